@@ -0,0 +1,39 @@
+// checked vs guard page memory accesses, per engine
+//
+//   g++ -std=c++23 -O2 -o guard bench/guard.cpp && ./guard examples/primes/ 20000000
+
+#include <chrono>
+#include "../src/cpu.hpp"
+
+int main(int argc, char** argv) {
+  auto prog = argc > 1 ? argv[1] : "../examples/primes/";
+  auto n = argc > 2 ? std::stoul(argv[2]) : 20000000UL;
+
+  auto engines = { CPU::ENGINE_INTERP, CPU::ENGINE_THREADED, CPU::ENGINE_JIT };
+  auto names = std::array{ "interp", "threaded", "jit" };
+
+  // the guest writes to the console, keep it out of the table
+  auto out = dup(1);
+  auto null = open("/dev/null", O_WRONLY);
+
+  for (auto engine : engines) {
+    for (auto guard_pages : { false, true }) {
+      auto config = Config();
+      config.guard_pages = guard_pages;
+      auto cpu = CPU(prog, config);
+      cpu.engine = engine;
+
+      std::cout << std::flush;
+      dup2(null, 1);
+      auto start = std::chrono::steady_clock::now();
+      cpu.steps(n);
+      auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << std::flush;
+      dup2(out, 1);
+
+      print(std::left, std::setw(10), names[engine], std::setw(9),
+            guard_pages ? "guarded" : "checked", std::right, std::fixed,
+            std::setprecision(1), std::setw(8), n / seconds / 1e6, " MIPS");
+    }
+  }
+}
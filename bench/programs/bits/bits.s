@@ -0,0 +1,158 @@
+# Zba/Zbb: every instruction on ROUNDS xorshift pairs (shifted and masked so
+# zero operands and zero bytes come up too), then SIEVES rounds of a sieve
+# of eratosthenes on a bitset, counting the primes with cpop and summing
+# them by walking the set bits with ctz.
+
+  .include "start.s"
+
+  .equ ROUNDS, 1 << 17
+  .equ SIEVES, 24
+  .equ BITS, 1 << 16
+  .equ SET, 0x10000
+
+main:
+  addi  sp, sp, -16
+  sw    ra, 12(sp)
+  sw    s0, 8(sp)
+  sw    s1, 4(sp)
+  sw    s2, 0(sp)
+
+  lw    a0, 0(zero)             # seed
+  li    s0, ROUNDS
+  li    s1, 0                   # checksum
+round:
+  jal   ra, xorshift
+  mv    s2, a0                  # x
+  jal   ra, xorshift            # y
+  sh1add t1, s2, a0
+  add   s1, s1, t1
+  sh2add t1, s2, a0
+  add   s1, s1, t1
+  sh3add t1, s2, a0
+  add   s1, s1, t1
+  andn  t1, s2, a0
+  add   s1, s1, t1
+  orn   t1, s2, a0
+  add   s1, s1, t1
+  xnor  t1, s2, a0
+  add   s1, s1, t1
+  max   t1, s2, a0
+  add   s1, s1, t1
+  maxu  t1, s2, a0
+  add   s1, s1, t1
+  min   t1, s2, a0
+  add   s1, s1, t1
+  minu  t1, s2, a0
+  add   s1, s1, t1
+  rol   t1, s2, a0
+  add   s1, s1, t1
+  ror   t1, s2, a0
+  add   s1, s1, t1
+  rori  t1, s2, 13
+  add   s1, s1, t1
+  srl   t2, s2, a0              # zero now and then
+  clz   t1, t2
+  add   s1, s1, t1
+  ctz   t1, t2
+  add   s1, s1, t1
+  cpop  t1, t2
+  add   s1, s1, t1
+  sext.b t1, s2
+  add   s1, s1, t1
+  sext.h t1, s2
+  add   s1, s1, t1
+  zext.h t1, s2
+  add   s1, s1, t1
+  and   t2, s2, a0              # some zero bytes
+  and   t2, t2, s1
+  orc.b t1, t2
+  add   s1, s1, t1
+  rev8  t1, s2
+  xor   s1, s1, t1
+  rori  s1, s1, 3
+  addi  s0, s0, -1
+  bnez  s0, round
+
+  li    s0, SIEVES
+sieve:
+  # all ones but 0 and 1
+  li    t0, SET
+  li    t1, SET + BITS / 8
+  li    t2, -1
+fill:
+  sw    t2, 0(t0)
+  addi  t0, t0, 4
+  bltu  t0, t1, fill
+  li    t0, SET
+  lw    t2, 0(t0)
+  andi  t2, t2, -4
+  sw    t2, 0(t0)
+
+  li    a1, 2                   # p
+next_prime:
+  mul   t0, a1, a1
+  li    t1, BITS
+  bgeu  t0, t1, sieved
+  srli  t2, a1, 5
+  li    t3, SET
+  sh2add t2, t2, t3
+  lw    t2, 0(t2)
+  srl   t2, t2, a1
+  andi  t2, t2, 1
+  beqz  t2, composite
+cross:                          # clear p*p, p*p + p, ...
+  srli  t2, t0, 5
+  li    t3, SET
+  sh2add t2, t2, t3
+  lw    t4, 0(t2)
+  li    t5, 1
+  sll   t5, t5, t0
+  andn  t4, t4, t5
+  sw    t4, 0(t2)
+  add   t0, t0, a1
+  bltu  t0, t1, cross
+composite:
+  addi  a1, a1, 1
+  j     next_prime
+sieved:
+
+  # count with cpop, sum by ctz over the set bits
+  li    t0, SET
+  li    t1, SET + BITS / 8
+  li    a2, 0                   # count
+  li    a3, 0                   # sum
+  li    a4, 0                   # bit index of the word
+count:
+  lw    t2, 0(t0)
+  cpop  t3, t2
+  add   a2, a2, t3
+walk:
+  beqz  t2, walked
+  ctz   t3, t2
+  add   t3, t3, a4
+  add   a3, a3, t3
+  addi  t4, t2, -1
+  and   t2, t2, t4
+  j     walk
+walked:
+  addi  a4, a4, 32
+  addi  t0, t0, 4
+  bltu  t0, t1, count
+
+  xor   s1, s1, a2
+  add   s1, s1, a3
+  rori  s1, s1, 1
+  addi  s0, s0, -1
+  bnez  s0, sieve
+
+  mv    a0, s1
+  lw    ra, 12(sp)
+  lw    s0, 8(sp)
+  lw    s1, 4(sp)
+  lw    s2, 0(sp)
+  addi  sp, sp, 16
+  ret
+
+  .data
+seed:
+  .word 0x9e3779b9
@@ -0,0 +1,17 @@
+#!/bin/sh
+# assembles the benchmark kernels into instruction_mem.bin/data_mem.bin pairs.
+# needs llvm-mc and llvm-objcopy with the riscv target.
+#
+#   bench/programs/build.sh [kernel...]
+
+set -e
+cd "$(dirname "$0")"
+[ $# -gt 0 ] || set -- sort crc matmul string muldiv float bits vector rvc csr
+for name in "$@"; do
+  c=-c
+  [ "$name" = rvc ] && c=+c
+  llvm-mc -triple=riscv32 -mattr=+m,+f,+d,+zba,+zbb,+zve32x,$c,-relax -filetype=obj -o "$name/$name.o" "$name/$name.s"
+  llvm-objcopy -O binary --only-section=.text "$name/$name.o" "$name/instruction_mem.bin"
+  llvm-objcopy -O binary --only-section=.data "$name/$name.o" "$name/data_mem.bin"
+  rm "$name/$name.o"
+done
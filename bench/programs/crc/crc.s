@@ -0,0 +1,79 @@
+# table driven CRC-32 (as in zlib) of a 64 KiB pseudo random buffer, PASSES
+# times in a row, so the checksum is the CRC of the buffer repeated PASSES
+# times. the table is computed bit by bit first.
+
+  .include "start.s"
+
+  .equ TABLE, 0x10000
+  .equ BUFFER, 0x20000
+  .equ SIZE, 0x10000
+  .equ PASSES, 64
+
+main:
+  addi  sp, sp, -32
+  sw    ra, 28(sp)
+  sw    s0, 24(sp)
+  sw    s1, 20(sp)
+  sw    s2, 16(sp)
+  sw    s3, 12(sp)
+
+  li    s0, TABLE
+  li    t6, 0xedb88320
+  li    t5, 256
+  li    t0, 0                   # table index
+table:
+  mv    t1, t0
+  li    t2, 8
+bit:
+  andi  t3, t1, 1
+  srli  t1, t1, 1
+  beqz  t3, 1f
+  xor   t1, t1, t6
+1:
+  addi  t2, t2, -1
+  bnez  t2, bit
+  slli  t3, t0, 2
+  add   t3, t3, s0
+  sw    t1, 0(t3)
+  addi  t0, t0, 1
+  bltu  t0, t5, table
+
+  lw    a0, 0(zero)             # seed
+  li    s1, BUFFER
+  li    s2, BUFFER + SIZE
+fill:
+  jal   ra, xorshift
+  sw    a0, 0(s1)
+  addi  s1, s1, 4
+  bltu  s1, s2, fill
+
+  li    a1, -1                  # crc
+  li    s3, PASSES
+pass:
+  li    s1, BUFFER
+byte:
+  lbu   t0, 0(s1)
+  xor   t0, t0, a1
+  andi  t0, t0, 0xff
+  slli  t0, t0, 2
+  add   t0, t0, s0
+  lw    t0, 0(t0)
+  srli  a1, a1, 8
+  xor   a1, a1, t0
+  addi  s1, s1, 1
+  bltu  s1, s2, byte
+  addi  s3, s3, -1
+  bnez  s3, pass
+
+  not   a0, a1
+  lw    ra, 28(sp)
+  lw    s0, 24(sp)
+  lw    s1, 20(sp)
+  lw    s2, 16(sp)
+  lw    s3, 12(sp)
+  addi  sp, sp, 32
+  ret
+
+  .data
+seed:
+  .word 0x7f4a7c15
@@ -0,0 +1,215 @@
+# Zicsr and Zicntr: an adaptive popcount, ROUNDS times. each round takes a
+# chunk of a dense or a sparse buffer, times a cpop loop and a loop clearing
+# the lowest set bit on its first words with instret and counts the whole
+# chunk with the cheaper one. cycle and time are checked to never go
+# backwards, frm, fflags, fcsr, vl, vtype and vlenb read once, and vxrm
+# and vxsat written and read back through vcsr and the other way round.
+# the checksum depends on instret, not on cycle, the time or VLEN.
+
+  .include "start.s"
+
+  .equ ROUNDS, 4000
+  .equ N, 4096                  # words per buffer
+  .equ CHUNK, 256               # words counted per round
+  .equ SAMPLE, 16               # words timed per variant
+  .equ DENSE, 0x10000
+  .equ SPARSE, 0x20000
+
+main:
+  addi  sp, sp, -48
+  sw    ra, 44(sp)
+  sw    s0, 40(sp)
+  sw    s1, 36(sp)
+  sw    s2, 32(sp)
+  sw    s3, 28(sp)
+  sw    s4, 24(sp)
+  sw    s5, 20(sp)
+  sw    s6, 16(sp)
+  sw    s7, 12(sp)
+  sw    s8, 8(sp)
+
+  # DENSE: xorshift words, SPARSE: a single bit in every 8th word or so
+  lw    a0, 0(zero)             # seed
+  li    s3, DENSE
+  li    s4, SPARSE
+  li    s5, DENSE + 4 * N
+fill:
+  jal   ra, xorshift
+  sw    a0, 0(s3)
+  andi  t1, a0, 7
+  li    t2, 0
+  bnez  t1, 1f
+  srli  t1, a0, 27
+  li    t2, 1
+  sll   t2, t2, t1
+1:
+  sw    t2, 0(s4)
+  addi  s3, s3, 4
+  addi  s4, s4, 4
+  bltu  s3, s5, fill
+  mv    s2, a0                  # xorshift state
+
+  li    s0, ROUNDS
+  li    s1, 0                   # checksum
+  li    s3, 0                   # last cycle
+  li    s4, 0                   # last time, high and low half
+  li    s5, 0
+round:
+  # a chunk of DENSE or SPARSE, by the next random number
+  mv    a0, s2
+  jal   ra, xorshift
+  mv    s2, a0
+  srli  t1, a0, 8
+  li    t2, N - CHUNK
+  and   t1, t1, t2
+  li    t2, DENSE
+  andi  t3, a0, 1
+  beqz  t3, 1f
+  li    t2, SPARSE
+1:
+  sh2add s6, t1, t2
+
+  # instructions per variant on the first SAMPLE words
+  rdinstret s7
+  mv    a0, s6
+  li    a1, SAMPLE
+  jal   ra, pop_cpop
+  rdinstret t1
+  sub   s7, t1, s7
+  rdinstret s8
+  mv    a0, s6
+  li    a1, SAMPLE
+  jal   ra, pop_clear
+  rdinstret t1
+  sub   s8, t1, s8
+  add   s1, s1, s7
+  xor   s1, s1, s8
+
+  # the whole chunk with the cheaper one
+  mv    a0, s6
+  li    a1, CHUNK
+  bltu  s8, s7, 2f
+  jal   ra, pop_cpop
+  j     3f
+2:
+  jal   ra, pop_clear
+  addi  s1, s1, 1
+3:
+  add   s1, s1, a0
+  rori  s1, s1, 5
+
+  # cycle never goes backwards
+  rdcycle t1
+  sltu  t2, t1, s3
+  add   s1, s1, t2
+  mv    s3, t1
+
+  # neither does time, read as 64 bits: the high half again in case the
+  # low one wrapped in between
+4:
+  rdtimeh t1
+  rdtime t2
+  rdtimeh t3
+  bne   t1, t3, 4b
+  sltu  t4, t1, s4
+  bne   t1, s4, 5f
+  sltu  t4, t2, s5
+5:
+  add   s1, s1, t4
+  mv    s4, t1
+  mv    s5, t2
+
+  addi  s0, s0, -1
+  bnez  s0, round
+
+  # 1/3 rounded toward zero through frm, inexact in fflags
+  fsrmi 1
+  fsflagsi 0
+  li    t1, 1
+  fcvt.s.w ft0, t1
+  li    t1, 3
+  fcvt.s.w ft1, t1
+  fdiv.s ft2, ft0, ft1
+  fmv.x.w t1, ft2
+  add   s1, s1, t1
+  frflags t1
+  add   s1, s1, t1
+  frcsr t1
+  xor   s1, s1, t1
+  fscsr zero
+
+  # vl and vtype as vsetvli left them, vl within vlenb
+  li    t1, 4
+  vsetvli t1, t1, e8, m1, ta, ma
+  csrr  t1, vl
+  add   s1, s1, t1
+  csrr  t1, vtype
+  xor   s1, s1, t1
+  csrr  t2, vlenb
+  csrr  t1, vl
+  sltu  t1, t2, t1
+  add   s1, s1, t1
+
+  # vxrm and vxsat are fields of vcsr, vstart is 0 and stays there
+  csrwi vxrm, 2
+  csrwi vxsat, 1
+  csrr  t1, vcsr
+  add   s1, s1, t1
+  csrwi vcsr, 6
+  csrr  t1, vxrm
+  slli  t1, t1, 3
+  add   s1, s1, t1
+  csrr  t1, vxsat
+  add   s1, s1, t1
+  csrw  vstart, zero
+  csrr  t1, vstart
+  add   s1, s1, t1
+  csrwi vcsr, 0
+
+  mv    a0, s1
+  lw    ra, 44(sp)
+  lw    s0, 40(sp)
+  lw    s1, 36(sp)
+  lw    s2, 32(sp)
+  lw    s3, 28(sp)
+  lw    s4, 24(sp)
+  lw    s5, 20(sp)
+  lw    s6, 16(sp)
+  lw    s7, 12(sp)
+  lw    s8, 8(sp)
+  addi  sp, sp, 48
+  ret
+
+# a0 = set bits of the a1 words at a0
+pop_cpop:
+  li    t0, 0
+1:
+  lw    t1, 0(a0)
+  cpop  t1, t1
+  add   t0, t0, t1
+  addi  a0, a0, 4
+  addi  a1, a1, -1
+  bnez  a1, 1b
+  mv    a0, t0
+  ret
+
+# the same, a bit at a time, cheaper on sparse words
+pop_clear:
+  li    t0, 0
+1:
+  lw    t1, 0(a0)
+  beqz  t1, 3f
+2:
+  addi  t2, t1, -1
+  and   t1, t1, t2
+  addi  t0, t0, 1
+  bnez  t1, 2b
+3:
+  addi  a0, a0, 4
+  addi  a1, a1, -1
+  bnez  a1, 1b
+  mv    a0, t0
+  ret
+
+  .data
+  .word 0x2545f491
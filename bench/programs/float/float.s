@@ -0,0 +1,139 @@
+# RV32FD: a W x H mandelbrot in double, then ROUNDS passes of
+# a[i] = sqrt(a[i] * a[i] + 1) / 2 over a float array, summed in double.
+# the checksum adds up the iteration counts and the final z of every point
+# and folds in the bits of the sum.
+
+  .include "start.s"
+
+  .equ W, 160
+  .equ H, 120
+  .equ MAXIT, 64
+  .equ ARR, 0x10000
+  .equ N, 1024
+  .equ ROUNDS, 800
+
+main:
+  addi  sp, sp, -32
+  sw    ra, 28(sp)
+  sw    s0, 24(sp)
+  sw    s1, 20(sp)
+  sw    s2, 16(sp)
+  sw    s3, 12(sp)
+
+  li    t0, 4
+  fcvt.d.w fs0, t0              # escape radius squared
+  li    t0, 3
+  fcvt.d.w ft0, t0
+  li    t0, W
+  fcvt.d.w ft1, t0
+  fdiv.d fs2, ft0, ft1          # dx = 3 / W
+  li    t0, 2
+  fcvt.d.w ft0, t0
+  li    t0, H
+  fcvt.d.w ft1, t0
+  fdiv.d fs3, ft0, ft1          # dy = 2 / H
+  li    t0, 1
+  fcvt.d.w fs10, t0
+  li    t0, 2
+  fcvt.d.w fs11, t0
+
+  li    s3, 0                   # checksum
+  li    s0, 0                   # y
+row:
+  fcvt.d.w ft0, s0
+  fmul.d fs4, ft0, fs3
+  fsub.d fs4, fs4, fs10         # ci = y * dy - 1
+  li    s1, 0                   # x
+point:
+  fcvt.d.w ft0, s1
+  fmul.d fs5, ft0, fs2
+  fsub.d fs5, fs5, fs11         # cr = x * dx - 2
+  fcvt.d.w fa0, zero            # zr
+  fcvt.d.w fa1, zero            # zi
+  li    s2, 0
+iterate:
+  fmul.d ft2, fa0, fa0
+  fmul.d ft3, fa1, fa1
+  fadd.d ft4, ft2, ft3
+  flt.d t1, fs0, ft4
+  bnez  t1, escaped
+  fmul.d ft5, fa0, fa1
+  fadd.d fa1, ft5, ft5
+  fadd.d fa1, fa1, fs4          # zi = 2 zr zi + ci
+  fsub.d fa0, ft2, ft3
+  fadd.d fa0, fa0, fs5          # zr = zr^2 - zi^2 + cr
+  addi  s2, s2, 1
+  li    t1, MAXIT
+  bltu  s2, t1, iterate
+escaped:
+  add   s3, s3, s2
+  fmul.d ft0, fa0, fa1
+  fmadd.d ft0, ft0, fs11, fa0   # 2 zr zi + zr, scaled up before truncating
+  fcvt.w.d t1, ft0, rtz
+  add   s3, s3, t1
+  addi  s1, s1, 1
+  li    t0, W
+  bltu  s1, t0, point
+  addi  s0, s0, 1
+  li    t0, H
+  bltu  s0, t0, row
+
+  # a[i] = i / 7
+  li    t0, ARR
+  li    t1, 0
+  li    t2, 7
+  fcvt.s.w ft1, t2
+fill:
+  fcvt.s.w ft0, t1
+  fdiv.s ft0, ft0, ft1
+  fsw   ft0, 0(t0)
+  addi  t0, t0, 4
+  addi  t1, t1, 1
+  li    t2, N
+  bltu  t1, t2, fill
+
+  li    t3, 0x3f000000
+  fmv.w.x fs7, t3               # 0.5f
+  li    t3, 0x3f800000
+  fmv.w.x fs8, t3               # 1.0f
+  fcvt.d.w fs6, zero            # sum
+  li    s0, ROUNDS
+  li    t1, ARR + 4 * N
+pass:
+  li    t0, ARR
+element:
+  flw   ft0, 0(t0)
+  fmadd.s ft1, ft0, ft0, fs8
+  fsqrt.s ft1, ft1
+  fmul.s ft1, ft1, fs7
+  fsw   ft1, 0(t0)
+  fcvt.d.s ft2, ft1
+  fadd.d fs6, fs6, ft2
+  addi  t0, t0, 4
+  bltu  t0, t1, element
+  fsd   fs6, 0(t1)
+  fld   fs6, 0(t1)
+  addi  s0, s0, -1
+  bnez  s0, pass
+
+  lw    t0, 0(t1)
+  xor   s3, s3, t0
+  lw    t0, 4(t1)
+  xor   s3, s3, t0
+  fcvt.s.d ft0, fs6
+  fmv.x.w t0, ft0
+  add   s3, s3, t0
+  fclass.d t0, fs6
+  add   s3, s3, t0
+
+  mv    a0, s3
+  lw    ra, 28(sp)
+  lw    s0, 24(sp)
+  lw    s1, 20(sp)
+  lw    s2, 16(sp)
+  lw    s3, 12(sp)
+  addi  sp, sp, 32
+  ret
+
+  .data
+  .word 0                       # the array lives past the image
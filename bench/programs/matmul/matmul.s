@@ -0,0 +1,99 @@
+# N x N integer matrix multiply C = A * B, ROUNDS times, each round feeding the
+# low bytes of C back in as A. rv32i has no multiplier, so every product goes
+# through mulsi3. the checksum adds up every C.
+
+  .include "start.s"
+
+  .equ A, 0x10000
+  .equ B, 0x11000
+  .equ C, 0x12000
+  .equ N, 32
+  .equ ROUNDS, 12
+
+main:
+  addi  sp, sp, -48
+  sw    ra, 44(sp)
+  sw    s0, 40(sp)
+  sw    s1, 36(sp)
+  sw    s2, 32(sp)
+  sw    s3, 28(sp)
+  sw    s4, 24(sp)
+  sw    s5, 20(sp)
+  sw    s6, 16(sp)
+  sw    s7, 12(sp)
+  sw    s8, 8(sp)
+  sw    s9, 4(sp)
+
+  # A and B are 4N^2 bytes apart, fill both with bytes
+  lw    a0, 0(zero)             # seed
+  li    s0, A
+  li    s1, C
+fill:
+  jal   ra, xorshift
+  andi  t1, a0, 0xff
+  sw    t1, 0(s0)
+  addi  s0, s0, 4
+  bltu  s0, s1, fill
+
+  li    s3, ROUNDS
+  li    s4, 0                   # checksum
+  li    s9, A + 4 * N * N
+round:
+  li    s0, A                   # row of A
+  li    s2, C
+row:
+  li    s1, B                   # column of B
+column:
+  mv    s5, s0
+  mv    s6, s1
+  li    s7, 0                   # sum
+  li    s8, N
+dot:
+  lw    a0, 0(s5)
+  lw    a1, 0(s6)
+  jal   ra, mulsi3
+  add   s7, s7, a0
+  addi  s5, s5, 4
+  addi  s6, s6, 4 * N
+  addi  s8, s8, -1
+  bnez  s8, dot
+  sw    s7, 0(s2)
+  add   s4, s4, s7
+  addi  s2, s2, 4
+  addi  s1, s1, 4
+  li    t0, B + 4 * N
+  bltu  s1, t0, column
+  addi  s0, s0, 4 * N
+  bltu  s0, s9, row
+
+  li    t2, A
+  li    t3, C
+feed:
+  lw    t1, 0(t3)
+  andi  t1, t1, 0xff
+  sw    t1, 0(t2)
+  addi  t2, t2, 4
+  addi  t3, t3, 4
+  bltu  t2, s9, feed
+
+  addi  s3, s3, -1
+  bnez  s3, round
+
+  mv    a0, s4
+  lw    ra, 44(sp)
+  lw    s0, 40(sp)
+  lw    s1, 36(sp)
+  lw    s2, 32(sp)
+  lw    s3, 28(sp)
+  lw    s4, 24(sp)
+  lw    s5, 20(sp)
+  lw    s6, 16(sp)
+  lw    s7, 12(sp)
+  lw    s8, 8(sp)
+  lw    s9, 4(sp)
+  addi  sp, sp, 48
+  ret
+
+  .data
+seed:
+  .word 0x9e3779b9
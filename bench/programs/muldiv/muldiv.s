@@ -0,0 +1,70 @@
+# RV32M products and quotients of ROUNDS xorshift pairs. one divisor in 16
+# is 0 and one is -1, half of the latter with a dividend of -2^31, so the
+# checksum covers division by zero and the signed overflow as well.
+
+  .include "start.s"
+
+  .equ ROUNDS, 1 << 19
+
+main:
+  addi  sp, sp, -16
+  sw    ra, 12(sp)
+  sw    s0, 8(sp)
+  sw    s1, 4(sp)
+
+  lw    a0, 0(zero)             # seed
+  li    s0, ROUNDS
+  li    s1, 0                   # checksum
+round:
+  jal   ra, xorshift
+  mv    a1, a0                  # x
+  jal   ra, xorshift            # y
+
+  mul   t1, a1, a0
+  add   s1, s1, t1
+  mulh  t1, a1, a0
+  xor   s1, s1, t1
+  mulhsu t1, a1, a0
+  add   s1, s1, t1
+  mulhu t1, a1, a0
+  xor   s1, s1, t1
+
+  # divisor t2 = y >> 20 (signed), 0 or -1, dividend t3 = x or -2^31
+  srai  t2, a0, 20
+  mv    t3, a1
+  andi  t4, a0, 15
+  bnez  t4, 1f
+  li    t2, 0
+1:
+  li    t5, 1
+  bne   t4, t5, 2f
+  li    t2, -1
+  andi  t4, a0, 16
+  beqz  t4, 2f
+  li    t3, 0x80000000
+2:
+  div   t1, t3, t2
+  add   s1, s1, t1
+  divu  t1, t3, t2
+  xor   s1, s1, t1
+  rem   t1, t3, t2
+  add   s1, s1, t1
+  remu  t1, t3, t2
+  xor   s1, s1, t1
+  slli  t1, s1, 1               # rotate, so equal terms don't cancel
+  srli  s1, s1, 31
+  or    s1, s1, t1
+
+  addi  s0, s0, -1
+  bnez  s0, round
+
+  mv    a0, s1
+  lw    ra, 12(sp)
+  lw    s0, 8(sp)
+  lw    s1, 4(sp)
+  addi  sp, sp, 16
+  ret
+
+  .data
+seed:
+  .word 0x2545f491
@@ -0,0 +1,221 @@
+# C: assembled with the C extension, so every instruction that has a
+# compressed form gets it and the 32 bit ones that are left start on any
+# halfword. ROUNDS times a heapsort of N pseudo random words, hashed once
+# sorted, and a pass over the compressible instructions (integer, F and D
+# loads and stores, jumps, calls and branches) on xorshift values. the same
+# source without C gives the same checksum.
+
+  .include "start.s"
+
+  .equ ARRAY, 0x10000
+  .equ N, 2048
+  .equ ROUNDS, 12
+  .equ FORMS, 4096              # passes over the forms per round
+
+main:
+  addi  sp, sp, -16
+  sw    ra, 12(sp)
+  sw    s0, 8(sp)
+  sw    s1, 4(sp)
+  sw    s2, 0(sp)
+
+  lw    a0, 0(zero)             # seed
+  li    s0, ROUNDS
+  li    s1, 0                   # checksum
+round:
+  li    s2, ARRAY
+  li    a5, ARRAY + 4 * N
+fill:
+  jal   ra, xorshift
+  sw    a0, 0(s2)
+  addi  s2, s2, 4
+  bltu  s2, a5, fill
+  mv    s2, a0
+
+  li    a0, ARRAY
+  li    a1, N
+  jal   ra, heapsort
+
+  li    a0, ARRAY
+  li    a1, N
+  jal   ra, hash
+  xor   s1, s1, a0
+
+  mv    a0, s2
+  li    s2, FORMS
+1:
+  jal   ra, forms
+  addi  s2, s2, -1
+  bnez  s2, 1b
+
+  slli  a1, s1, 7
+  srli  a2, s1, 25
+  or    s1, a1, a2
+  addi  s0, s0, -1
+  bnez  s0, round
+
+  mv    a0, s1
+  lw    ra, 12(sp)
+  lw    s0, 8(sp)
+  lw    s1, 4(sp)
+  lw    s2, 0(sp)
+  addi  sp, sp, 16
+  ret
+
+# sorts the a1 signed words at a0
+heapsort:
+  addi  sp, sp, -16
+  sw    ra, 12(sp)
+  sw    s0, 8(sp)
+  sw    s1, 4(sp)
+  mv    s0, a1
+  srli  s1, a1, 1               # heapify from the last parent
+1:
+  beqz  s1, 2f
+  addi  s1, s1, -1
+  mv    a2, s1
+  mv    a1, s0
+  jal   ra, sift
+  j     1b
+2:
+  addi  s0, s0, -1              # move the max behind the heap
+  blez  s0, 3f
+  slli  a3, s0, 2
+  add   a3, a3, a0
+  lw    a4, 0(a0)
+  lw    a5, 0(a3)
+  sw    a5, 0(a0)
+  sw    a4, 0(a3)
+  li    a2, 0
+  mv    a1, s0
+  jal   ra, sift
+  j     2b
+3:
+  lw    ra, 12(sp)
+  lw    s0, 8(sp)
+  lw    s1, 4(sp)
+  addi  sp, sp, 16
+  ret
+
+# sifts element a2 down the heap of a1 words at a0, clobbers a2 to a5, t0, t1
+sift:
+  slli  a3, a2, 1
+  addi  a3, a3, 1               # left child
+  bge   a3, a1, 2f
+  slli  a4, a3, 2
+  add   a4, a4, a0
+  lw    a5, 0(a4)
+  addi  t0, a3, 1               # right child
+  bge   t0, a1, 1f
+  lw    t1, 4(a4)
+  bge   a5, t1, 1f
+  mv    a3, t0
+  mv    a5, t1
+1:
+  slli  a4, a2, 2
+  add   a4, a4, a0
+  lw    t1, 0(a4)
+  bge   t1, a5, 2f
+  sw    a5, 0(a4)
+  slli  a4, a3, 2
+  add   a4, a4, a0
+  sw    t1, 0(a4)
+  mv    a2, a3
+  j     sift
+2:
+  ret
+
+# a0 = hash of the a1 words at a0, ~0 if they are out of order
+hash:
+  li    a2, 0
+  lw    a3, 0(a0)
+1:
+  lw    a4, 0(a0)
+  blt   a4, a3, 2f
+  mv    a3, a4
+  slli  a5, a2, 5
+  add   a2, a2, a5
+  xor   a2, a2, a4
+  addi  a0, a0, 4
+  addi  a1, a1, -1
+  bnez  a1, 1b
+  mv    a0, a2
+  ret
+2:
+  li    a0, -1
+  ret
+
+# one xorshift step of a0 run through the compressible forms into s1
+forms:
+  mv    a5, ra
+  jal   ra, xorshift
+  mv    ra, a5
+  mv    a1, a0
+  srli  a1, a1, 7
+  mv    a2, a0
+  srai  a2, a2, 5
+  andi  a2, a2, -17
+  sub   a1, a1, a2
+  xor   a1, a1, a0
+  or    a2, a2, a1
+  and   a1, a1, a2
+  slli  a1, a1, 3
+  add   s1, s1, a1
+  addi  s1, s1, -7
+  li    a3, 13
+  lui   a4, 0x1f
+  add   a4, a4, a3
+  xor   s1, s1, a4
+
+  addi  sp, sp, -64
+  addi  a5, sp, 16
+  sw    a1, 0(a5)
+  sw    a2, 20(sp)
+  lw    a3, 4(a5)
+  lw    a4, 16(sp)
+  sub   a3, a3, a4
+  xor   s1, s1, a3
+  fcvt.s.w fa0, a1
+  fsw   fa0, 8(a5)
+  flw   fa1, 24(sp)
+  fcvt.d.w fa2, a2
+  fsd   fa2, 32(sp)
+  fld   fa3, 16(a5)
+  fadd.d fa3, fa3, fa2
+  fsw   fa1, 40(sp)
+  flw   fa4, 24(a5)
+  fsd   fa3, 32(a5)
+  fld   fa5, 48(sp)
+  fcvt.w.s a3, fa4
+  fcvt.w.d a4, fa5
+  addi  sp, sp, 64
+  add   s1, s1, a3
+  xor   s1, s1, a4
+
+  andi  a3, a0, 3
+  andi  a4, a0, 12
+  beqz  a3, 1f
+  addi  s1, s1, 1
+1:
+  bnez  a4, 2f
+  addi  s1, s1, 3
+2:
+  mv    a2, ra
+  jal   ra, bump
+  la    a1, bump
+  jalr  ra, 0(a1)
+  mv    ra, a2
+  j     3f
+  addi  s1, s1, 9
+3:
+  nop
+  ret
+
+bump:
+  addi  s1, s1, 5
+  slli  a1, s1, 1
+  xor   s1, s1, a1
+  ret
+
+  .data
+  .word 0x2545f491
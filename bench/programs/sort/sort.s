@@ -0,0 +1,79 @@
+# insertion sort of N pseudo random signed words, ROUNDS times over.
+# the checksum hashes every sorted array, or is ~0 if one was out of order.
+
+  .include "start.s"
+
+  .equ ARRAY, 0x10000
+  .equ N, 1024
+  .equ ROUNDS, 16
+
+main:
+  addi  sp, sp, -32
+  sw    ra, 28(sp)
+  sw    s0, 24(sp)
+  sw    s1, 20(sp)
+  sw    s2, 16(sp)
+  sw    s3, 12(sp)
+  sw    s4, 8(sp)
+
+  lw    a0, 0(zero)             # seed
+  li    s2, ARRAY
+  li    s1, ARRAY + 4 * N
+  li    s3, ROUNDS
+  li    s4, 0                   # checksum
+
+round:
+  mv    s0, s2
+fill:
+  jal   ra, xorshift
+  sw    a0, 0(s0)
+  addi  s0, s0, 4
+  bltu  s0, s1, fill
+
+  addi  s0, s2, 4
+outer:
+  lw    t1, 0(s0)               # key
+  addi  t2, s0, -4
+inner:
+  bltu  t2, s2, place
+  lw    t3, 0(t2)
+  bge   t1, t3, place
+  sw    t3, 4(t2)
+  addi  t2, t2, -4
+  j     inner
+place:
+  sw    t1, 4(t2)
+  addi  s0, s0, 4
+  bltu  s0, s1, outer
+
+  mv    s0, s2
+  addi  t6, s1, -4
+check:
+  lw    t1, 0(s0)
+  lw    t2, 4(s0)
+  blt   t2, t1, unsorted
+  slli  t3, s4, 5
+  add   s4, s4, t3
+  xor   s4, s4, t1
+  addi  s0, s0, 4
+  bltu  s0, t6, check
+
+  addi  s3, s3, -1
+  bnez  s3, round
+  mv    a0, s4
+  j     done
+unsorted:
+  li    a0, -1
+done:
+  lw    ra, 28(sp)
+  lw    s0, 24(sp)
+  lw    s1, 20(sp)
+  lw    s2, 16(sp)
+  lw    s3, 12(sp)
+  lw    s4, 8(sp)
+  addi  sp, sp, 32
+  ret
+
+  .data
+seed:
+  .word 0x2545f491
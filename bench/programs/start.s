@@ -0,0 +1,57 @@
+# entry point and helpers shared by the benchmark kernels.
+#
+# every kernel defines main, which returns a checksum of its work in a0. the
+# checksum is printed to the console as 8 hex digits before the ebreak.
+
+  .equ CONSOLE, 0x5000
+
+  .text
+_start:
+  lui   sp, 0x3ff
+  jal   ra, main
+  jal   ra, print_hex
+  ebreak
+
+# prints a0 as 8 hex digits and a newline
+print_hex:
+  li    t0, CONSOLE
+  li    t1, 28
+  li    t4, 10
+1:
+  srl   t2, a0, t1
+  andi  t2, t2, 0xf
+  addi  t3, t2, '0'
+  blt   t2, t4, 2f
+  addi  t3, t2, 'a' - 10
+2:
+  sb    t3, 0(t0)
+  addi  t1, t1, -4
+  bgez  t1, 1b
+  li    t3, '\n'
+  sb    t3, 0(t0)
+  ret
+
+# one xorshift32 step of the state in a0, clobbers t0
+xorshift:
+  slli  t0, a0, 13
+  xor   a0, a0, t0
+  srli  t0, a0, 17
+  xor   a0, a0, t0
+  slli  t0, a0, 5
+  xor   a0, a0, t0
+  ret
+
+# a0 * a1 by shift and add, as rv32i code without a multiplier gets it.
+# clobbers t0, t1, a1
+mulsi3:
+  li    t0, 0
+1:
+  andi  t1, a1, 1
+  beqz  t1, 2f
+  add   t0, t0, a0
+2:
+  slli  a0, a0, 1
+  srli  a1, a1, 1
+  bnez  a1, 1b
+  mv    a0, t0
+  ret
@@ -0,0 +1,160 @@
+# byte wise string processing over a NUL terminated text, ROUNDS times: strlen,
+# an upper case copy, a word count, a naive search for a pattern, an in place
+# reverse and a djb2 hash of the result, all folded into the checksum.
+
+  .include "start.s"
+
+  .equ BUF, 0x10000
+  .equ ROUNDS, 512
+
+  # data_mem.bin is loaded at 0
+  .equ PATTERN, 0
+  .equ TEXT, 8
+
+  .data
+  .asciz "THAT"
+  .org TEXT
+  .ascii "Four score and seven years ago our fathers brought forth on this continent, a new\n"
+  .ascii "nation, conceived in Liberty, and dedicated to the proposition that all men are\n"
+  .ascii "created equal.\n"
+  .ascii "Now we are engaged in a great civil war, testing whether that nation, or any nation\n"
+  .ascii "so conceived and so dedicated, can long endure. We are met on a great battle-field\n"
+  .ascii "of that war. We have come to dedicate a portion of that field, as a final resting\n"
+  .ascii "place for those who here gave their lives that that nation might live. It is\n"
+  .ascii "altogether fitting and proper that we should do this.\n"
+  .ascii "But, in a larger sense, we can not dedicate -- we can not consecrate -- we can not\n"
+  .ascii "hallow -- this ground. The brave men, living and dead, who struggled here, have\n"
+  .ascii "consecrated it, far above our poor power to add or detract. The world will little\n"
+  .ascii "note, nor long remember what we say here, but it can never forget what they did\n"
+  .ascii "here. It is for us the living, rather, to be dedicated here to the unfinished work\n"
+  .ascii "which they who fought here have thus far so nobly advanced. It is rather for us to\n"
+  .ascii "be here dedicated to the great task remaining before us -- that from these honored\n"
+  .ascii "dead we take increased devotion to that cause for which they gave the last full\n"
+  .ascii "measure of devotion -- that we here highly resolve that these dead shall not have\n"
+  .ascii "died in vain -- that this nation, under God, shall have a new birth of freedom --\n"
+  .ascii "and that government of the people, by the people, for the people, shall not perish\n"
+  .asciz "from the earth.\n"
+
+  .text
+main:
+  addi  sp, sp, -32
+  sw    ra, 28(sp)
+  sw    s0, 24(sp)
+  sw    s1, 20(sp)
+  sw    s2, 16(sp)
+  sw    s3, 12(sp)
+  sw    s4, 8(sp)
+
+  li    s3, ROUNDS
+  li    s4, 0                   # checksum
+round:
+  # strlen
+  li    t0, TEXT
+1:
+  lbu   t1, 0(t0)
+  addi  t0, t0, 1
+  bnez  t1, 1b
+  addi  s0, t0, -1 - TEXT       # length
+
+  # upper case copy, with the NUL
+  li    t0, TEXT
+  li    t2, BUF
+  li    t4, 'a'
+  li    t5, 'z'
+1:
+  lbu   t1, 0(t0)
+  bltu  t1, t4, 2f
+  bltu  t5, t1, 2f
+  addi  t1, t1, 'A' - 'a'
+2:
+  sb    t1, 0(t2)
+  addi  t0, t0, 1
+  addi  t2, t2, 1
+  bnez  t1, 1b
+
+  # words, runs of characters above ' '
+  li    s1, 0
+  li    t0, BUF
+  li    t3, ' '
+  li    t2, ' '                 # previous character
+1:
+  lbu   t1, 0(t0)
+  beqz  t1, 3f
+  bgeu  t3, t1, 2f
+  bltu  t3, t2, 2f
+  addi  s1, s1, 1
+2:
+  mv    t2, t1
+  addi  t0, t0, 1
+  j     1b
+3:
+
+  # occurrences of the pattern
+  li    s2, 0
+  li    t0, BUF
+  li    t6, BUF
+  add   t6, t6, s0              # end
+1:
+  mv    t1, t0
+  li    t2, PATTERN
+2:
+  lbu   t4, 0(t2)
+  beqz  t4, 3f                  # whole pattern matched
+  bgeu  t1, t6, 4f
+  lbu   t3, 0(t1)
+  bne   t3, t4, 4f
+  addi  t1, t1, 1
+  addi  t2, t2, 1
+  j     2b
+3:
+  addi  s2, s2, 1
+4:
+  addi  t0, t0, 1
+  bltu  t0, t6, 1b
+
+  # reverse
+  li    t0, BUF
+  addi  t1, t6, -1
+1:
+  bgeu  t0, t1, 2f
+  lbu   t2, 0(t0)
+  lbu   t3, 0(t1)
+  sb    t3, 0(t0)
+  sb    t2, 0(t1)
+  addi  t0, t0, 1
+  addi  t1, t1, -1
+  j     1b
+2:
+
+  # djb2
+  li    a0, 5381
+  li    t0, BUF
+1:
+  lbu   t1, 0(t0)
+  slli  t2, a0, 5
+  add   a0, a0, t2
+  add   a0, a0, t1
+  addi  t0, t0, 1
+  bltu  t0, t6, 1b
+
+  slli  t2, s4, 5
+  add   s4, s4, t2
+  xor   s4, s4, a0
+  add   s4, s4, s1
+  slli  t2, s2, 8
+  add   s4, s4, t2
+  slli  t2, s0, 16
+  add   s4, s4, t2
+
+  addi  s3, s3, -1
+  bnez  s3, round
+
+  mv    a0, s4
+  lw    ra, 28(sp)
+  lw    s0, 24(sp)
+  lw    s1, 20(sp)
+  lw    s2, 16(sp)
+  lw    s3, 12(sp)
+  lw    s4, 8(sp)
+  addi  sp, sp, 32
+  ret
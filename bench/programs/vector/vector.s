@@ -0,0 +1,350 @@
+# V (Zve32x): strip mined loops, ROUNDS times: a misaligned memcpy, memset,
+# strlen with fault-only-first loads (once up to the last byte of RAM), a
+# byte count, a dot product, strided column sums with min/max reductions and
+# a masked clamp over halfwords, all folded into the checksum. written not
+# to depend on VLEN.
+
+  .include "start.s"
+
+  .equ ROUNDS, 96
+  .equ N, 1 << 16               # bytes per buffer
+  .equ SRC, 0x10000
+  .equ DST, 0x20000
+  .equ TEXT, 0x30000
+  .equ MASK, 0x40000
+  .equ RAM_END, 5000000         # CPU Config::ram_size
+
+main:
+  addi  sp, sp, -16
+  sw    ra, 12(sp)
+  sw    s0, 8(sp)
+  sw    s1, 4(sp)
+  sw    s2, 0(sp)
+
+  # SRC: xorshift words, TEXT: the same bytes without zeros
+  lw    a0, 0(zero)             # seed
+  li    t1, SRC
+  li    t2, SRC + N
+fill:
+  jal   ra, xorshift
+  sw    a0, 0(t1)
+  addi  t1, t1, 4
+  bltu  t1, t2, fill
+  li    a1, SRC
+  li    a2, TEXT
+  li    a3, N
+1:
+  vsetvli t0, a3, e8, m8, ta, ma
+  vle8.v v8, (a1)
+  vor.vi v8, v8, 1
+  vse8.v v8, (a2)
+  add   a1, a1, t0
+  add   a2, a2, t0
+  sub   a3, a3, t0
+  bnez  a3, 1b
+
+  # a string of 39 bytes that ends with the last byte of RAM
+  li    t1, RAM_END - 40
+  li    t2, RAM_END - 1
+  li    t3, 'v'
+2:
+  sb    t3, 0(t1)
+  addi  t1, t1, 1
+  bltu  t1, t2, 2b
+  sb    zero, 0(t2)
+
+  li    s0, ROUNDS
+  li    s1, 0                   # checksum
+round:
+  # memcpy(DST, SRC + round % 16, N - 16), sum of DST
+  li    a0, DST
+  andi  a1, s0, 15
+  li    t1, SRC
+  add   a1, a1, t1
+  li    a2, N - 16
+  jal   ra, memcpy
+  li    a0, DST
+  li    a1, (N - 16) / 4
+  jal   ra, sum32
+  add   s1, s1, a0
+
+  # memset(DST + round % 8, round, N / 2), sum of DST
+  li    a0, DST
+  andi  t1, s0, 7
+  add   a0, a0, t1
+  mv    a1, s0
+  li    a2, N / 2
+  jal   ra, memset
+  li    a0, DST
+  li    a1, N / 4
+  jal   ra, sum32
+  xor   s1, s1, a0
+
+  # strlen of TEXT cut off at round * 677 % N
+  li    t1, 677
+  mul   s2, s0, t1
+  li    t1, N - 1
+  and   s2, s2, t1
+  li    t1, TEXT
+  add   s2, s2, t1
+  sb    zero, 0(s2)
+  li    a0, TEXT
+  jal   ra, strlen
+  add   s1, s1, a0
+  li    t1, 1
+  sb    t1, 0(s2)
+  li    a0, RAM_END - 40
+  jal   ra, strlen
+  add   s1, s1, a0
+
+  # bytes equal to round in SRC
+  li    a0, SRC
+  mv    a1, s0
+  li    a2, N
+  jal   ra, count
+  slli  a0, a0, 3
+  add   s1, s1, a0
+
+  # SRC . DST
+  li    a0, SRC
+  li    a1, DST
+  li    a2, N / 4
+  jal   ra, dot
+  xor   s1, s1, a0
+
+  # column round % 64 of SRC as 256 rows of 64 words
+  li    a0, SRC
+  andi  t1, s0, 63
+  sh2add a0, t1, a0
+  li    a1, 256
+  li    a2, 256
+  jal   ra, column
+  add   s1, s1, a0
+
+  # halfwords of DST clamped and mangled, sum of DST
+  li    a0, DST
+  li    t1, 0x2f1
+  mul   a1, s0, t1
+  li    a2, N / 2
+  jal   ra, clamp
+  xor   s1, s1, a0
+  li    a0, DST
+  li    a1, N / 4
+  jal   ra, sum32
+  add   s1, s1, a0
+
+  rori  s1, s1, 7
+  addi  s0, s0, -1
+  bnez  s0, round
+
+  mv    a0, s1
+  lw    ra, 12(sp)
+  lw    s0, 8(sp)
+  lw    s1, 4(sp)
+  lw    s2, 0(sp)
+  addi  sp, sp, 16
+  ret
+
+# copies a2 bytes from a1 to a0
+memcpy:
+  vsetvli t0, a2, e8, m8, ta, ma
+  vle8.v v8, (a1)
+  vse8.v v8, (a0)
+  add   a1, a1, t0
+  add   a0, a0, t0
+  sub   a2, a2, t0
+  bnez  a2, memcpy
+  ret
+
+# fills a2 bytes at a0 with a1
+memset:
+  vsetvli t0, zero, e8, m8, ta, ma
+  vmv.v.x v8, a1
+1:
+  vsetvli t0, a2, e8, m8, ta, ma
+  vse8.v v8, (a0)
+  add   a0, a0, t0
+  sub   a2, a2, t0
+  bnez  a2, 1b
+  ret
+
+# a0 = sum of the a1 words at a0
+sum32:
+  vsetvli t0, zero, e32, m8, ta, ma
+  vmv.v.i v16, 0
+1:
+  vsetvli t0, a1, e32, m8, tu, ma
+  vle32.v v8, (a0)
+  vadd.vv v16, v16, v8
+  sh2add a0, t0, a0
+  sub   a1, a1, t0
+  bnez  a1, 1b
+  vsetvli t0, zero, e32, m8, ta, ma
+  vmv.s.x v8, zero
+  vredsum.vs v8, v16, v8
+  vmv.x.s a0, v8
+  ret
+
+# a0 = length of the string at a0. vl after a fault-only-first load is the
+# population of an all ones mask (vmset.m is vmxnor.mm)
+strlen:
+  mv    t1, a0
+1:
+  vsetvli t0, zero, e8, m8, ta, ma
+  vle8ff.v v8, (t1)
+  vmseq.vi v0, v8, 0
+  vfirst.m t2, v0
+  bgez  t2, 2f
+  vmxnor.mm v1, v1, v1
+  vcpop.m t0, v1
+  add   t1, t1, t0
+  j     1b
+2:
+  add   t1, t1, t2
+  sub   a0, t1, a0
+  ret
+
+# a0 = bytes equal to a1 among the a2 at a0
+count:
+  li    t2, 0
+1:
+  vsetvli t0, a2, e8, m8, ta, ma
+  vle8.v v8, (a0)
+  vmseq.vx v0, v8, a1
+  vcpop.m t1, v0
+  add   t2, t2, t1
+  add   a0, a0, t0
+  sub   a2, a2, t0
+  bnez  a2, 1b
+  mv    a0, t2
+  ret
+
+# a0 = sum of a0[i] * a1[i] over a2 words
+dot:
+  vsetvli t0, zero, e32, m4, ta, ma
+  vmv.v.i v16, 0
+1:
+  vsetvli t0, a2, e32, m4, tu, ma
+  vle32.v v8, (a0)
+  vle32.v v12, (a1)
+  vmacc.vv v16, v8, v12
+  sh2add a0, t0, a0
+  sh2add a1, t0, a1
+  sub   a2, a2, t0
+  bnez  a2, 1b
+  vsetvli t0, zero, e32, m4, ta, ma
+  vmv.s.x v8, zero
+  vredsum.vs v8, v16, v8
+  vmv.x.s a0, v8
+  ret
+
+# a0 = sum ^ unsigned max ^ signed min of a2 words a1 bytes apart from a0
+column:
+  li    t3, 0
+  li    t4, 0
+  li    t5, 0x7fffffff
+  li    t6, 0xd0                # vtype e32, m1, ta, ma
+1:
+  vsetvl t0, a2, t6
+  vlse32.v v8, (a0), a1
+  vmv.s.x v16, t3
+  vredsum.vs v16, v8, v16
+  vmv.x.s t3, v16
+  vmv.s.x v16, t4
+  vredmaxu.vs v16, v8, v16
+  vmv.x.s t4, v16
+  vmv.s.x v16, t5
+  vredmin.vs v16, v8, v16
+  vmv.x.s t5, v16
+  mul   t1, t0, a1
+  add   a0, a0, t1
+  sub   a2, a2, t0
+  bnez  a2, 1b
+  xor   a0, t3, t4
+  xor   a0, a0, t5
+  ret
+
+# rewrites the a2 halfwords at a0, with a1 as threshold: above it (unsigned)
+# they become it, the negative ones (signed) a masked mix of shifts, all of
+# them a few more operations with their index. a0 = mask counts and
+# reductions of the result, and a mask stored and loaded again.
+clamp:
+  li    t2, 0                   # index
+  li    t3, 0                   # mask counts
+  li    t4, -0x8000             # max
+  li    t5, 0                   # or
+  li    t6, -1                  # and
+  li    a3, 0                   # xor
+  li    a4, 0xffff              # unsigned min
+  mv    a5, a0
+1:
+  vsetvli t0, a2, e16, m8, ta, mu
+  vle16.v v8, (a0)
+  vmsgtu.vx v0, v8, a1
+  vmsle.vi v1, v8, -1
+  vmandn.mm v2, v1, v0
+  vcpop.m t1, v2
+  add   t3, t3, t1
+  vmor.mm v3, v1, v0
+  vcpop.m t1, v3
+  add   t3, t3, t1
+  vmnand.mm v4, v1, v0
+  vcpop.m t1, v4, v0.t
+  add   t3, t3, t1
+  vmerge.vxm v8, v8, a1, v0
+  vmor.mm v0, v1, v1
+  vsra.vi v16, v8, 3
+  vadd.vv v8, v8, v16, v0.t
+  vsll.vi v8, v8, 1, v0.t
+  vxor.vx v8, v8, a1, v0.t
+  vid.v v16
+  vadd.vx v16, v16, t2
+  vrsub.vx v16, v16, a1
+  vmul.vv v8, v8, v16
+  vminu.vx v24, v8, a1
+  vmax.vv v8, v8, v24
+  vsrl.vi v24, v8, 5
+  vsub.vv v8, v8, v24
+  vand.vi v24, v8, -6
+  vor.vx v8, v8, a1
+  vxor.vv v8, v8, v24
+  vmin.vx v24, v8, a1
+  vmaxu.vv v8, v8, v24
+  vse16.v v8, (a0)
+  vmv.s.x v16, t4
+  vredmax.vs v16, v8, v16
+  vmv.x.s t4, v16
+  vmv.s.x v16, t5
+  vredor.vs v16, v8, v16
+  vmv.x.s t5, v16
+  vmv.s.x v16, t6
+  vredand.vs v16, v8, v16
+  vmv.x.s t6, v16
+  vmv.s.x v16, a3
+  vredxor.vs v16, v8, v16
+  vmv.x.s a3, v16
+  vmv.s.x v16, a4
+  vredminu.vs v16, v8, v16
+  vmv.x.s a4, v16
+  add   t2, t2, t0
+  sh1add a0, t0, a0
+  sub   a2, a2, t0
+  bnez  a2, 1b
+  add   t3, t3, t4
+  add   t3, t3, t5
+  add   t3, t3, t6
+  add   t3, t3, a3
+  add   t3, t3, a4
+  # the first 4 halfwords above the threshold, as a mask through memory
+  vsetivli zero, 4, e16, m2, ta, ma
+  vle16.v v8, (a5)
+  vmsgtu.vx v3, v8, a1
+  li    t1, MASK
+  vsm.v v3, (t1)
+  vlm.v v5, (t1)
+  vcpop.m t1, v5
+  add   a0, t3, t1
+  ret
+
+  .data
+  .word 0x9e3779b9
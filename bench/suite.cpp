@@ -0,0 +1,215 @@
+// guest workloads per engine, and microbenchmarks of the decoder and the
+// memory path
+//
+// every program of the corpus runs on every engine in a child process of its
+// own, so that its peak RSS (ru_maxrss, which includes the few MiB of the
+// runner itself) is its own. runs are repeated --runs times and the fastest
+// one is reported. the console output of every engine is compared to the
+// interpreter's. with --json=<file> each result is also appended to <file>
+// as one line of JSON, tagged with --label, e.g. a commit hash.
+//
+//   bench/programs/build.sh   # only after changing a kernel
+//   g++ -std=c++23 -O2 -o suite bench/suite.cpp
+//   ./suite [--runs=3] [--budget=66666666] [--guard-pages] [--jit-passes=all] [--json=<file>]
+//           [--label=<name>] [--no-micro] [program/...]
+//
+// --jit-passes takes the IR passes of the JIT engine (see src/ir.hpp), e.g.
+// --jit-passes=none and --jit-passes=fold show what constant folding buys.
+
+#include <fstream>
+#include <random>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "../src/batch.hpp"
+
+// what a child reports back through its pipe
+struct Sample {
+  Result::Status status = Result::STATUS_FAULT;
+  size_t instructions = 0;
+  double seconds = 0;
+  u64 console = 0; // hash of the console output
+};
+
+auto fnv1a(u64 h, const char* data, size_t n) {
+  for (size_t i = 0; i < n; i++) h = (h ^ u8(data[i])) * 0x100000001b3;
+  return h;
+}
+
+auto run_sample(const std::string& prog, const Config& config, CPU::Engine engine, size_t budget) {
+  auto sample = Sample();
+  sample.console = 0xcbf29ce484222325;
+  auto cpu = CPU(prog, config);
+  cpu.engine = engine;
+  cpu.console.sink = [&](const char* data, size_t n) { sample.console = fnv1a(sample.console, data, n); };
+
+  auto start = std::chrono::steady_clock::now();
+  try {
+    sample.instructions = cpu.steps(budget);
+    sample.status = cpu.halted ? Result::STATUS_HALTED : Result::STATUS_BUDGET;
+  } catch (const Fault&) {
+  }
+  sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  cpu.console.flush();
+  return sample;
+}
+
+// runs the sample in a child, returns it with the child's peak RSS in KiB
+auto fork_sample(const std::string& prog, const Config& config, CPU::Engine engine, size_t budget) {
+  int fds[2];
+  if (pipe(fds)) die("pipe failed");
+  std::cout << std::flush;
+  auto pid = fork();
+  if (pid < 0) die("fork failed");
+  if (pid == 0) {
+    close(fds[0]);
+    auto sample = run_sample(prog, config, engine, budget);
+    auto ok = write(fds[1], &sample, sizeof(sample)) == sizeof(sample);
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+  auto sample = Sample();
+  auto got = read(fds[0], &sample, sizeof(sample));
+  close(fds[0]);
+
+  auto status = 0;
+  auto usage = rusage();
+  wait4(pid, &status, 0, &usage);
+  if (got != sizeof(sample) || !WIFEXITED(status) || WEXITSTATUS(status)) die(prog, ": benchmark died");
+  return std::pair(sample, size_t(usage.ru_maxrss));
+}
+
+// calls body(i) for i in [0, n) until that took at least min_seconds, returns ns per call
+auto ns_per_op(size_t n, auto body, double min_seconds = 0.2) {
+  auto ops = size_t(0);
+  auto start = std::chrono::steady_clock::now();
+  auto seconds = 0.0;
+  do {
+    for (size_t i = 0; i < n; i++) body(i);
+    ops += n;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  } while (seconds < min_seconds);
+  return std::pair(seconds * 1e9 / ops, ops);
+}
+
+// keeps the compiler from dropping a result
+auto keep(auto x) { asm volatile("" : : "r"(x)); }
+
+int main(int argc, char** argv) {
+  auto programs = std::vector<std::string>();
+  auto runs = 3;
+  auto budget = size_t(66666666);
+  auto config = Config();
+  auto json_file = std::string();
+  auto label = std::string();
+  auto micro = true;
+
+  for (auto i = 1; i < argc; i++) {
+    auto arg = std::string(argv[i]);
+    if      (arg.starts_with("--runs="))   runs = std::stoi(arg.substr(7));
+    else if (arg.starts_with("--budget=")) budget = std::stoul(arg.substr(9));
+    else if (arg == "--guard-pages")       config.guard_pages = true;
+    else if (arg.starts_with("--jit-passes=")) config.jit_passes = IR::parse_passes(arg.substr(13));
+    else if (arg.starts_with("--json="))   json_file = arg.substr(7);
+    else if (arg.starts_with("--label="))  label = arg.substr(8);
+    else if (arg == "--no-micro")          micro = false;
+    else if (arg.starts_with("--"))        die("unknown option ", arg);
+    else                                   programs.push_back(arg.ends_with('/') ? arg : arg + '/');
+  }
+  if (programs.empty()) {
+    programs = { "examples/primes/", "bench/programs/sort/", "bench/programs/crc/",
+                 "bench/programs/matmul/", "bench/programs/string/", "bench/programs/muldiv/",
+                 "bench/programs/float/", "bench/programs/bits/", "bench/programs/vector/",
+                 "bench/programs/rvc/", "bench/programs/csr/" };
+  }
+
+  auto json = std::ofstream();
+  if (!json_file.empty()) {
+    json.open(json_file, std::ios::app);
+    if (!json) die("could not open ", json_file);
+  }
+  auto report = [&](const std::string& fields) {
+    if (json) json << "{\"label\":" << json_string(label) << "," << fields << "}\n";
+  };
+
+  auto engines = { CPU::ENGINE_INTERP, CPU::ENGINE_THREADED, CPU::ENGINE_JIT };
+  auto names = std::array{ "interp", "threaded", "jit" };
+  static const char* status_names[] = {"halted", "budget", "fault"};
+
+  for (auto& prog : programs) {
+    auto name = std::filesystem::path(prog).parent_path().filename().string();
+    auto reference = u64(0);
+    for (auto engine : engines) {
+      auto best = Sample();
+      auto rss = size_t(0);
+      for (auto run = 0; run < runs; run++) {
+        auto [sample, peak] = fork_sample(prog, config, engine, budget);
+        if (run == 0 || sample.seconds < best.seconds) best = sample;
+        rss = std::max(rss, peak);
+      }
+      if (engine == CPU::ENGINE_INTERP) reference = best.console;
+      auto matches = best.console == reference;
+
+      auto mips = best.instructions / best.seconds / 1e6;
+      auto ns = best.seconds * 1e9 / best.instructions;
+      print(std::left, std::setw(10), name, std::setw(10), names[engine], std::right, std::fixed,
+            std::setprecision(1), std::setw(8), mips, " MIPS", std::setprecision(2), std::setw(8), ns,
+            " ns/inst", std::setprecision(1), std::setw(8), rss / 1024.0, " MiB peak",
+            best.status == Result::STATUS_FAULT ? "  FAULT" : "", matches ? "" : "  OUTPUT DIFFERS");
+      report(str("\"benchmark\":", json_string(name), ",\"engine\":\"", names[engine], "\"",
+                 ",\"guard_pages\":", config.guard_pages ? "true" : "false",
+                 ",\"jit_passes\":", int(config.jit_passes),
+                 ",\"status\":\"", status_names[best.status], "\"",
+                 ",\"instructions\":", best.instructions, ",\"seconds\":", best.seconds,
+                 ",\"mips\":", mips, ",\"ns_per_inst\":", ns, ",\"peak_rss_kb\":", rss,
+                 ",\"output_matches\":", matches ? "true" : "false"));
+    }
+  }
+
+  if (!micro) return 0;
+
+  // every instruction word of the corpus
+  auto words = std::vector<u32>();
+  for (auto& prog : programs) {
+    auto program = Program::load(prog + "instruction_mem.bin");
+    auto imem = (const u32*)program->imem;
+    words.insert(words.end(), imem, imem + program->imem_size / 4);
+  }
+  // get_imm() only takes the formats that have an immediate
+  auto has_imm = [](u32 w) {
+    switch (get_opcode(w)) {
+    case OPCODE_LUI: case OPCODE_AUIPC: case OPCODE_JAL: case OPCODE_JALR: case OPCODE_BRANCH:
+    case OPCODE_LOAD: case OPCODE_STORE: case OPCODE_OP_IMM: case OPCODE_SYSTEM:
+    case OPCODE_LOAD_FP: case OPCODE_STORE_FP:
+      return decode(w) != UNDEF;
+    default:
+      return false;
+    }
+  };
+  auto with_imm = std::vector<u32>();
+  for (auto w : words) if (has_imm(w)) with_imm.push_back(w);
+
+  auto cpu = CPU(programs.front(), config);
+  auto ram = u32(cpu.dmem_size) & ~3u;
+  auto rng = std::mt19937(1);
+  auto random_addrs = std::vector<u32>(1 << 16);
+  for (auto& a : random_addrs) a = rng() % ram & ~3u;
+  auto load = [&](u32 addr) {
+    return config.guard_pages ? cpu.dmem_get<u32, true>(addr) : cpu.dmem_get<u32, false>(addr);
+  };
+
+  auto micros = std::vector<std::tuple<const char*, std::pair<double, size_t>>>{
+    {"decode", ns_per_op(words.size(), [&](size_t i) { keep(decode(words[i])); })},
+    {"get_imm", ns_per_op(with_imm.size(), [&](size_t i) { keep(get_imm(with_imm[i])); })},
+    // one page after the other, mostly TLB hits
+    {"dmem_get", ns_per_op(ram / 4, [&](size_t i) { keep(load(u32(i * 4))); })},
+    // all over RAM, mostly TLB misses
+    {"dmem_get_random", ns_per_op(random_addrs.size(), [&](size_t i) { keep(load(random_addrs[i])); })},
+  };
+  for (auto& [name, result] : micros) {
+    auto [ns, ops] = result;
+    print(std::left, std::setw(20), name, std::right, std::fixed, std::setprecision(2),
+          std::setw(8), ns, " ns/op");
+    report(str("\"benchmark\":", json_string(name), ",\"guard_pages\":",
+               config.guard_pages ? "true" : "false", ",\"ops\":", ops, ",\"ns_per_op\":", ns));
+  }
+}
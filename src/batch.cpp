@@ -0,0 +1,36 @@
+#include <fstream>
+#include "batch.hpp"
+#include "options.hpp"
+
+// runs every program given on the command line (or listed one per line in
+// --list files) and prints one line of JSON per program, in input order.
+int main(int argc, char** argv) {
+  auto jobs = std::vector<Job>();
+  auto budget = size_t(66666666);
+  auto threads = size_t(std::thread::hardware_concurrency());
+  auto engine = CPU::ENGINE_INTERP;
+  auto config = Config();
+  auto programs = std::vector<std::string>();
+
+  for (auto i = 1; i < argc; i++) {
+    auto arg = std::string(argv[i]);
+    if      (parse_cpu_option(arg, engine, config)) continue;
+    else if (arg.starts_with("--budget=")) budget = std::stoul(arg.substr(9));
+    else if (arg.starts_with("--threads=")) threads = std::stoul(arg.substr(10));
+    else if (arg.starts_with("--list=")) {
+      auto file = std::ifstream(arg.substr(7));
+      if (!file) die("could not open ", arg.substr(7));
+      for (auto line = std::string(); std::getline(file, line); ) {
+        if (!line.empty()) programs.push_back(line);
+      }
+    }
+    else if (arg.starts_with("--"))        die("unknown option ", arg);
+    else                                   programs.push_back(arg);
+  }
+
+  for (auto& program : programs) jobs.push_back({program, budget});
+
+  for (auto& result : run_batch(jobs, threads, config, engine)) {
+    print(to_json(result));
+  }
+}
@@ -0,0 +1,134 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+// runs many guest programs on a work stealing thread pool.
+//
+// every worker owns a deque of job indices, takes work from its back and,
+// once that runs dry, steals from the front of the others. all jobs are
+// known up front, so a worker that finds every deque empty is done.
+
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <thread>
+
+#include "cpu.hpp"
+
+struct Job {
+  std::string program; // directory holding instruction_mem.bin and data_mem.bin
+  size_t budget;       // instructions
+};
+
+struct Result {
+  enum Status { STATUS_HALTED, STATUS_BUDGET, STATUS_FAULT };
+
+  std::string program;
+  Status status = STATUS_FAULT;
+  std::string error;
+  u32 pc = 0;
+  std::array<u32, 32> regs = {0};
+  size_t instructions = 0;
+  double seconds = 0;
+  std::string console;
+};
+
+auto run_job(const Job& job, const Config& config, CPU::Engine engine) {
+  auto result = Result();
+  result.program = job.program;
+
+  auto dir = job.program.ends_with('/') ? job.program : job.program + '/';
+  for (auto file : {"instruction_mem.bin", "data_mem.bin"}) {
+    if (!std::filesystem::exists(dir + file)) {
+      result.error = str("missing ", dir, file);
+      return result;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto cpu = CPU(dir, config);
+  cpu.engine = engine;
+  cpu.console.sink = [&](const char* data, size_t n) { result.console.append(data, n); };
+
+  try {
+    cpu.steps(job.budget);
+    result.status = cpu.halted ? Result::STATUS_HALTED : Result::STATUS_BUDGET;
+  } catch (const Fault& e) {
+    result.error = e.what();
+  }
+  // counts up to the faulting instruction as well
+  result.instructions = cpu.executed;
+  cpu.console.flush();
+
+  result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  result.pc = cpu.pc;
+  std::copy_n(cpu.regs.begin(), 32, result.regs.begin());
+  return result;
+}
+
+auto run_batch(const std::vector<Job>& jobs, size_t threads, const Config& config = {},
+               CPU::Engine engine = CPU::ENGINE_INTERP) {
+  auto results = std::vector<Result>(jobs.size());
+  threads = std::max<size_t>(1, std::min(threads, jobs.size()));
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> jobs;
+  };
+  auto queues = std::vector<Queue>(threads);
+  for (size_t i = 0; i < jobs.size(); i++) queues[i % threads].jobs.push_back(i);
+
+  auto take = [&](size_t worker) -> std::optional<size_t> {
+    for (size_t k = 0; k < threads; k++) {
+      auto& q = queues[(worker + k) % threads];
+      auto lock = std::lock_guard(q.mutex);
+      if (q.jobs.empty()) continue;
+      auto own = k == 0;
+      auto i = own ? q.jobs.back() : q.jobs.front();
+      if (own) q.jobs.pop_back(); else q.jobs.pop_front();
+      return i;
+    }
+    return std::nullopt;
+  };
+
+  auto workers = std::vector<std::jthread>();
+  for (size_t w = 0; w < threads; w++) {
+    workers.emplace_back([&, w]{
+      while (auto i = take(w)) results[*i] = run_job(jobs[*i], config, engine);
+    });
+  }
+  workers.clear(); // joins
+
+  return results;
+}
+
+auto json_string(const std::string& x) {
+  auto out = std::string("\"");
+  for (auto c : x) {
+    switch (c) {
+    case '"':  out += "\\\""; break;
+    case '\\': out += "\\\\"; break;
+    case '\n': out += "\\n"; break;
+    default:
+      if (u8(c) < 0x20) out += str("\\u00", byte_to_hex(u8(c)));
+      else out += c;
+    }
+  }
+  return out + "\"";
+}
+
+// one line of JSON
+auto to_json(const Result& r) {
+  static const char* status[] = {"halted", "budget", "fault"};
+  auto regs = std::string();
+  for (auto x : r.regs) regs += str(regs.empty() ? "" : ",", x);
+  return str("{\"program\":", json_string(r.program),
+             ",\"status\":\"", status[r.status], "\"",
+             ",\"error\":", json_string(r.error),
+             ",\"pc\":", r.pc,
+             ",\"regs\":[", regs, "]",
+             ",\"instructions\":", r.instructions,
+             ",\"seconds\":", r.seconds,
+             ",\"console\":", json_string(r.console), "}");
+}
+
+#endif // #ifndef BATCH_HPP
@@ -0,0 +1,168 @@
+#ifndef CONSOLE_HPP
+#define CONSOLE_HPP
+
+// buffered character output.
+//
+// guest output is collected in a ring buffer and handed to the sink in
+// blocks: once the buffer is full, on a newline and at exit. with a consumer
+// thread the guest only ever touches the buffer, the thread does the writes.
+// the buffer is a single producer (the guest's thread) / single consumer
+// queue. head is only advanced by the guest, tail by drain(), which holds
+// drain_mutex since die() flushes every live console from whichever thread
+// failed.
+//
+// registers:
+//   DATA (+0) a store prints its low byte
+//   ADDR (+4) guest address of a block
+//   LEN  (+8) a store prints LEN bytes from ADDR
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mmu.hpp"
+
+struct Console : Device {
+  enum : u32 { DATA = 0, ADDR = 4, LEN = 8, SIZE = 12 };
+
+  static constexpr size_t capacity = 64 * 1024;
+
+  // where the output ends up
+  std::function<void(const char*, size_t)> sink = [](const char* data, size_t n) {
+    std::cout.write(data, n);
+  };
+
+  const MMU& mmu; // memory behind block transfers
+  u32 addr = 0;
+
+  std::vector<char> buffer = std::vector<char>(capacity);
+  std::atomic<size_t> head = 0; // next byte to write, owned by the guest
+  std::atomic<size_t> tail = 0; // next byte to print, owned by the consumer
+  std::mutex drain_mutex;
+
+  std::thread consumer;
+  std::atomic<u32> kicks = 0; // bumped to wake the consumer
+  std::atomic<bool> stop = false;
+
+  // consoles to flush before die() reports
+  static inline std::mutex live_mutex;
+  static inline std::vector<Console*> live;
+
+  // hands [tail, head) to the sink, in up to two pieces around the wrap
+  auto drain() {
+    auto lock = std::lock_guard(drain_mutex);
+    auto t = tail.load(std::memory_order_relaxed);
+    auto h = head.load(std::memory_order_acquire);
+    while (t != h) {
+      auto n = std::min(h - t, capacity - t % capacity);
+      sink(buffer.data() + t % capacity, n);
+      t += n;
+    }
+    tail.store(t, std::memory_order_release);
+    tail.notify_one();
+  }
+
+  auto kick() {
+    if (!consumer.joinable()) return drain();
+    kicks.fetch_add(1, std::memory_order_release);
+    kicks.notify_one();
+  }
+
+  // everything written so far reached the sink
+  auto flush() {
+    kick();
+    for (auto h = head.load(); ; ) {
+      auto t = tail.load(std::memory_order_acquire);
+      if (t == h) break;
+      tail.wait(t);
+    }
+  }
+
+  auto start_consumer() {
+    if (consumer.joinable()) return;
+    stop = false;
+    consumer = std::thread([this]{
+      for (;;) {
+        auto k = kicks.load(std::memory_order_acquire);
+        if (tail.load(std::memory_order_relaxed) != head.load(std::memory_order_acquire)) {
+          drain();
+        } else if (stop) {
+          break;
+        } else {
+          kicks.wait(k);
+        }
+      }
+    });
+  }
+
+  auto stop_consumer() {
+    if (!consumer.joinable()) return;
+    stop = true;
+    kick();
+    consumer.join();
+  }
+
+  static auto flush_all() {
+    auto lock = std::lock_guard(live_mutex);
+    for (auto console : live) console->flush();
+  }
+
+  Console(const MMU& mmu) : mmu(mmu) {
+    auto lock = std::lock_guard(live_mutex);
+    live.push_back(this);
+    before_die = flush_all;
+  }
+
+  Console(const Console&) = delete;
+  Console& operator=(const Console&) = delete;
+
+  ~Console() {
+    stop_consumer();
+    flush();
+    auto lock = std::lock_guard(live_mutex);
+    std::erase(live, this);
+  }
+
+  // copies n bytes into the buffer, waiting for room whenever it is full
+  auto push(const char* data, size_t n) {
+    auto newline = false;
+    while (n) {
+      auto h = head.load(std::memory_order_relaxed);
+      auto t = tail.load(std::memory_order_acquire);
+      if (h - t == capacity) {
+        kick();
+        if (consumer.joinable()) tail.wait(t);
+        continue;
+      }
+      auto k = std::min({n, capacity - (h - t), capacity - h % capacity});
+      std::memcpy(buffer.data() + h % capacity, data, k);
+      newline = newline || std::memchr(data, '\n', k);
+      head.store(h + k, std::memory_order_release);
+      data += k;
+      n -= k;
+    }
+    if (newline) kick();
+  }
+
+  u32 read(u32 offset, u32) override {
+    return offset == ADDR ? addr : 0;
+  }
+
+  void write(u32 offset, u32 x, u32) override {
+    switch (offset) {
+    case DATA: { auto c = char(x); push(&c, 1); break; }
+    case ADDR: addr = x; break;
+    case LEN: {
+      auto data = mmu.host(addr, x);
+      if (!data) MMU::invalid("console", addr);
+      push((const char*)data, x);
+      break;
+    }
+    }
+  }
+};
+
+#endif // #ifndef CONSOLE_HPP
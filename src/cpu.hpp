@@ -0,0 +1,1350 @@
+#ifndef CPU_HPP
+#define CPU_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <filesystem>
+#include <csetjmp>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ucontext.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "isa.hpp"
+#include "mmu.hpp"
+#include "console.hpp"
+#include "fpu.hpp"
+#include "vpu.hpp"
+#include "ir.hpp"
+#include "jit.hpp"
+#include "stats.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+
+// maps filename copy on write over the first file_size bytes of mem
+void map_file_over(u8* mem, const std::string& filename, size_t file_size, int prot) {
+  if (!file_size) return;
+  auto fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) die("open(", filename, ") failed");
+  if (mmap(mem, file_size, prot, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    die("mmap(", filename, ") failed");
+  }
+  close(fd);
+}
+
+// copies filename into the first file_size bytes of mem
+void read_file_into(u8* mem, const std::string& filename, size_t file_size) {
+  auto fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) die("open(", filename, ") failed");
+  for (size_t done = 0; done < file_size; ) {
+    auto n = pread(fd, mem + done, file_size - done, done);
+    if (n <= 0) die("read(", filename, ") failed");
+    done += n;
+  }
+  close(fd);
+}
+
+// maps filename copy on write over the start of a zero filled region of
+// size >= file_size bytes. pages are only read or allocated once touched.
+u8* map_file(const std::string& filename, size_t file_size, size_t size, int prot) {
+  auto mem = (u8*)mmap(nullptr, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mem == MAP_FAILED) die("mmap(", filename, ", ", size, ") failed");
+  map_file_over(mem, filename, file_size, prot);
+  return mem;
+}
+
+enum HugePages {
+  HUGE_PAGES_OFF,     // 4 KiB pages
+  HUGE_PAGES_THP,     // 2 MiB aligned, madvise(MADV_HUGEPAGE)
+  HUGE_PAGES_HUGETLB, // MAP_HUGETLB, falls back to HUGE_PAGES_THP
+};
+
+constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+// maps size bytes with the given alignment, trimming the over allocation
+u8* map_aligned(size_t size, size_t align, int prot, int flags) {
+  auto raw = (u8*)mmap(nullptr, size + align, prot, flags, -1, 0);
+  if (raw == MAP_FAILED) die("mmap(", size, ") failed");
+  auto mem = (u8*)((uintptr_t(raw) + align - 1) & ~(align - 1));
+  if (mem != raw) munmap(raw, mem - raw);
+  munmap(mem + size, raw + size + align - (mem + size));
+  return mem;
+}
+
+// anonymous zero filled guest RAM, host memory is only committed for the
+// pages the guest touches. size is rounded up to whole huge pages. with at
+// (huge page aligned) the RAM replaces the mapping at [at, at + size).
+u8* map_ram(size_t& size, HugePages huge_pages, u8* at = nullptr) {
+  auto flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (at ? MAP_FIXED : 0);
+  auto prot = PROT_READ | PROT_WRITE;
+
+  if (huge_pages == HUGE_PAGES_OFF) {
+    auto mem = (u8*)mmap(at, size, prot, flags, -1, 0);
+    if (mem == MAP_FAILED) die("mmap(", size, ") failed");
+    return mem;
+  }
+
+  size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+  if (huge_pages == HUGE_PAGES_HUGETLB) {
+    // without a reservation the mapping would succeed and fault on first touch
+    auto mem = (u8*)mmap(at, size, prot, (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) return mem;
+    log("mmap(MAP_HUGETLB) failed, using transparent huge pages");
+  }
+
+  auto mem = at ? (u8*)mmap(at, size, prot, flags, -1, 0)
+                : map_aligned(size, huge_page_size, prot, flags);
+  if (mem == MAP_FAILED) die("mmap(", size, ") failed");
+  madvise(mem, size, MADV_HUGEPAGE);
+  return mem;
+}
+
+// guest RAM in a memfd, mapped shared so it can be handed to copy on write
+// forks later (see map_fork). size is rounded up to whole pages.
+u8* map_shareable_ram(size_t& size, int& fd, u8* at = nullptr) {
+  size = (size + 4095) / 4096 * 4096;
+  fd = memfd_create("rvvm-dmem", MFD_CLOEXEC);
+  if (fd < 0 || ftruncate(fd, size)) die("memfd_create(", size, ") failed");
+  auto mem = (u8*)mmap(at, size, PROT_READ | PROT_WRITE, MAP_SHARED | (at ? MAP_FIXED : 0), fd, 0);
+  if (mem == MAP_FAILED) die("mmap(memfd, ", size, ") failed");
+  return mem;
+}
+
+// private copy on write view of a map_shareable_ram() memfd. with at, the
+// view replaces the mapping at [at, at + size), dropping its written pages.
+u8* map_fork(int fd, size_t size, u8* at = nullptr) {
+  auto mem = (u8*)mmap(at, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | (at ? MAP_FIXED : 0), fd, 0);
+  if (mem == MAP_FAILED) die("mmap(fork, ", size, ") failed");
+  return mem;
+}
+
+// -- guard pages --------------------------------------------------------
+//
+// with Config::guard_pages dmem sits at the start of a PROT_NONE reservation
+// of the whole 32 bit guest address space (plus a page for accesses that
+// straddle 4 GiB), so loads and stores need no bounds checks: anything
+// outside of dmem faults and guard_handler turns the fault into a guest error.
+
+constexpr size_t page_size = 4096;
+constexpr size_t guest_space = (1UL << 32) + page_size;
+
+// the guarded CPU running on this thread
+struct Guard {
+  u8* base = nullptr;
+  sigjmp_buf env;
+  u32 addr; // faulting guest address
+  u8* rip;  // faulting host instruction, see JIT::accesses
+  u32 mxcsr; // at the fault, with the flags of translated code
+};
+
+thread_local Guard guard;
+
+struct sigaction guard_previous_segv;
+struct sigaction guard_previous_bus;
+
+void guard_handler(int sig, siginfo_t* info, void* context) {
+  auto addr = (u8*)info->si_addr;
+  if (guard.base && guard.base <= addr && addr < guard.base + guest_space) {
+    guard.addr = u32(addr - guard.base);
+#if defined(__x86_64__)
+    guard.rip = (u8*)((ucontext_t*)context)->uc_mcontext.gregs[REG_RIP];
+    guard.mxcsr = ((ucontext_t*)context)->uc_mcontext.fpregs->mxcsr;
+#endif
+    siglongjmp(guard.env, 1);
+  }
+  // not a guest access: restore the previous handler and fault again
+  sigaction(sig, sig == SIGSEGV ? &guard_previous_segv : &guard_previous_bus, nullptr);
+}
+
+auto install_guard_handler() {
+  static std::once_flag once;
+  std::call_once(once, []{
+    struct sigaction action = {};
+    action.sa_sigaction = guard_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &guard_previous_segv);
+    sigaction(SIGBUS, &action, &guard_previous_bus);
+  });
+}
+
+u8* reserve_guest_space() {
+  return map_aligned(guest_space, huge_page_size, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE);
+}
+
+// per CPU settings
+struct Config {
+  size_t ram_size = 5000000; // dmem bytes, at least the size of the data image
+  HugePages huge_pages = HUGE_PAGES_OFF;
+  bool guard_pages = false;  // see reserve_guest_space()
+  bool console_thread = false; // print guest output from a separate thread
+  bool shareable = false;    // dmem in a memfd (CPU::dmem_fd), see pool.hpp
+  int fork_fd = -1;          // dmem is a copy on write view of this memfd instead of data_mem.bin
+  u8 jit_passes = IR::PASS_ALL; // IR passes of ENGINE_JIT, see ir.hpp
+  u32 vlen = 128;            // bits per vector register, see vpu.hpp
+  double cpi = 1;            // cycles per instruction, the cycle CSR's cost model
+  u64 timebase = 10000000;   // Hz of the time CSR
+};
+
+// read only instruction image and its predecoded form. loaded once per
+// process and shared by every CPU running the same program.
+struct Program {
+  const u8* imem;
+  size_t imem_size;
+
+  // imem decoded once at load time, indexed by halfword address. a 32 bit
+  // instruction takes two slots, the second one decodes whatever a jump
+  // into its middle would execute.
+  std::vector<Decoded> icache;
+
+  // block_len[i] = number of instructions from icache[i] up to and including
+  // the next JAL, JALR, branch, CSR instruction, EBREAK or UNDEF
+  std::vector<u32> block_len;
+
+  // handler address per icache slot, filled by
+  // CPU::steps_threaded<guarded, hooks> as threaded[guarded][hooks]
+  std::once_flag threaded_once[2][8];
+  std::vector<const void*> threaded[2][8];
+
+  Program(const std::string& filename) {
+    imem_size = std::filesystem::file_size(std::filesystem::path(filename));
+    imem = map_file(filename, imem_size, std::max(imem_size, 1UL), PROT_READ);
+
+    icache.resize(imem_size / 2);
+    for (size_t i = 0; i < icache.size(); i++) {
+      icache[i] = predecode(fetch(2 * i));
+    }
+
+    auto ends_block = [](auto op) {
+      return op == JAL || op == JALR || (BEQ <= op && op <= BGEU)
+          || is_csr(op) || op == EBREAK || op == UNDEF;
+    };
+
+    block_len.resize(icache.size());
+    for (size_t i = icache.size(); i--; ) {
+      auto next = i + icache[i].len / 2;
+      auto last = ends_block(icache[i].op) || next >= icache.size();
+      block_len[i] = last ? 1 : block_len[next] + 1;
+    }
+  }
+
+  // the instruction at addr, only the low half if it's compressed. 0
+  // (illegal) if it doesn't fit into imem.
+  u32 fetch(size_t addr) const {
+    if (addr + 2 > imem_size) return 0;
+    auto half = *(const u16*)(imem + addr);
+    if (is_compressed(half)) return half;
+    return addr + 4 > imem_size ? 0 : *(const u32*)(imem + addr);
+  }
+
+  Program(const Program&) = delete;
+  Program& operator=(const Program&) = delete;
+
+  ~Program() {
+    munmap((void*)imem, std::max(imem_size, 1UL));
+  }
+
+  // the program loaded from filename, shared while any CPU still uses it
+  static std::shared_ptr<Program> load(const std::string& filename) {
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<Program>> loaded;
+
+    auto key = std::string();
+    try {
+      key = std::filesystem::canonical(std::filesystem::path(filename)).string();
+    } catch (const std::filesystem::filesystem_error& e) {
+      die("could not load program. ", e.what());
+    }
+
+    auto lock = std::lock_guard(mutex);
+    auto program = loaded[key].lock();
+    if (!program) loaded[key] = program = std::make_shared<Program>(key);
+    return program;
+  }
+};
+
+struct CPU {
+  std::array<u32, 33> regs = {0};
+  FPU fpu{regs.data()};
+  VPU vpu;
+
+  std::shared_ptr<Program> program;
+  const u8* imem;
+  u8* dmem;
+  size_t imem_size;
+  size_t dmem_size;
+  int dmem_fd = -1; // Config::shareable
+  u32 pc = 0;
+  bool halted = false; // set by EBREAK, pc stays on the EBREAK
+  u64 executed = 0;    // instructions run by steps(), also up to a fault
+
+  // what the running loop added to executed ahead of pc, whole blocks or a
+  // JIT run's budget. uncount() takes it back when a fault stops the loop.
+  enum Counted : u8 { COUNTED_NONE, COUNTED_BLOCK, COUNTED_JIT };
+  Counted counted = COUNTED_NONE;
+
+  // see Config::cpi and Config::timebase
+  double cpi;
+  u64 timebase;
+
+  // checkpoint chain this CPU continues, see snapshot.hpp
+  u64 checkpoint_id = 0;
+  u32 checkpoints = 0; // files in the chain so far
+
+  const std::vector<Decoded>& icache;
+  const std::vector<u32>& block_len;
+
+  // data address space: RAM at [0, dmem_size) and the console registers
+  MMU mmu;
+  Console console{mmu};
+
+  // guarded: dmem is a guest_space reservation, faults replace the TLB
+  bool guarded = false;
+
+  // counts what runs while set, see stats.hpp
+  std::unique_ptr<Stats> stats;
+
+  // samples the guest's call stacks while set, see profiler.hpp
+  std::unique_ptr<Profiler> profiler;
+
+  // records every instruction while set, see trace.hpp. has to go before
+  // its TraceWriter
+  std::unique_ptr<Tracer> tracer;
+
+  auto enable_stats() {
+    if (!stats) stats = std::make_unique<Stats>(icache.size());
+    return stats.get();
+  }
+
+  // the shadow stack starts at the current pc, so best before the first steps()
+  auto enable_profiler(u64 interval) {
+    if (!profiler) profiler = std::make_unique<Profiler>(std::max<u64>(interval, 1), pc);
+    return profiler.get();
+  }
+
+  // what an instrumented execution loop reports, a template parameter of the
+  // loops so that the ones without hooks carry no trace of them
+  enum Hooks : u8 {
+    HOOKS_NONE = 0,
+    HOOKS_STATS = 1, // every instruction, branch and access, to stats
+    HOOKS_CALLS = 2, // JAL and JALR, to the profiler
+    HOOKS_TRACE = 4, // every instruction and access, to the tracer
+  };
+
+  template<typename T, bool guarded = false>
+  T dmem_get(u32 addr) {
+    if constexpr (guarded) {
+      if (mmu.attr[addr >> MMU::page_bits] <= ATTR_CLEAN) return *(T*)(dmem + addr);
+    } else {
+      auto& e = mmu.tlb[MMU::READ][(addr >> MMU::page_bits) % MMU::tlb_size];
+      if ((addr & (MMU::page_mask | (sizeof(T) - 1))) == e.tag) return *(T*)(e.addend + addr);
+    }
+    return mmu.load<T>(addr);
+  }
+
+  template<typename T, bool guarded = false>
+  void dmem_set(u32 addr, T x) {
+    if constexpr (guarded) {
+      // only the first byte's page is checked, so not across pages
+      if (mmu.attr[addr >> MMU::page_bits] == ATTR_RAM && (addr & ~MMU::page_mask) <= ~MMU::page_mask + 1 - sizeof(T)) {
+        *(T*)(dmem + addr) = x;
+        return;
+      }
+    } else {
+      auto& e = mmu.tlb[MMU::WRITE][(addr >> MMU::page_bits) % MMU::tlb_size];
+      if ((addr & (MMU::page_mask | (sizeof(T) - 1))) == e.tag) { *(T*)(e.addend + addr) = x; return; }
+    }
+    mmu.store<T>(addr, x);
+  }
+
+  // host address of addr if its page takes the fast path
+  template<bool guarded>
+  u8* fast_host(u32 addr, bool store) {
+    auto page = addr >> MMU::page_bits;
+    if constexpr (guarded) {
+      return (store ? mmu.attr[page] == ATTR_RAM : mmu.attr[page] <= ATTR_CLEAN) ? dmem + addr : nullptr;
+    } else {
+      auto& e = mmu.tlb[store ? MMU::WRITE : MMU::READ][page % MMU::tlb_size];
+      return (addr & MMU::page_mask) == e.tag ? (u8*)(e.addend + addr) : nullptr;
+    }
+  }
+
+  auto illegal_vector() {
+    fault("\nError: illegal vector instruction @", to_hex(pc), " (vtype ", to_hex(vpu.vtype), ")\n");
+  }
+
+  auto illegal_fp() {
+    fault("\nError: illegal floating point instruction @", to_hex(pc), " (frm ", fpu.fcsr >> 5 & 7, ")\n");
+  }
+
+  // a V load or store. unit stride elements move a page at a time while
+  // the page takes the fast path, everything else element by element
+  // through dmem_get and dmem_set. fast_only (translated code) returns
+  // false at the first element that needs more, the interpreter then redoes
+  // the whole instruction, which only repeats the same accesses. stats count
+  // the instruction as one access of the bytes it moved, traces show its
+  // first element.
+  template<bool guarded, u8 hooks = HOOKS_NONE, bool fast_only = false>
+  bool vmem(const Decoded& d) {
+    auto access = vpu.access(d);
+    if (!access) {
+      if constexpr (!fast_only) illegal_vector();
+      return false;
+    }
+    auto [vd, eew, n, vm] = *access;
+    auto store = is_vstore(d.op);
+    auto stride = d.op == VLSE || d.op == VSSE ? regs[d.rs2] : eew;
+    auto reg = vpu.reg(vd);
+
+    [[maybe_unused]] u32 moved = 0;
+    // after elements [i, i + k) at addr moved
+    auto moving = [&](u32 addr, u32 i, u32 k) {
+      if constexpr (hooks & HOOKS_TRACE) {
+        if (!moved) {
+          auto x = u32(0);
+          std::memcpy(&x, reg + i * eew, eew);
+          tracer->access(addr, x);
+        }
+      }
+      moved += k * eew;
+    };
+
+    for (u32 i = 0; i < n; ) {
+      auto addr = regs[d.rs1] + i * stride;
+      if (!vpu.active(vm, i)) { i++; continue; }
+      // past the first element a fault-only-first load ends early instead
+      if (d.op == VLEFF && i && !mmu.find(addr, eew)) {
+        if constexpr (fast_only) return false;
+        vpu.vl = i;
+        break;
+      }
+
+      auto fit = ((addr | ~MMU::page_mask) - addr + 1) / eew;
+      auto run = std::min(stride == eew && vm ? n - i : 1u, fit);
+      auto host = fast_host<guarded>(addr, store);
+      // pages past dmem are RAM to the guarded check. translated code can't
+      // recover from a guard page fault in the copy, the interpreter can
+      if constexpr (guarded && fast_only) {
+        if (u64(addr) + run * eew > dmem_size) host = nullptr;
+      }
+      if (host && run) {
+        if (store) std::memcpy(host, reg + i * eew, run * eew);
+        else std::memcpy(reg + i * eew, host, run * eew);
+        moving(addr, i, run);
+        i += run;
+        continue;
+      }
+      if constexpr (fast_only) return false;
+
+      auto element = [&](auto x) {
+        if (store) {
+          std::memcpy(&x, reg + i * eew, sizeof(x));
+          dmem_set<decltype(x), guarded>(addr, x);
+        } else {
+          x = dmem_get<decltype(x), guarded>(addr);
+          std::memcpy(reg + i * eew, &x, sizeof(x));
+        }
+      };
+      if (eew == 1) element(u8());
+      else if (eew == 2) element(u16());
+      else element(u32());
+      moving(addr, i, 1);
+      i++;
+    }
+    if constexpr (hooks & HOOKS_STATS) {
+      if (moved) store ? stats->store(moved) : stats->load(moved);
+    }
+    return true;
+  }
+
+  // for calls from translated code
+  template<bool guarded>
+  static bool vmem_fast(void* cpu, Decoded d) {
+    return ((CPU*)cpu)->vmem<guarded, HOOKS_NONE, true>(d);
+  }
+
+  // the host's monotonic clock in ticks of timebase Hz
+  u64 time() const {
+    auto ns = u64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+    return ns / 1000000000 * timebase + ns % 1000000000 * timebase / 1000000000;
+  }
+
+  // the CSR file. the counters are worked out when read, nothing counts
+  // cycles or instructions while they aren't.
+  u32 csr_read(u32 csr, u64 instret) {
+    auto counter = [&](u32 csr) -> u64 {
+      if (csr == CSR_CYCLE) return u64(double(instret) * cpi);
+      return csr == CSR_TIME ? time() : instret;
+    };
+    switch (csr) {
+    case CSR_FFLAGS:   return fpu.fcsr & 0x1f;
+    case CSR_FRM:      return fpu.fcsr >> 5 & 7;
+    case CSR_FCSR:     return fpu.fcsr;
+    case CSR_VSTART:   return 0;
+    case CSR_VXSAT:    return vpu.vcsr & 1;
+    case CSR_VXRM:     return vpu.vcsr >> 1 & 3;
+    case CSR_VCSR:     return vpu.vcsr;
+    case CSR_CYCLE: case CSR_TIME: case CSR_INSTRET:
+      return u32(counter(csr));
+    case CSR_CYCLEH: case CSR_TIMEH: case CSR_INSTRETH:
+      return u32(counter(csr & ~0x80u) >> 32);
+    case CSR_VL:       return vpu.vl;
+    case CSR_VTYPE:    return vpu.vtype;
+    case CSR_VLENB:    return vpu.vlenb;
+    default:           break;
+    }
+    fault("\nError: illegal CSR ", csr_name(csr), " @", to_hex(pc), '\n');
+    return 0;
+  }
+
+  void csr_write(u32 csr, u32 x) {
+    switch (csr) {
+    case CSR_FFLAGS: fpu.fcsr = (fpu.fcsr & ~0x1fu) | (x & 0x1f); return;
+    case CSR_FRM:    fpu.fcsr = (fpu.fcsr & 0x1f) | (x & 7) << 5;  return;
+    case CSR_FCSR:   fpu.fcsr = x & 0xff;                          return;
+    case CSR_VXSAT:  vpu.vcsr = (vpu.vcsr & ~1u) | (x & 1);        return;
+    case CSR_VXRM:   vpu.vcsr = (vpu.vcsr & 1) | (x & 3) << 1;     return;
+    case CSR_VCSR:   vpu.vcsr = x & 7;                             return;
+    // vector instructions always run to the end, vstart stays 0
+    case CSR_VSTART: if (x == 0) return; break;
+    default:         break;
+    }
+    fault("\nError: illegal write to CSR ", csr_name(csr), " @", to_hex(pc), '\n');
+  }
+
+  // a Zicsr instruction. the loops stop on one without running it (halted,
+  // pc on it), steps_hooked runs it with the number of instructions retired
+  // before it, so that instret is exact without being counted.
+  template<u8 hooks>
+  void exec_csr(const Decoded& d, u64 instret) {
+    fpu.settle();
+    auto x = d.op >= CSRRWI ? u32(d.rs1) : regs[d.rs1];
+    auto old = csr_read(d.imm, instret);
+    // CSRRS and CSRRC of x0 or 0 don't write, not even read only CSRs
+    if (d.op == CSRRW || d.op == CSRRWI) csr_write(d.imm, x);
+    else if (d.rs1) csr_write(d.imm, d.op == CSRRS || d.op == CSRRSI ? old | x : old & ~x);
+    regs[d.rd] = old;
+    FPU::clear_host_flags(); // the cycle CSR's arithmetic isn't the guest's
+    if constexpr (hooks & HOOKS_TRACE) tracer->retire(pc, program->fetch(pc & 0xfffff), rd_value(d));
+    pc += 4;
+  }
+
+  auto fetch() {
+    auto addr = pc & 0xfffff;
+    if (addr % 2) fault("misaligned fetch @", to_hex(pc));
+    return program->fetch(addr);
+  }
+
+  auto& fetch_decoded() {
+    auto addr = pc & 0xfffff;
+    if (addr % 2) fault("misaligned fetch @", to_hex(pc));
+    if (addr / 2 >= icache.size()) fault("invalid fetch @", to_hex(pc));
+    return icache[addr / 2];
+  }
+
+  // what d wrote to its rd, the low half of a floating point one, for traces.
+  // vector registers don't show.
+  u32 rd_value(const Decoded& d) const {
+    if (writes_f(d.op)) return u32(fpu.f[d.rd]);
+    if (writes_v(d.op)) return 0;
+    return d.rd == 32 ? 0 : regs[d.rd];
+  }
+
+  template<bool guarded = false, u8 hooks = HOOKS_NONE>
+  auto exec(const Decoded& d) {
+    auto rd = [&] -> auto& { return regs[d.rd]; };
+    // a branch rather than pc += d.len, which would put the load of len in
+    // the way of the next fetch
+    auto inc_pc = [&] [[gnu::always_inline]] { if (d.len == 4) [[likely]] pc += 4; else pc += 2; };
+    auto rs1 = [&]{ return regs[d.rs1]; };
+    auto rs2 = [&]{ return regs[d.rs2]; };
+    auto imm = [&]{ return d.imm; };
+    auto ishamt = [&]{ return imm(); };
+    auto rshamt = [&]{ return rs2() & 0x1f; };
+    auto addr = [&]{ return rs1() + imm(); };
+    auto j = [&](auto target){ pc = target; };
+    auto jal = [&](auto target){
+      if constexpr (hooks & HOOKS_CALLS) if (Profiler::links(d)) profiler->jump(d, target);
+      rd() = pc + d.len;
+      j(target);
+    };
+    auto jal_target = [&]{ return pc + imm(); };
+    auto jalr_target = [&]{ return addr() & ~1; };
+    auto b_target = [&](auto cond){ return cond ? pc + imm() : pc + d.len; };
+    auto branch = [&](auto cond){
+      if constexpr (hooks & HOOKS_STATS) stats->branch(d.op, cond);
+      return j(b_target(cond));
+    };
+    auto load = [&](auto x){
+      if constexpr (hooks & HOOKS_STATS) stats->load(sizeof(x));
+      auto a = addr();
+      rd() = dmem_get<decltype(x), guarded>(a);
+      if constexpr (hooks & HOOKS_TRACE) tracer->access(a, rd());
+    };
+    auto store = [&](auto x){
+      if constexpr (hooks & HOOKS_STATS) stats->store(sizeof(x));
+      if constexpr (hooks & HOOKS_TRACE) tracer->access(addr(), u32(x));
+      dmem_set<decltype(x), guarded>(addr(), x);
+    };
+    // singles are NaN-boxed
+    auto fload = [&](auto x){
+      if constexpr (hooks & HOOKS_STATS) stats->load(sizeof(x));
+      auto a = addr();
+      auto v = dmem_get<decltype(x), guarded>(a);
+      fpu.f[d.rd] = sizeof(x) == 4 ? FPU::boxed | v : v;
+      if constexpr (hooks & HOOKS_TRACE) tracer->access(a, u32(v));
+    };
+
+    if constexpr (hooks & HOOKS_STATS) stats->count(pc, d.op);
+    [[maybe_unused]] auto inst_pc = pc;
+
+#define I_OP(T, OP) (((T) rs1()) OP ((T) imm()))
+#define R_OP(T, OP) (((T) rs1()) OP ((T) rs2()))
+#define I_SH(T, SH) (((T) rs1()) SH ((T) ishamt()))
+#define R_SH(T, SH) (((T) rs1()) SH ((T) rshamt()))
+#define M_OP(OP)    muldiv(OP, rs1(), rs2())
+#define B_OP(OP)    bitmanip(OP, rs1(), rs2())
+
+    switch (d.op) {
+    case LUI:    rd() = imm();         inc_pc(); break;
+    case AUIPC:  rd() = pc + imm();    inc_pc(); break;
+    case JAL:    jal(jal_target());              break;
+    case JALR:   jal(jalr_target());             break;
+    case BEQ:    branch(R_OP(i32, ==));          break;
+    case BNE:    branch(R_OP(i32, !=));          break;
+    case BLT:    branch(R_OP(i32,  <));          break;
+    case BGE:    branch(R_OP(i32, >=));          break;
+    case BLTU:   branch(R_OP(u32,  <));          break;
+    case BGEU:   branch(R_OP(u32, >=));          break;
+    case LB:     load(i8());           inc_pc(); break;
+    case LH:     load(i16());          inc_pc(); break;
+    case LW:     load(u32());          inc_pc(); break;
+    case LBU:    load(u8());           inc_pc(); break;
+    case LHU:    load(u16());          inc_pc(); break;
+    case SB:     store(u8(rs2()));     inc_pc(); break;
+    case SH:     store(u16(rs2()));    inc_pc(); break;
+    case SW:     store(u32(rs2()));    inc_pc(); break;
+    case ADDI:   rd() = I_OP(u32,  +); inc_pc(); break;
+    case SLTI:   rd() = I_OP(i32,  <); inc_pc(); break;
+    case SLTIU:  rd() = I_OP(u32,  <); inc_pc(); break;
+    case XORI:   rd() = I_OP(u32,  ^); inc_pc(); break;
+    case ORI:    rd() = I_OP(u32,  |); inc_pc(); break;
+    case ANDI:   rd() = I_OP(u32,  &); inc_pc(); break;
+    case SLLI:   rd() = I_SH(u32, <<); inc_pc(); break;
+    case SRLI:   rd() = I_SH(u32, >>); inc_pc(); break;
+    case SRAI:   rd() = I_SH(i32, >>); inc_pc(); break;
+    case ADD:    rd() = R_OP(u32,  +); inc_pc(); break;
+    case SUB:    rd() = R_OP(u32,  -); inc_pc(); break;
+    case SLL:    rd() = R_SH(u32, <<); inc_pc(); break;
+    case SLT:    rd() = R_OP(i32,  <); inc_pc(); break;
+    case SLTU:   rd() = R_OP(u32,  <); inc_pc(); break;
+    case XOR:    rd() = R_OP(u32,  ^); inc_pc(); break;
+    case SRL:    rd() = R_SH(u32, >>); inc_pc(); break;
+    case SRA:    rd() = R_SH(i32, >>); inc_pc(); break;
+    case OR:     rd() = R_OP(u32,  |); inc_pc(); break;
+    case AND:    rd() = R_OP(u32,  &); inc_pc(); break;
+    case MUL:    rd() = M_OP(MUL);     inc_pc(); break;
+    case MULH:   rd() = M_OP(MULH);    inc_pc(); break;
+    case MULHSU: rd() = M_OP(MULHSU);  inc_pc(); break;
+    case MULHU:  rd() = M_OP(MULHU);   inc_pc(); break;
+    case DIV:    rd() = M_OP(DIV);     inc_pc(); break;
+    case DIVU:   rd() = M_OP(DIVU);    inc_pc(); break;
+    case REM:    rd() = M_OP(REM);     inc_pc(); break;
+    case REMU:   rd() = M_OP(REMU);    inc_pc(); break;
+    case SH1ADD: rd() = B_OP(SH1ADD);  inc_pc(); break;
+    case SH2ADD: rd() = B_OP(SH2ADD);  inc_pc(); break;
+    case SH3ADD: rd() = B_OP(SH3ADD);  inc_pc(); break;
+    case ANDN:   rd() = B_OP(ANDN);    inc_pc(); break;
+    case ORN:    rd() = B_OP(ORN);     inc_pc(); break;
+    case XNOR:   rd() = B_OP(XNOR);    inc_pc(); break;
+    case MAX:    rd() = B_OP(MAX);     inc_pc(); break;
+    case MAXU:   rd() = B_OP(MAXU);    inc_pc(); break;
+    case MIN:    rd() = B_OP(MIN);     inc_pc(); break;
+    case MINU:   rd() = B_OP(MINU);    inc_pc(); break;
+    case ROL:    rd() = B_OP(ROL);     inc_pc(); break;
+    case ROR:    rd() = B_OP(ROR);     inc_pc(); break;
+    case RORI:   rd() = bitmanip(RORI, rs1(), imm()); inc_pc(); break;
+    case CLZ:    rd() = B_OP(CLZ);     inc_pc(); break;
+    case CTZ:    rd() = B_OP(CTZ);     inc_pc(); break;
+    case CPOP:   rd() = B_OP(CPOP);    inc_pc(); break;
+    case SEXT_B: rd() = B_OP(SEXT_B);  inc_pc(); break;
+    case SEXT_H: rd() = B_OP(SEXT_H);  inc_pc(); break;
+    case ZEXT_H: rd() = B_OP(ZEXT_H);  inc_pc(); break;
+    case ORC_B:  rd() = B_OP(ORC_B);   inc_pc(); break;
+    case REV8:   rd() = B_OP(REV8);    inc_pc(); break;
+    case FLW:    fload(u32());         inc_pc(); break;
+    case FSW:    store(u32(fpu.f[d.rs2])); inc_pc(); break;
+    case FLD:    fload(u64());         inc_pc(); break;
+    case FSD:    store(u64(fpu.f[d.rs2])); inc_pc(); break;
+    case CSRRW: case CSRRS: case CSRRC:
+    case CSRRWI: case CSRRSI: case CSRRCI: halted = true; return; // see exec_csr
+    case EBREAK: halted = true;                  break;
+    case UNDEF:  log(disasm(fetch()), "  [@pc=", to_hex(pc), "]"); break;
+    default:
+      // the rest of F and D, and V
+      if (is_vmem(d.op)) vmem<guarded, hooks>(d);
+      else if (is_vector(d.op)) { if (!vpu.exec(d)) illegal_vector(); }
+      else if (!fpu.exec(d)) illegal_fp();
+      inc_pc();
+      break;
+    }
+
+    if constexpr (hooks & HOOKS_TRACE) {
+      tracer->retire(inst_pc, program->fetch(inst_pc & 0xfffff), rd_value(d));
+    }
+  }
+
+  auto exec(u32 inst) {
+    exec(predecode(inst));
+  }
+
+  template<bool guarded = false, u8 hooks = HOOKS_NONE>
+  auto exec() {
+    exec<guarded, hooks>(fetch_decoded());
+  }
+
+  // single steps up to n instructions, returns the steps left
+  template<bool guarded, u8 hooks = HOOKS_NONE>
+  size_t steps_interp(size_t n) {
+    counted = COUNTED_NONE;
+    // faults on guard pages longjmp past the catch, that loop counts as it goes
+    if constexpr (guarded) {
+      while (n && !halted) {
+        n--;
+        exec<guarded, hooks>();
+        executed++;
+      }
+      return n;
+    }
+    auto left = n;
+    try {
+      while (left && !halted) {
+        left--;
+        exec<guarded, hooks>();
+      }
+    } catch (...) {
+      executed += n - left - 1;
+      throw;
+    }
+    executed += n - left;
+    return left;
+  }
+
+  // executes whole basic blocks with direct threaded dispatch (computed goto).
+  // pc is only written at block exits and in front of anything that can
+  // fault, handlers inside a block derive their own pc from the block start.
+  // blocks that don't fit into the remaining n steps are single stepped
+  // through exec().
+  //
+  // the handlers step two halfword slots and link 4 bytes on, without
+  // reading the length from d. compressed instructions get handlers of their
+  // own (T_COMPRESSED), which step one slot.
+  //
+  // the slot of the first instruction of a frequent pair (T_FUSIONS) of 32
+  // bit instructions inside a block gets a fused handler, which runs the
+  // first instruction and goes straight to the handler of the second one,
+  // saving one dispatch. the second slot keeps its own handler for jumps
+  // into the middle of the pair. fusion only lives in this handler table:
+  // predecode, the other engines and the IR still see two instructions. the
+  // first one of a pair runs the same body as its own handler, so a load or
+  // store that faults there leaves pc on itself too.
+  template<bool guarded, u8 hooks = HOOKS_NONE>
+  size_t steps_threaded(size_t n) {
+    static const void* const handlers[] = {
+      &&do_LUI, &&do_AUIPC,
+      &&do_JAL, &&do_JALR, &&do_BEQ, &&do_BNE, &&do_BLT, &&do_BGE, &&do_BLTU, &&do_BGEU,
+      &&do_LB, &&do_LH, &&do_LW, &&do_LBU, &&do_LHU, &&do_SB, &&do_SH, &&do_SW,
+      &&do_ADDI, &&do_SLTI, &&do_SLTIU, &&do_XORI, &&do_ORI, &&do_ANDI,
+      &&do_SLLI, &&do_SRLI, &&do_SRAI,
+      &&do_ADD, &&do_SUB, &&do_SLL, &&do_SLT, &&do_SLTU, &&do_XOR, &&do_SRL,
+      &&do_SRA, &&do_OR, &&do_AND,
+      &&do_MUL, &&do_MULH, &&do_MULHSU, &&do_MULHU,
+      &&do_DIV, &&do_DIVU, &&do_REM, &&do_REMU,
+      &&do_SH1ADD, &&do_SH2ADD, &&do_SH3ADD,
+      &&do_ANDN, &&do_ORN, &&do_XNOR, &&do_MAX, &&do_MAXU, &&do_MIN, &&do_MINU,
+      &&do_ROL, &&do_ROR, &&do_RORI,
+      &&do_CLZ, &&do_CTZ, &&do_CPOP, &&do_SEXT_B, &&do_SEXT_H, &&do_ZEXT_H, &&do_ORC_B, &&do_REV8,
+      &&do_FLW, &&do_FSW, &&do_FLD, &&do_FSD,
+      // the rest of F and D, single then double
+      &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP,
+      &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP,
+      &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP,
+      &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP,
+      &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP,
+      &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP, &&do_FP,
+      // V, the loads and stores and the rest
+      &&do_V, &&do_V, &&do_V,
+      &&do_VMEM, &&do_VMEM, &&do_VMEM, &&do_VMEM, &&do_VMEM, &&do_VMEM, &&do_VMEM,
+      &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V,
+      &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V,
+      &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V,
+      &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V,
+      &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V, &&do_V,
+      &&do_V, &&do_V, &&do_V, &&do_V, &&do_V,
+      &&do_CSR, &&do_CSR, &&do_CSR, &&do_CSR, &&do_CSR, &&do_CSR,
+      &&do_EBREAK, &&do_UNDEF,
+      &&do_END // past the last icache slot
+    };
+    // one entry per Instruction, then END
+    static_assert(std::size(handlers) == UNDEF + 2);
+
+    // by dynamic frequency in examples/primes and bench/programs, first
+    // instruction, second instruction, what the first one does
+#define T_FUSIONS(X) \
+    X(ADDI, JAL,  T_I_BODY(u32, +))  X(ADDI, ADDI, T_I_BODY(u32, +)) \
+    X(ADDI, BLTU, T_I_BODY(u32, +))  X(ADDI, BNE,  T_I_BODY(u32, +)) \
+    X(SRLI, BNE,  T_I_BODY(u32, >>)) X(SRLI, SRLI, T_I_BODY(u32, >>)) \
+    X(SLLI, SRLI, T_I_BODY(u32, <<)) X(SLLI, SLLI, T_I_BODY(u32, <<)) \
+    X(SLLI, ADD,  T_I_BODY(u32, <<)) X(SLLI, BLTU, T_I_BODY(u32, <<)) \
+    X(ANDI, BEQ,  T_I_BODY(u32, &))  X(ADD,  SLLI, T_R_BODY(u32, +)) \
+    X(XOR,  ANDI, T_R_BODY(u32, ^))  X(SW,   ADDI, T_STORE_BODY(u32)) \
+    X(SB,   ADDI, T_STORE_BODY(u8))  X(LW,   BGE,  T_LOAD_BODY(u32)) \
+    X(LW,   LW,   T_LOAD_BODY(u32))  X(LBU,  BEQ,  T_LOAD_BODY(u8)) \
+    X(LBU,  BNE,  T_LOAD_BODY(u8))   X(LBU,  XOR,  T_LOAD_BODY(u8))
+#define T_FUSION(A, B, FIRST) {A, B, &&fused_##A##_##B},
+
+    static const struct { u8 first, second; const void* handler; } fusions[] = { T_FUSIONS(T_FUSION) };
+
+    // everything a compressed instruction expands to except the jumps and
+    // branches, and what it does
+#define T_COMPRESSED(X) \
+    X(ADDI, T_I_BODY(u32, +))   X(ANDI, T_I_BODY(u32, &))   X(SLLI, T_I_BODY(u32, <<)) \
+    X(SRLI, T_I_BODY(u32, >>))  X(SRAI, T_I_BODY(i32, >>))  X(LUI,  T_RD = T_IMM) \
+    X(ADD,  T_R_BODY(u32, +))   X(SUB,  T_R_BODY(u32, -))   X(XOR,  T_R_BODY(u32, ^)) \
+    X(OR,   T_R_BODY(u32, |))   X(AND,  T_R_BODY(u32, &)) \
+    X(LW,   T_LOAD_BODY(u32))   X(SW,   T_STORE_BODY(u32)) \
+    X(FLW,  T_FLOAD_BODY(u32))  X(FSW,  T_FSTORE_BODY(u32)) \
+    X(FLD,  T_FLOAD_BODY(u64))  X(FSD,  T_FSTORE_BODY(u64))
+#define T_C_HANDLER(OP, BODY) {OP, &&c_##OP},
+
+    static const struct { u8 op; const void* handler; } compressed[] = {
+      T_COMPRESSED(T_C_HANDLER) {JAL, &&c_JAL}, {JALR, &&c_JALR}, {BEQ, &&c_BEQ}, {BNE, &&c_BNE}
+    };
+
+    // one extra slot so falling off the end of imem returns to the dispatcher
+    auto& threaded = program->threaded[guarded][hooks];
+    std::call_once(program->threaded_once[guarded][hooks], [&]{
+      for (auto& d : icache) threaded.push_back(handlers[d.op]);
+      threaded.push_back(handlers[UNDEF + 1]);
+      for (size_t i = 0; i < icache.size(); i++) {
+        if (icache[i].len == 4) continue;
+        for (auto& c : compressed) {
+          if (c.op == icache[i].op) threaded[i] = c.handler;
+        }
+      }
+      for (size_t i = 0; i + 2 < icache.size(); i++) {
+        if (block_len[i] < 2) continue; // the pair would span blocks
+        if (icache[i].len != 4 || icache[i + 2].len != 4) continue;
+        for (auto& f : fusions) {
+          if (f.first == icache[i].op && f.second == icache[i + 2].op) threaded[i] = f.handler;
+        }
+      }
+    });
+
+    const Decoded* block = nullptr;
+    const Decoded* d = nullptr;
+    const void* const* t = nullptr;
+    u32 block_pc = 0;
+    counted = COUNTED_BLOCK;
+
+#define T_RD          regs[d->rd]
+#define T_RS1         regs[d->rs1]
+#define T_RS2         regs[d->rs2]
+#define T_IMM         d->imm
+#define T_PC          (block_pc + 2 * u32(d - block))
+#define T_STATS(X)    do { if constexpr (hooks & HOOKS_STATS) stats->X; } while (0)
+#define T_TRACE       do { if constexpr (hooks & HOOKS_TRACE) { \
+    tracer->retire(T_PC, program->fetch(2 * (d - icache.data())), rd_value(*d)); } } while (0)
+#define T_ACCESS(A, V) do { if constexpr (hooks & HOOKS_TRACE) tracer->access(A, V); } while (0)
+#define T_STEP_BY(N)  do { T_STATS(count(T_PC, d->op)); T_TRACE; d += N; t += N; } while (0)
+#define T_STEP        T_STEP_BY(2)
+#define T_NEXT        do { T_STEP; goto **t; } while (0)
+#define T_JUMP(X)     do { T_STATS(count(T_PC, d->op)); T_TRACE; pc = (X); goto jumped; } while (0)
+#define T_I_BODY(T, OP) T_RD = ((T) T_RS1) OP ((T) T_IMM)
+#define T_R_BODY(T, OP) T_RD = ((T) T_RS1) OP ((T) T_RS2)
+#define T_I_OP(T, OP) T_I_BODY(T, OP); T_NEXT
+#define T_R_OP(T, OP) T_R_BODY(T, OP); T_NEXT
+#define T_R_SH(T, SH) T_RD = ((T) T_RS1) SH ((T) T_RS2 & 0x1f); T_NEXT
+#define T_M_OP(OP)    T_RD = muldiv(OP, T_RS1, T_RS2); T_NEXT
+#define T_B_OP(OP)    T_RD = bitmanip(OP, T_RS1, T_RS2); T_NEXT
+#define T_BRANCH(T, OP, LEN) do { \
+    auto taken = ((T) T_RS1) OP ((T) T_RS2); \
+    T_STATS(branch(d->op, taken)); \
+    T_JUMP(taken ? T_PC + T_IMM : T_PC + LEN); \
+  } while (0)
+#define T_JALR(LEN) do { \
+    auto target = (T_RS1 + T_IMM) & ~1u; \
+    T_RD = T_PC + LEN; \
+    T_JUMP(target); \
+  } while (0)
+#define T_LOAD_BODY(T) do { \
+    pc = T_PC; \
+    auto addr = T_RS1 + T_IMM; \
+    T_STATS(load(sizeof(T))); \
+    T_RD = dmem_get<T, guarded>(addr); \
+    T_ACCESS(addr, T_RD); \
+  } while (0)
+#define T_STORE_BODY(T) do { \
+    pc = T_PC; \
+    auto addr = T_RS1 + T_IMM; \
+    T_STATS(store(sizeof(T))); \
+    T_ACCESS(addr, T(T_RS2)); \
+    dmem_set<T, guarded>(addr, T(T_RS2)); \
+  } while (0)
+#define T_FLOAD_BODY(T) do { \
+    pc = T_PC; \
+    auto addr = T_RS1 + T_IMM; \
+    T_STATS(load(sizeof(T))); \
+    auto v = dmem_get<T, guarded>(addr); \
+    fpu.f[d->rd] = sizeof(T) == 4 ? FPU::boxed | v : v; \
+    T_ACCESS(addr, u32(v)); \
+  } while (0)
+#define T_FSTORE_BODY(T) do { \
+    pc = T_PC; \
+    auto addr = T_RS1 + T_IMM; \
+    T_STATS(store(sizeof(T))); \
+    T_ACCESS(addr, u32(fpu.f[d->rs2])); \
+    dmem_set<T, guarded>(addr, T(fpu.f[d->rs2])); \
+  } while (0)
+#define T_LOAD(T)     T_LOAD_BODY(T); T_NEXT
+#define T_STORE(T)    T_STORE_BODY(T); T_NEXT
+#define T_FLOAD(T)    T_FLOAD_BODY(T); T_NEXT
+#define T_FSTORE(T)   T_FSTORE_BODY(T); T_NEXT
+#define T_FUSED(A, B, FIRST) fused_##A##_##B: FIRST; T_STEP; goto do_##B;
+#define T_C(OP, BODY) c_##OP: BODY; T_STEP_BY(1); goto **t;
+
+  next_block:
+    if (!n || halted) return n;
+    {
+      auto& first = fetch_decoded();
+      auto i = &first - icache.data();
+      if (block_len[i] > n) return steps_interp<guarded, hooks>(n);
+      n -= block_len[i];
+      executed += block_len[i];
+      block = d = &first;
+      block_pc = pc;
+      t = &threaded[i];
+      goto **t;
+    }
+
+    // d is the jump that ended the block, the one place calls are followed
+  jumped:
+    if constexpr (hooks & HOOKS_CALLS) {
+      if (Profiler::links(*d)) profiler->jump(*d, pc);
+    }
+    goto next_block;
+
+  do_LUI:    T_RD = T_IMM; T_NEXT;
+  do_AUIPC:  T_RD = T_PC + T_IMM; T_NEXT;
+  do_JAL:    T_RD = T_PC + 4; T_JUMP(T_PC + T_IMM);
+  do_JALR:   T_JALR(4);
+  do_BEQ:    T_BRANCH(i32, ==, 4);
+  do_BNE:    T_BRANCH(i32, !=, 4);
+  do_BLT:    T_BRANCH(i32,  <, 4);
+  do_BGE:    T_BRANCH(i32, >=, 4);
+  do_BLTU:   T_BRANCH(u32,  <, 4);
+  do_BGEU:   T_BRANCH(u32, >=, 4);
+  do_LB:     T_LOAD(i8);
+  do_LH:     T_LOAD(i16);
+  do_LW:     T_LOAD(u32);
+  do_LBU:    T_LOAD(u8);
+  do_LHU:    T_LOAD(u16);
+  do_SB:     T_STORE(u8);
+  do_SH:     T_STORE(u16);
+  do_SW:     T_STORE(u32);
+  do_ADDI:   T_I_OP(u32,  +);
+  do_SLTI:   T_I_OP(i32,  <);
+  do_SLTIU:  T_I_OP(u32,  <);
+  do_XORI:   T_I_OP(u32,  ^);
+  do_ORI:    T_I_OP(u32,  |);
+  do_ANDI:   T_I_OP(u32,  &);
+  do_SLLI:   T_I_OP(u32, <<);
+  do_SRLI:   T_I_OP(u32, >>);
+  do_SRAI:   T_I_OP(i32, >>);
+  do_ADD:    T_R_OP(u32,  +);
+  do_SUB:    T_R_OP(u32,  -);
+  do_SLL:    T_R_SH(u32, <<);
+  do_SLT:    T_R_OP(i32,  <);
+  do_SLTU:   T_R_OP(u32,  <);
+  do_XOR:    T_R_OP(u32,  ^);
+  do_SRL:    T_R_SH(u32, >>);
+  do_SRA:    T_R_SH(i32, >>);
+  do_OR:     T_R_OP(u32,  |);
+  do_AND:    T_R_OP(u32,  &);
+  do_MUL:    T_M_OP(MUL);
+  do_MULH:   T_M_OP(MULH);
+  do_MULHSU: T_M_OP(MULHSU);
+  do_MULHU:  T_M_OP(MULHU);
+  do_DIV:    T_M_OP(DIV);
+  do_DIVU:   T_M_OP(DIVU);
+  do_REM:    T_M_OP(REM);
+  do_REMU:   T_M_OP(REMU);
+  do_SH1ADD: T_B_OP(SH1ADD);
+  do_SH2ADD: T_B_OP(SH2ADD);
+  do_SH3ADD: T_B_OP(SH3ADD);
+  do_ANDN:   T_B_OP(ANDN);
+  do_ORN:    T_B_OP(ORN);
+  do_XNOR:   T_B_OP(XNOR);
+  do_MAX:    T_B_OP(MAX);
+  do_MAXU:   T_B_OP(MAXU);
+  do_MIN:    T_B_OP(MIN);
+  do_MINU:   T_B_OP(MINU);
+  do_ROL:    T_B_OP(ROL);
+  do_ROR:    T_B_OP(ROR);
+  do_RORI:   T_RD = bitmanip(RORI, T_RS1, T_IMM); T_NEXT;
+  do_CLZ:    T_B_OP(CLZ);
+  do_CTZ:    T_B_OP(CTZ);
+  do_CPOP:   T_B_OP(CPOP);
+  do_SEXT_B: T_B_OP(SEXT_B);
+  do_SEXT_H: T_B_OP(SEXT_H);
+  do_ZEXT_H: T_B_OP(ZEXT_H);
+  do_ORC_B:  T_B_OP(ORC_B);
+  do_REV8:   T_B_OP(REV8);
+  do_FLW:    T_FLOAD(u32);
+  do_FSW:    T_FSTORE(u32);
+  do_FLD:    T_FLOAD(u64);
+  do_FSD:    T_FSTORE(u64);
+  do_FP:     if (!fpu.exec(*d)) { pc = T_PC; illegal_fp(); } T_NEXT;
+  do_V:      if (!vpu.exec(*d)) { pc = T_PC; illegal_vector(); } T_NEXT;
+  do_VMEM:   pc = T_PC; vmem<guarded, hooks>(*d); T_NEXT;
+  do_CSR:
+  do_EBREAK:
+  do_UNDEF:  pc = T_PC; exec<guarded, hooks>(*d); goto next_block;
+  do_END:    pc = T_PC; goto next_block;
+
+  T_FUSIONS(T_FUSED)
+
+  T_COMPRESSED(T_C)
+  c_JAL:     T_RD = T_PC + 2; T_JUMP(T_PC + T_IMM);
+  c_JALR:    T_JALR(2);
+  c_BEQ:     T_BRANCH(i32, ==, 2);
+  c_BNE:     T_BRANCH(i32, !=, 2);
+
+#undef T_RD
+#undef T_RS1
+#undef T_RS2
+#undef T_IMM
+#undef T_PC
+#undef T_STEP_BY
+#undef T_STEP
+#undef T_NEXT
+#undef T_JUMP
+#undef T_I_BODY
+#undef T_R_BODY
+#undef T_I_OP
+#undef T_R_OP
+#undef T_R_SH
+#undef T_M_OP
+#undef T_B_OP
+#undef T_FLOAD
+#undef T_FSTORE
+#undef T_BRANCH
+#undef T_JALR
+#undef T_STATS
+#undef T_TRACE
+#undef T_ACCESS
+#undef T_LOAD_BODY
+#undef T_STORE_BODY
+#undef T_FLOAD_BODY
+#undef T_FSTORE_BODY
+#undef T_LOAD
+#undef T_STORE
+#undef T_FUSIONS
+#undef T_FUSION
+#undef T_FUSED
+#undef T_COMPRESSED
+#undef T_C_HANDLER
+#undef T_C
+  }
+
+#if defined(__x86_64__)
+  JIT jit;
+
+  // runs translated blocks once they got hot, everything else (cold blocks,
+  // blocks longer than the remaining n, side exits) goes through exec()
+  template<bool guarded, u8 hooks = HOOKS_NONE>
+  size_t steps_jit(size_t n) {
+    counted = COUNTED_NONE;
+    if (auto wanted = hooks & HOOKS_CALLS ? profiler.get() : nullptr; jit.profiler != wanted) {
+      jit.flush();
+      jit.profiler = wanted;
+    }
+    while (n && !halted) {
+      auto i = &fetch_decoded() - icache.data();
+
+      if (auto block = jit.lookup(pc, icache); block && block->len <= n) {
+        auto& ctx = jit.ctx;
+        ctx.regs = regs.data();
+        ctx.dmem = dmem;
+        ctx.mmu = guarded ? (void*)mmu.attr.data() : mmu.tlb;
+        ctx.budget = n;
+        ctx.pc = pc;
+        executed += n;
+        counted = COUNTED_JIT;
+        jit.run(ctx, block->code);
+        counted = COUNTED_NONE;
+        executed -= ctx.budget;
+        pc = ctx.pc;
+        // the first instruction left through a side exit, e.g. console output
+        if (ctx.budget == n) {
+          exec<guarded, hooks>();
+          executed++;
+          ctx.budget--;
+        }
+        n = ctx.budget;
+        continue;
+      }
+
+      auto len = std::min<size_t>(block_len[i], n);
+      n -= len;
+      while (len--) {
+        exec<guarded, hooks>();
+        executed++;
+      }
+    }
+    return n;
+  }
+#endif
+
+  enum Engine { ENGINE_INTERP, ENGINE_THREADED, ENGINE_JIT };
+  Engine engine = ENGINE_INTERP;
+
+  // translated code only calls the profiler, the JIT engine runs threaded
+  // while stats or traces are on
+  template<bool guarded, u8 hooks>
+  size_t steps_with(size_t n) {
+    switch (engine) {
+    case ENGINE_INTERP:   return steps_interp<guarded, hooks>(n);
+    case ENGINE_THREADED: return steps_threaded<guarded, hooks>(n);
+#if defined(__x86_64__)
+    case ENGINE_JIT:
+      if constexpr (hooks & ~HOOKS_CALLS) return steps_threaded<guarded, hooks>(n);
+      else return steps_jit<guarded, hooks>(n);
+#else
+    case ENGINE_JIT:      return steps_threaded<guarded, hooks>(n);
+#endif
+    }
+    return n;
+  }
+
+  // runs in slices up to the profiler's next sample
+  template<bool guarded, u8 hooks>
+  size_t steps_profiled(size_t n) {
+    while (n && !halted) {
+      auto slice = std::min<size_t>(n, profiler->countdown);
+      auto ran = slice - steps_with<guarded, hooks>(slice);
+      n -= ran;
+      profiler->countdown -= ran;
+      if (!profiler->countdown) {
+        profiler->sample(pc);
+        profiler->countdown = profiler->interval;
+      }
+    }
+    return n;
+  }
+
+  // runs the CSR instructions the loops stop on, see exec_csr
+  template<bool guarded, u8 hooks>
+  size_t steps_hooked(size_t n) {
+    for (auto left = n; ; ) {
+      if constexpr (hooks & HOOKS_CALLS) left = steps_profiled<guarded, hooks>(left);
+      else left = steps_with<guarded, hooks>(left);
+      if (!halted || !is_csr(fetch_decoded().op)) return left;
+      halted = false;
+      // the loop counted the CSR instruction, it ends its block
+      counted = COUNTED_BLOCK;
+      exec_csr<hooks>(fetch_decoded(), executed - 1);
+    }
+  }
+
+  // the loops with the hooks for whatever is attached
+  template<bool guarded>
+  size_t steps_any(size_t n) {
+    auto hooks = (stats ? HOOKS_STATS : 0) | (profiler ? HOOKS_CALLS : 0) | (tracer ? HOOKS_TRACE : 0);
+    switch (hooks) {
+    case 0: return steps_hooked<guarded, 0>(n);
+    case 1: return steps_hooked<guarded, 1>(n);
+    case 2: return steps_hooked<guarded, 2>(n);
+    case 3: return steps_hooked<guarded, 3>(n);
+    case 4: return steps_hooked<guarded, 4>(n);
+    case 5: return steps_hooked<guarded, 5>(n);
+    case 6: return steps_hooked<guarded, 6>(n);
+    default: return steps_hooked<guarded, 7>(n);
+    }
+  }
+
+  // after a fault: takes back what the loop counted for the faulting
+  // instruction and the ones behind it. pc is on the faulting instruction,
+  // or isn't a valid one if the fetch faulted, then nothing was counted.
+  void uncount() {
+    switch (std::exchange(counted, COUNTED_NONE)) {
+    case COUNTED_NONE:
+      break;
+    case COUNTED_BLOCK:
+      if (auto addr = pc & 0xfffff; addr % 2 == 0 && addr / 2 < icache.size()) {
+        executed -= block_len[addr / 2];
+      }
+      break;
+    case COUNTED_JIT:
+#if defined(__x86_64__)
+      // only guard page faults stop translated code, they skip its exit
+      executed -= jit.ctx.budget;
+      if (auto it = jit.accesses.find(guard.rip); it != jit.accesses.end()) {
+        pc = it->second.pc;
+        executed -= it->second.refund;
+      }
+#endif
+      break;
+    }
+  }
+
+  // runs up to n instructions or until EBREAK, returns the number executed.
+  // guest errors throw a Fault, with pc on the faulting instruction and
+  // executed counting the ones before it.
+  size_t steps(size_t n) {
+    auto start = executed;
+    // fflags gets what the guest's floating point arithmetic raised, see
+    // FPU::settle
+    FPU::clear_host_flags();
+    struct Settle { FPU& fpu; ~Settle() { fpu.settle(); } } settle{fpu};
+    if (!guarded) {
+      try {
+        steps_any<false>(n);
+      } catch (...) {
+        uncount();
+        throw;
+      }
+      return executed - start;
+    }
+
+    struct Scope { ~Scope() { guard.base = nullptr; } } scope;
+    guard.base = dmem;
+    if (sigsetjmp(guard.env, 1)) {
+#if defined(__x86_64__)
+      // the handler ran on a fresh MXCSR, the guest's flags are in guard
+      fpu.fcsr |= FPU::from_mxcsr(guard.mxcsr);
+#endif
+      uncount();
+      fault("\nError: guard page: invalid memory access @", to_hex(guard.addr), '\n');
+    }
+    try {
+      steps_any<true>(n);
+    } catch (...) {
+      uncount();
+      throw;
+    }
+    return executed - start;
+  }
+
+  CPU(const auto prog_dir, const Config& config = {})
+    : vpu(regs.data(), config.vlen),
+      program(Program::load(std::string(prog_dir) + "instruction_mem.bin")),
+      imem(program->imem),
+      imem_size(program->imem_size),
+      cpi(config.cpi),
+      timebase(config.timebase),
+      icache(program->icache),
+      block_len(program->block_len) {
+    auto dmem_filename = std::string(prog_dir) + std::string("data_mem.bin");
+
+    try {
+      auto dmem_file_size = size_t(0);
+      if (config.fork_fd >= 0) {
+        struct stat st;
+        if (fstat(config.fork_fd, &st)) die("fstat(fork_fd) failed");
+        dmem_size = st.st_size;
+      } else {
+        dmem_file_size = std::filesystem::file_size(std::filesystem::path(dmem_filename));
+        dmem_size = std::max(dmem_file_size, config.ram_size);
+      }
+
+      guarded = config.guard_pages;
+      auto at = (u8*)nullptr;
+      if (guarded) {
+        install_guard_handler();
+        dmem_size = (dmem_size + page_size - 1) / page_size * page_size;
+        at = reserve_guest_space();
+      }
+
+      if (config.fork_fd >= 0) {
+        dmem = map_fork(config.fork_fd, dmem_size, at);
+      } else if (config.shareable) {
+        dmem = map_shareable_ram(dmem_size, dmem_fd, at);
+        read_file_into(dmem, dmem_filename, dmem_file_size);
+      } else {
+        dmem = map_ram(dmem_size, config.huge_pages, at);
+        // mapping the image would split the first huge page into small ones
+        if (config.huge_pages == HUGE_PAGES_OFF) {
+          map_file_over(dmem, dmem_filename, dmem_file_size, PROT_READ | PROT_WRITE);
+        } else {
+          read_file_into(dmem, dmem_filename, dmem_file_size);
+        }
+      }
+
+      if (guarded) {
+        mmu.guard(dmem);
+#if defined(__x86_64__)
+        jit.guarded = true;
+#endif
+      }
+#if defined(__x86_64__)
+      jit.passes = config.jit_passes;
+      jit.mmu = &mmu;
+      jit.fpu = &fpu;
+      jit.vpu = &vpu;
+      jit.cpu = this;
+      jit.vmem = guarded ? &vmem_fast<true> : &vmem_fast<false>;
+#endif
+      mmu.map_ram(0, dmem_size, dmem);
+      mmu.map_device(0x5000, Console::SIZE, &console);
+      if (config.console_thread) console.start_consumer();
+    } catch (std::filesystem::filesystem_error e) {
+      die("could not initialize CPU memory. ", e.what());
+    }
+  }
+
+  ~CPU(){
+    munmap(dmem, guarded ? guest_space : dmem_size);
+    if (dmem_fd >= 0) close(dmem_fd);
+  }
+
+  auto dump_regs() {
+    print();
+    for (size_t i1 = 0, i2 = 16; i1 < 16; i1++, i2++) {
+      print("[x", std::left, std::setw(2), i1, "] = ", to_hex(regs[i1]), "\t",
+            "[x", std::left, std::setw(2), i2, "] = ", to_hex(regs[i2]));
+    }
+  }
+
+  auto dump_imem(size_t n) {
+    print("\n------------------------IMEM------------------------");
+    for (u32 i = 0; n-- && i + 2 <= imem_size; ) {
+      auto x = program->fetch(i);
+      print("[", to_hex(i), "] = ", to_hex(x), "\t\t", disasm(x));
+      i += is_compressed(x) ? 2 : 4;
+    }
+    print("------------------------IMEM END--------------------");
+  }
+
+  auto dump_dmem(auto n) {
+    n = std::min(n, dmem_size);
+    print("\n------------------------DMEM------------------------");
+    for (u32 i = 0; i < n; i += 4) {
+      auto x = *(u32*)(dmem + i);
+      print("[", to_hex(i), "] = ", to_hex(x));
+    }
+    print("------------------------DMEM END--------------------");
+  }
+
+};
+
+#endif // #ifndef CPU_HPP
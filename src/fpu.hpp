@@ -0,0 +1,363 @@
+#ifndef FPU_HPP
+#define FPU_HPP
+
+// the F and D extensions, on host scalar floating point (SSE2 on x86-64).
+//
+// the 32 registers are 64 bits wide, singles live NaN-boxed in the lower
+// half: a single whose upper half isn't all ones reads as the canonical NaN.
+// arithmetic runs on the host, which stays in round to nearest even: the
+// other modes switch it for the one operation, RMM, which the host lacks,
+// fixes up ties (away()). the host's exception flags are only moved into
+// fflags at CSR instructions and when the CPU stops (settle()). NaN results
+// are always the canonical NaN, the host would propagate payloads.
+//
+// conversions to integers, comparisons, min/max and fclass don't go through
+// the host: their saturation, NaN handling and flags are RISC-V's own.
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__x86_64__)
+#include <xmmintrin.h>
+#else
+#include <cfenv>
+#endif
+
+#include "isa.hpp"
+
+struct FPU {
+  std::array<u64, 32> f = {0};
+  u32 fcsr = 0; // frm << 5 | fflags
+  u32* x;       // the integer registers, x[32] is the x0 sink
+
+  enum : u32 { FLAG_NX = 1, FLAG_UF = 2, FLAG_OF = 4, FLAG_DZ = 8, FLAG_NV = 16 };
+  enum : u32 { RM_RNE, RM_RTZ, RM_RDN, RM_RUP, RM_RMM, RM_DYN = 7 };
+
+  explicit FPU(u32* x) : x(x) {}
+
+  static constexpr u64 boxed = 0xffffffff00000000;
+  static constexpr u32 nan_s = 0x7fc00000;
+  static constexpr u64 nan_d = 0x7ff8000000000000;
+
+  // for calls from translated code
+  static bool step(FPU* fpu, Decoded d) {
+    return fpu->exec(d);
+  }
+
+  template<typename T> T get(u32 r) const {
+    if constexpr (sizeof(T) == 4) {
+      return std::bit_cast<float>(f[r] >> 32 == 0xffffffff ? u32(f[r]) : nan_s);
+    } else {
+      return std::bit_cast<double>(f[r]);
+    }
+  }
+
+  template<typename T> void set(u32 r, T v) {
+    if constexpr (sizeof(T) == 4) f[r] = boxed | std::bit_cast<u32>(v);
+    else f[r] = std::bit_cast<u64>(v);
+  }
+
+  template<typename T> static T canonical(T v) {
+    if (!std::isnan(v)) return v;
+    if constexpr (sizeof(T) == 4) return std::bit_cast<float>(nan_s);
+    else return std::bit_cast<double>(nan_d);
+  }
+
+  template<typename T> static bool is_snan(T v) {
+    if constexpr (sizeof(T) == 4) {
+      auto b = std::bit_cast<u32>(v);
+      return (b & 0x7fc00000) == 0x7f800000 && (b & 0x003fffff);
+    } else {
+      auto b = std::bit_cast<u64>(v);
+      return (b & 0x7ff8000000000000) == 0x7ff0000000000000 && (b & 0x0007ffffffffffff);
+    }
+  }
+
+  // the instruction's rounding mode, frm for RM_DYN. decode() rejects the
+  // reserved static ones, exec() reserved values in frm.
+  u32 rounding(const Decoded& d) const {
+    auto rm = u32(d.imm & 7);
+    return rm == RM_DYN ? fcsr >> 5 & 7 : rm;
+  }
+
+  // forces v into a register (memory off x86-64) at this point, so the
+  // compiler can't move its computation across a rounding mode switch
+  template<typename V>
+  static void pin(V& v) {
+#if defined(__x86_64__)
+    if constexpr (std::is_floating_point_v<V>) asm volatile("" : "+x"(v));
+    else asm volatile("" : "+r"(v));
+#else
+    asm volatile("" : "+m"(v));
+#endif
+  }
+
+  // the exception flags host arithmetic raised, in MXCSR (the fenv flags off
+  // x86-64). they pile up there, translated code's too, and settle() moves
+  // them into fflags when a CSR instruction runs and when CPU::steps() returns.
+#if defined(__x86_64__)
+  // the denormal operand flag has no RISC-V counterpart
+  static u32 from_mxcsr(u32 mxcsr) {
+    return (mxcsr & 0x01 ? u32(FLAG_NV) : 0u) | (mxcsr & 0x04 ? u32(FLAG_DZ) : 0u)
+         | (mxcsr & 0x08 ? u32(FLAG_OF) : 0u) | (mxcsr & 0x10 ? u32(FLAG_UF) : 0u)
+         | (mxcsr & 0x20 ? u32(FLAG_NX) : 0u);
+  }
+
+  static u32 host_flags() { return from_mxcsr(_mm_getcsr()); }
+  static void clear_host_flags() { _mm_setcsr(_mm_getcsr() & ~0x3fu); }
+#else
+  static u32 host_flags() {
+    auto raised = std::fetestexcept(FE_ALL_EXCEPT);
+    return (raised & FE_INVALID ? u32(FLAG_NV) : 0u) | (raised & FE_DIVBYZERO ? u32(FLAG_DZ) : 0u)
+         | (raised & FE_OVERFLOW ? u32(FLAG_OF) : 0u) | (raised & FE_UNDERFLOW ? u32(FLAG_UF) : 0u)
+         | (raised & FE_INEXACT ? u32(FLAG_NX) : 0u);
+  }
+
+  static void clear_host_flags() { std::feclearexcept(FE_ALL_EXCEPT); }
+#endif
+
+  void settle() {
+    fcsr |= host_flags();
+    clear_host_flags();
+  }
+
+  // fn(args...) under rounding mode rm, any but RMM. the host stays in RNE,
+  // the other modes switch it around fn, with args and the result pinned in
+  // between.
+  template<typename T>
+  T host(u32 rm, auto fn, auto... args) {
+    if (rm == RM_RNE) return canonical(T(fn(args...)));
+#if defined(__x86_64__)
+    // MXCSR rounding control, in RM_* order
+    static constexpr u32 rc[] = {0x0000, 0x6000, 0x2000, 0x4000};
+    _mm_setcsr(_mm_getcsr() | rc[rm]);
+    (pin(args), ...);
+    T r = fn(args...);
+    pin(r);
+    _mm_setcsr(_mm_getcsr() & ~0x6000u);
+#else
+    static constexpr int modes[] = {FE_TONEAREST, FE_TOWARDZERO, FE_DOWNWARD, FE_UPWARD};
+    std::fesetround(modes[rm]);
+    (pin(args), ...);
+    T r = fn(args...);
+    pin(r);
+    std::fesetround(FE_TONEAREST);
+#endif
+    return canonical(r);
+  }
+
+  // fn(args...), leaving the host's exception flags as they were
+  template<typename T>
+  static T quietly(auto fn, auto... args) {
+#if defined(__x86_64__)
+    auto flags = _mm_getcsr();
+#else
+    std::fexcept_t flags;
+    std::fegetexceptflag(&flags, FE_ALL_EXCEPT);
+#endif
+    (pin(args), ...);
+    T r = fn(args...);
+    pin(r);
+#if defined(__x86_64__)
+    _mm_setcsr(flags);
+#else
+    std::fesetexceptflag(&flags, FE_ALL_EXCEPT);
+#endif
+    return r;
+  }
+
+  // op (the single precision instruction) under RMM, which the host lacks:
+  // to nearest, ties away from zero. the operands are exact as doubles. only
+  // a tie rounds differently from RNE, so this takes the host's RNE result
+  // in double, v, and works out from fma residuals how far the exact result
+  // lies beyond it, e / s with s > 0. a double tie that went towards zero
+  // moves one step away. singles narrow v, its float midpoints are exact
+  // ones but for the fused ops, where e breaks them.
+  template<typename T>
+  T away(u32 op, double a, double b = 0, double c = 0) {
+    auto fused = op == FMADD_S || op == FMSUB_S || op == FNMSUB_S || op == FNMADD_S;
+    auto v = [&]{
+      switch (op) {
+      case FADD_S:  return a + b;
+      case FSUB_S:  return a - b;
+      case FMUL_S:  return a * b;
+      case FDIV_S:  return a / b;
+      case FSQRT_S: return std::sqrt(a);
+      default:      return fused ? std::fma(a, b, c) : a; // conversions
+      }
+    }();
+    pin(v);
+    T r = T(v);
+    pin(r);
+    if (!std::isfinite(v)) return canonical(r);
+
+    return quietly<T>([op, fused](double v, T r, double a, double b, double c) -> T {
+      // s + err is x + y exactly
+      auto two_sum = [](double x, double y, double& err) {
+        auto s = x + y;
+        auto y1 = s - x;
+        err = (x - (s - y1)) + (y - y1);
+        return s;
+      };
+      auto e = 0.0, s = 1.0;
+      if (op == FADD_S || op == FSUB_S) two_sum(a, op == FADD_S ? b : -b, e);
+      if (op == FMUL_S) e = std::fma(a, b, -v);
+      if (op == FDIV_S) { e = std::fma(-v, b, a); s = b; }
+      if (fused && std::isfinite(a * b)) {
+        // Boldo and Muller's ErrFma: the exact result is v + r2 + r3, with r3
+        // below half an ulp of r2. a nonzero r3 rules out a double tie,
+        // singles only need the sign.
+        auto u1 = a * b;
+        auto u2 = std::fma(a, b, -u1);
+        double a2, b2;
+        auto a1 = two_sum(c, u2, a2);
+        auto b1 = two_sum(u1, a1, b2);
+        auto g = (b1 - v) + b2;
+        auto r2 = g + a2;
+        auto r3 = a2 - (r2 - g);
+        e = sizeof(T) == 4 || r3 == 0 ? r2 : 0;
+      }
+      if (s < 0) { e = -e; s = -s; }
+
+      if constexpr (sizeof(T) == 8) {
+        if (e == 0) return r;
+        auto n = std::nextafter(v, e > 0 ? INFINITY : -INFINITY);
+        return 2 * e == (n - v) * s && std::fabs(n) > std::fabs(v) ? n : v;
+      } else {
+        if (double(r) == v) return r;
+        auto n = std::nextafter(r, v > double(r) ? INFINITY : -INFINITY);
+        if ((double(r) + double(n)) / 2 != v) return r;
+        // v is a midpoint: ties away, unless e says which side it's really on
+        if (e == 0) return std::fabs(n) > std::fabs(r) ? n : r;
+        return (e > 0) == (n > r) ? n : r;
+      }
+    }, v, r, a, b, c);
+  }
+
+  // rounds to an integer the way rm says, saturating out of range values
+  template<typename T>
+  u32 to_int(T v, u32 rm, bool is_unsigned) {
+    if (std::isnan(v)) {
+      fcsr |= FLAG_NV;
+      return is_unsigned ? ~0u : 0x7fffffff;
+    }
+    auto r = [&]{
+      switch (rm) {
+      case RM_RTZ: return std::trunc(v);
+      case RM_RDN: return std::floor(v);
+      case RM_RUP: return std::ceil(v);
+      case RM_RMM: return std::round(v);
+      default:     return std::nearbyint(v); // the host rounds to nearest even
+      }
+    }();
+    auto lo = is_unsigned ? 0.0 : -2147483648.0;
+    auto hi = is_unsigned ? 4294967295.0 : 2147483647.0;
+    if (double(r) < lo) { fcsr |= FLAG_NV; return is_unsigned ? 0 : 0x80000000; }
+    if (double(r) > hi) { fcsr |= FLAG_NV; return is_unsigned ? ~0u : 0x7fffffff; }
+    if (r != v) fcsr |= FLAG_NX;
+    return is_unsigned ? u32(r) : u32(i32(r));
+  }
+
+  template<typename T>
+  static u32 classify(T v) {
+    auto negative = std::signbit(v);
+    switch (std::fpclassify(v)) {
+    case FP_INFINITE:  return negative ? 1 << 0 : 1 << 7;
+    case FP_NORMAL:    return negative ? 1 << 1 : 1 << 6;
+    case FP_SUBNORMAL: return negative ? 1 << 2 : 1 << 5;
+    case FP_ZERO:      return negative ? 1 << 3 : 1 << 4;
+    default:           return is_snan(v) ? 1 << 8 : 1 << 9;
+    }
+  }
+
+  // op is the single precision instruction, T the format
+  template<typename T>
+  void exec_as(const Decoded& d, u32 op) {
+    using U = std::conditional_t<sizeof(T) == 4, u32, u64>;
+    constexpr auto sign = U(1) << (8 * sizeof(T) - 1);
+
+    auto a = get<T>(d.rs1);
+    auto b = get<T>(d.rs2);
+    auto rm = rounding(d);
+    auto set_rd = [&](T v) { set(d.rd, v); };
+    auto arith = [&](auto fn, auto... args) {
+      set_rd(rm == RM_RMM ? away<T>(op, args...) : host<T>(rm, fn, args...));
+    };
+    auto fma = [&](T a, T b, T c) {
+      // RISC-V raises invalid for inf * 0 even with a quiet NaN addend
+      if ((std::isinf(a) && b == 0) || (a == 0 && std::isinf(b))) fcsr |= FLAG_NV;
+      arith([](T x, T y, T z) { return std::fma(x, y, z); }, a, b, c);
+    };
+    auto sign_inject = [&](auto fn) {
+      auto x = std::bit_cast<U>(a);
+      set_rd(std::bit_cast<T>(U((x & ~sign) | (fn(x, std::bit_cast<U>(b)) & sign))));
+    };
+    auto min_max = [&](bool is_max) {
+      if (is_snan(a) || is_snan(b)) fcsr |= FLAG_NV;
+      if (std::isnan(a) && std::isnan(b)) return set_rd(canonical(a));
+      if (std::isnan(a)) return set_rd(b);
+      if (std::isnan(b)) return set_rd(a);
+      // -0 is less than +0 here
+      auto less = a < b || (a == b && std::signbit(a) && !std::signbit(b));
+      set_rd(less != is_max ? a : b);
+    };
+    // quiet compares only complain about signaling NaNs
+    auto compare = [&](bool quiet, bool result) {
+      if (std::isnan(a) || std::isnan(b)) {
+        if (!quiet || is_snan(a) || is_snan(b)) fcsr |= FLAG_NV;
+        result = false;
+      }
+      x[d.rd] = result;
+    };
+
+    switch (op) {
+    case FMADD_S:   fma(a, b, get<T>(d.imm >> 3));   break;
+    case FMSUB_S:   fma(a, b, -get<T>(d.imm >> 3));  break;
+    case FNMSUB_S:  fma(-a, b, get<T>(d.imm >> 3));  break;
+    case FNMADD_S:  fma(-a, b, -get<T>(d.imm >> 3)); break;
+    case FADD_S:    arith([](T x, T y) { return x + y; }, a, b); break;
+    case FSUB_S:    arith([](T x, T y) { return x - y; }, a, b); break;
+    case FMUL_S:    arith([](T x, T y) { return x * y; }, a, b); break;
+    case FDIV_S:    arith([](T x, T y) { return x / y; }, a, b); break;
+    case FSQRT_S:   arith([](T x) { return std::sqrt(x); }, a);  break;
+    case FSGNJ_S:   sign_inject([](U, U y) { return y; });      break;
+    case FSGNJN_S:  sign_inject([](U, U y) { return ~y; });     break;
+    case FSGNJX_S:  sign_inject([](U x, U y) { return x ^ y; }); break;
+    case FMIN_S:    min_max(false); break;
+    case FMAX_S:    min_max(true);  break;
+    case FCVT_W_S:  x[d.rd] = to_int(a, rm, false); break;
+    case FCVT_WU_S: x[d.rd] = to_int(a, rm, true);  break;
+    case FEQ_S:     compare(true,  a == b); break;
+    case FLT_S:     compare(false, a < b);  break;
+    case FLE_S:     compare(false, a <= b); break;
+    case FCLASS_S:  x[d.rd] = classify(a); break;
+    case FCVT_S_W:  arith([](i32 v) { return T(v); }, i32(x[d.rs1])); break;
+    case FCVT_S_WU: arith([](u32 v) { return T(v); }, x[d.rs1]);      break;
+    }
+  }
+
+  // false if d is illegal: a dynamic rounding mode while frm holds a
+  // reserved one. only rounding instructions have RM_DYN in their funct3.
+  bool exec(const Decoded& d) {
+    if ((d.imm & 7) == RM_DYN && (fcsr >> 5 & 7) > RM_RMM) return false;
+    switch (d.op) {
+    case FMV_X_W:  x[d.rd] = u32(f[d.rs1]); break;
+    case FMV_W_X:  f[d.rd] = boxed | x[d.rs1]; break;
+    case FCVT_S_D: {
+      auto rm = rounding(d);
+      auto v = get<double>(d.rs1);
+      set(d.rd, rm == RM_RMM ? away<float>(FCVT_S_D, v) : host<float>(rm, [](double v) { return float(v); }, v));
+      break;
+    }
+    case FCVT_D_S: set(d.rd, host<double>(RM_RNE, [](float v) { return double(v); }, get<float>(d.rs1))); break;
+    default:
+      if (d.op < FMADD_D) exec_as<float>(d, d.op);
+      else exec_as<double>(d, d.op - (FMADD_D - FMADD_S));
+    }
+    return true;
+  }
+};
+
+#endif // #ifndef FPU_HPP
@@ -0,0 +1,243 @@
+#ifndef IR_HPP
+#define IR_HPP
+
+// the IR basic blocks pass through before translation.
+//
+// a block is the predecoded instructions plus explicit SET_PC pseudo
+// instructions, lifted the way the interpreter executes it: every
+// instruction writes its rd (x0 to the regs[32] sink) and moves pc on. the
+// passes rewrite it into cheaper but equivalent RV32IM, each on its own:
+//
+//   PASS_FORWARD  a load from the address a store of the block just wrote
+//                 takes the stored value instead (same size, no store or
+//                 value register write in between, no vector store either).
+//                 only for constant addresses (through x0, which PASS_FOLD
+//                 runs first to make) that aren't device registers
+//   PASS_FOLD     instructions whose operands are known constants become
+//                 LUI rd, value; loads and stores from a constant address go
+//                 through x0; branches and JALRs with a known outcome become
+//                 JALs, which chain like any static exit
+//   PASS_X0       drops instructions that only write x0, loads and jumps
+//                 to x0 keep their other effects
+//   PASS_PC       drops the SET_PCs, exits set pc themselves
+//
+// every instruction keeps the index of the guest instruction it came from,
+// for budget refunds and the pc of side exits (pcs, guest instructions are
+// 2 or 4 bytes). registers are written as in the guest, so the state at any
+// side exit is still precise.
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "isa.hpp"
+
+struct IR {
+  enum : u8 {
+    SET_PC = UNDEF + 1, // pc = imm
+  };
+  static constexpr u8 no_rd = 0xff; // writes no register at all
+
+  enum Pass : u8 {
+    PASS_FORWARD = 1,
+    PASS_FOLD = 2,
+    PASS_X0 = 4,
+    PASS_PC = 8,
+    PASS_NONE = 0,
+    PASS_ALL = 15,
+  };
+
+  struct Inst {
+    Decoded d;
+    u32 index; // of the guest instruction in the block
+  };
+
+  u32 pc;  // of the first instruction
+  u32 len; // guest instructions
+  std::vector<Inst> insts;
+  std::vector<u32> pcs; // per guest instruction, and the pc after the block
+
+  static auto is_branch(u8 op) { return BEQ <= op && op <= BGEU; }
+  static auto is_load(u8 op) { return (LB <= op && op <= LHU) || op == FLW || op == FLD; }
+  static auto is_store(u8 op) { return (SB <= op && op <= SW) || op == FSW || op == FSD; }
+  static auto is_jump(u8 op) { return op == JAL || op == JALR; }
+
+  // the integer register an instruction writes, or no_rd
+  static auto written(const Decoded& d) {
+    return is_branch(d.op) || is_store(d.op) || d.op == SET_PC || writes_f(d.op) || writes_v(d.op) ? no_rd : d.rd;
+  }
+
+  // len instructions of icache from halfword first on, pc is that of the first
+  IR(const std::vector<Decoded>& icache, size_t first, u32 len, u32 pc) : pc(pc), len(len), pcs{pc} {
+    for (u32 k = 0; k < len; k++) {
+      auto& d = icache[first];
+      first += d.len / 2;
+      pcs.push_back(pcs.back() + d.len);
+      insts.push_back({d, k});
+      if (!is_branch(d.op) && !is_jump(d.op)) insts.push_back({{.op = SET_PC, .rd = 0, .rs1 = 0, .rs2 = 0, .imm = i32(pcs.back())}, k});
+    }
+  }
+
+  // plain(addr, n): [addr, addr + n) is memory, not device registers
+  void run(u8 passes, auto plain) {
+    if (passes & PASS_FOLD) fold_constants();
+    if (passes & PASS_FORWARD) forward_stores(plain);
+    if (passes & PASS_X0) drop_x0();
+    if (passes & PASS_PC) drop_pc();
+  }
+
+  void forward_stores(auto plain) {
+    auto out = std::vector<Inst>();
+    for (auto& inst : insts) {
+      if (!is_load(inst.d.op) || !forward(inst, out, plain)) out.push_back(inst);
+    }
+    insts = std::move(out);
+  }
+
+  // appends the value of the last store in out as load's result, if that
+  // store wrote the same constant memory address with the same size and its
+  // value register didn't change since. a device register needn't read back
+  // what was written to it.
+  bool forward(const Inst& load, std::vector<Inst>& out, auto plain) {
+    auto k = out.size();
+    while (k && !is_store(out[k - 1].d.op) && !is_vstore(out[k - 1].d.op)) k--;
+    if (!k || is_vstore(out[k - 1].d.op)) return false;
+    auto store = out[k - 1].d;
+    if (store.rs1 || load.d.rs1 || store.imm != load.d.imm) return false;
+    if (!plain(u32(store.imm), store.op == SW ? 4 : store.op == SH ? 2 : 1)) return false;
+    for (auto i = k; i < out.size(); i++) {
+      if (written(out[i].d) == store.rs2) return false;
+    }
+
+    auto rd = load.d.rd;
+    auto v = store.rs2;
+    auto op = [&](u8 op, u8 rs1, i32 imm) {
+      out.push_back({{.op = op, .rd = rd, .rs1 = rs1, .rs2 = 0, .imm = imm}, load.index});
+    };
+    switch (store.op << 8 | load.d.op) {
+    case SW << 8 | LW:  op(ADDI, v, 0); break;
+    case SH << 8 | LHU: op(SLLI, v, 16); op(SRLI, rd, 16); break;
+    case SH << 8 | LH:  op(SLLI, v, 16); op(SRAI, rd, 16); break;
+    case SB << 8 | LBU: op(ANDI, v, 0xff); break;
+    case SB << 8 | LB:  op(SLLI, v, 24); op(SRAI, rd, 24); break;
+    default: return false;
+    }
+    return true;
+  }
+
+  void fold_constants() {
+    auto known = std::array<bool, 33>{true}; // x0
+    auto value = std::array<u32, 33>{0};
+
+    for (auto& [d, index] : insts) {
+      auto ipc = pcs[index];
+      auto a = value[d.rs1];
+      auto b = value[d.rs2];
+      auto imm = u32(d.imm);
+      auto both = known[d.rs1] && known[d.rs2];
+
+      auto result = [&]() -> std::optional<u32> {
+        if (d.op == LUI) return imm;
+        if (d.op == AUIPC) return ipc + imm;
+        if (!known[d.rs1]) return std::nullopt;
+        switch (d.op) {
+        case ADDI:  return a + imm;
+        case SLTI:  return i32(a) < i32(imm);
+        case SLTIU: return a < imm;
+        case XORI:  return a ^ imm;
+        case ORI:   return a | imm;
+        case ANDI:  return a & imm;
+        case SLLI:  return a << (imm & 0x1f);
+        case SRLI:  return a >> (imm & 0x1f);
+        case SRAI:  return u32(i32(a) >> (imm & 0x1f));
+        case RORI:  return bitmanip(d.op, a, imm);
+        }
+        if (is_unary(d.op)) return bitmanip(d.op, a, 0);
+        if (!both) return std::nullopt;
+        switch (d.op) {
+        case ADD:  return a + b;
+        case SUB:  return a - b;
+        case SLL:  return a << (b & 0x1f);
+        case SLT:  return i32(a) < i32(b);
+        case SLTU: return a < b;
+        case XOR:  return a ^ b;
+        case SRL:  return a >> (b & 0x1f);
+        case SRA:  return u32(i32(a) >> (b & 0x1f));
+        case OR:   return a | b;
+        case AND:  return a & b;
+        case MUL: case MULH: case MULHSU: case MULHU:
+        case DIV: case DIVU: case REM: case REMU:
+          return muldiv(d.op, a, b);
+        case SH1ADD: case SH2ADD: case SH3ADD:
+        case ANDN: case ORN: case XNOR: case MAX: case MAXU: case MIN: case MINU: case ROL: case ROR:
+          return bitmanip(d.op, a, b);
+        }
+        return std::nullopt;
+      }();
+
+      if (result && d.rd < 32) {
+        d = {.op = LUI, .rd = d.rd, .rs1 = 0, .rs2 = 0, .len = d.len, .imm = i32(*result)};
+      } else if ((is_load(d.op) || is_store(d.op)) && known[d.rs1] && d.rs1) {
+        d.imm = i32(a + imm);
+        d.rs1 = 0;
+      } else if (is_branch(d.op) && both) {
+        auto taken = [&]{
+          switch (d.op) {
+          case BEQ:  return a == b;
+          case BNE:  return a != b;
+          case BLT:  return i32(a) < i32(b);
+          case BGE:  return i32(a) >= i32(b);
+          case BLTU: return a < b;
+          default:   return a >= b;
+          }
+        }();
+        d = {.op = JAL, .rd = no_rd, .rs1 = 0, .rs2 = 0, .len = d.len, .imm = taken ? d.imm : d.len};
+      } else if (d.op == JALR && known[d.rs1]) {
+        d = {.op = JAL, .rd = d.rd, .rs1 = 0, .rs2 = 0, .len = d.len, .imm = i32(((a + imm) & ~1u) - ipc)};
+      }
+
+      auto w = written(d);
+      if (w != no_rd && w < 32) {
+        known[w] = d.op == LUI;
+        value[w] = d.imm;
+      }
+    }
+  }
+
+  void drop_x0() {
+    auto out = std::vector<Inst>();
+    for (auto& inst : insts) {
+      // F and D ones still raise their flags, V ones set vl
+      if (inst.d.rd == 32 && written(inst.d) == 32 && !is_fp(inst.d.op) && !is_vector(inst.d.op)) {
+        if (!is_load(inst.d.op) && !is_jump(inst.d.op)) continue;
+        inst.d.rd = no_rd;
+      }
+      out.push_back(inst);
+    }
+    insts = std::move(out);
+  }
+
+  void drop_pc() {
+    std::erase_if(insts, [](auto& inst) { return inst.d.op == SET_PC; });
+  }
+
+  // "all", "none" or a comma separated list of forward, fold, x0 and pc
+  static u8 parse_passes(const std::string& list) {
+    if (list == "all") return PASS_ALL;
+    if (list == "none") return PASS_NONE;
+    auto passes = u8(0);
+    for (size_t start = 0; start <= list.size(); ) {
+      auto end = std::min(list.find(',', start), list.size());
+      auto name = list.substr(start, end - start);
+      if      (name == "forward") passes |= PASS_FORWARD;
+      else if (name == "fold")    passes |= PASS_FOLD;
+      else if (name == "x0")      passes |= PASS_X0;
+      else if (name == "pc")      passes |= PASS_PC;
+      else die("unknown pass ", name);
+      start = end + 1;
+    }
+    return passes;
+  }
+};
+
+#endif // #ifndef IR_HPP
@@ -0,0 +1,1313 @@
+#ifndef ISA_HPP
+#define ISA_HPP
+
+#include <cstdint>
+#include <array>
+#include <bit>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <stdexcept>
+
+using u64 = uint64_t;
+using i64 = int64_t;
+using i32 = int32_t;
+using i16 = int16_t;
+using i8  = int8_t;
+using u32 = uint32_t;
+using u16 = uint16_t;
+using u8  = uint8_t;
+
+auto log(const auto&... args) {
+  (std::cerr << ... << args) << '\n';
+}
+
+auto put(const auto&... args) {
+  (void)(std::cout << ... << args);
+}
+
+auto print(const auto&... args) {
+  put(args..., '\n');
+}
+
+auto str(const auto&... args) {
+  return (std::stringstream() << ... << args).str();
+}
+
+auto byte_to_hex(auto x) {
+  return str(std::hex, std::setw(2), std::setfill('0'), u32(x));
+}
+
+auto to_hex(u32 x) {
+  auto byte_0 = byte_to_hex(x & 0xff);
+  auto byte_1 = byte_to_hex((x >>= 8) & 0xff);
+  auto byte_2 = byte_to_hex((x >>= 8) & 0xff);
+  auto byte_3 = byte_to_hex((x >>= 8) & 0xff);
+  auto delim = '_';
+  return str("0x", byte_3, delim, byte_2, delim, byte_1, delim, byte_0);
+}
+
+// run by die() first, e.g. to get buffered guest output out
+inline void (*before_die)() = nullptr;
+
+auto die(const auto&... args) {
+  if (before_die) before_die();
+  std::cout << std::flush;
+  (std::cerr << ... << args) << '\n' << std::flush;
+  std::exit(EXIT_FAILURE);
+}
+
+// an error of the guest program (bad memory access, bad fetch). the CPU
+// stops, the host process doesn't have to.
+struct Fault : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+auto fault(const auto&... args) {
+  throw Fault(str(args...));
+}
+
+enum Instruction : size_t {
+  LUI, AUIPC,
+  JAL, JALR, BEQ, BNE, BLT, BGE, BLTU, BGEU,
+  LB, LH, LW, LBU, LHU, SB, SH, SW,
+  ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI,
+  ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND,
+  MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU,
+  SH1ADD, SH2ADD, SH3ADD,
+  // Zbb, the unary ones last, see is_unary
+  ANDN, ORN, XNOR, MAX, MAXU, MIN, MINU, ROL, ROR, RORI,
+  CLZ, CTZ, CPOP, SEXT_B, SEXT_H, ZEXT_H, ORC_B, REV8,
+  FLW, FSW, FLD, FSD,
+  // the same 22 for S and D first, see FPU::exec
+  FMADD_S, FMSUB_S, FNMSUB_S, FNMADD_S, FADD_S, FSUB_S, FMUL_S, FDIV_S, FSQRT_S,
+  FSGNJ_S, FSGNJN_S, FSGNJX_S, FMIN_S, FMAX_S, FCVT_W_S, FCVT_WU_S,
+  FEQ_S, FLT_S, FLE_S, FCLASS_S, FCVT_S_W, FCVT_S_WU, FMV_X_W, FMV_W_X,
+  FMADD_D, FMSUB_D, FNMSUB_D, FNMADD_D, FADD_D, FSUB_D, FMUL_D, FDIV_D, FSQRT_D,
+  FSGNJ_D, FSGNJN_D, FSGNJX_D, FMIN_D, FMAX_D, FCVT_W_D, FCVT_WU_D,
+  FEQ_D, FLT_D, FLE_D, FCLASS_D, FCVT_D_W, FCVT_D_WU, FCVT_S_D, FCVT_D_S,
+  // V, the loads and stores first (see is_vmem), the VPU runs the rest
+  VSETVLI, VSETIVLI, VSETVL,
+  VLE, VLSE, VLEFF, VLM, VSE, VSSE, VSM,
+  VADD, VSUB, VRSUB, VMINU, VMIN, VMAXU, VMAX, VAND, VOR, VXOR,
+  VSLL, VSRL, VSRA, VMUL, VMACC, VMERGE,
+  VMSEQ, VMSNE, VMSLTU, VMSLT, VMSLEU, VMSLE, VMSGTU, VMSGT,
+  // in funct6 order, the reductions and the mask logicals
+  VREDSUM, VREDAND, VREDOR, VREDXOR, VREDMINU, VREDMIN, VREDMAXU, VREDMAX,
+  VMANDN, VMAND, VMOR, VMXOR, VMORN, VMNAND, VMNOR, VMXNOR,
+  VMV_X_S, VMV_S_X, VCPOP_M, VFIRST_M, VID_V,
+  // Zicsr, see is_csr
+  CSRRW, CSRRS, CSRRC, CSRRWI, CSRRSI, CSRRCI,
+  EBREAK, UNDEF
+};
+
+enum OPCODE : u32 {
+  OPCODE_LUI         = 0x37,
+  OPCODE_AUIPC       = 0x17,
+  OPCODE_JAL         = 0x6f,
+  OPCODE_JALR        = 0x67,
+  OPCODE_BRANCH      = 0x63,
+  OPCODE_LOAD        = 0x03,
+  OPCODE_STORE       = 0x23,
+  OPCODE_OP_IMM      = 0x13,
+  OPCODE_OP          = 0x33,
+  OPCODE_SYSTEM      = 0x73,
+  OPCODE_LOAD_FP     = 0x07,
+  OPCODE_STORE_FP    = 0x27,
+  OPCODE_MADD        = 0x43,
+  OPCODE_MSUB        = 0x47,
+  OPCODE_NMSUB       = 0x4b,
+  OPCODE_NMADD       = 0x4f,
+  OPCODE_OP_FP       = 0x53,
+  OPCODE_OP_V        = 0x57,
+};
+
+enum FUNCT3 : u32 {
+  FUNCT3_BEQ         = 0x0,
+  FUNCT3_BNE         = 0x1,
+  FUNCT3_BLT         = 0x4,
+  FUNCT3_BGE         = 0x5,
+  FUNCT3_BLTU        = 0x6,
+  FUNCT3_BGEU        = 0x7,
+  FUNCT3_LB          = 0x0,
+  FUNCT3_LH          = 0x1,
+  FUNCT3_LW          = 0x2,
+  FUNCT3_LBU         = 0x4,
+  FUNCT3_LHU         = 0x5,
+  FUNCT3_SB          = 0x0,
+  FUNCT3_SH          = 0x1,
+  FUNCT3_SW          = 0x2,
+  FUNCT3_ADDI        = 0x0,
+  FUNCT3_SLTI        = 0x2,
+  FUNCT3_SLTIU       = 0x3,
+  FUNCT3_XORI        = 0x4,
+  FUNCT3_ORI         = 0x6,
+  FUNCT3_ANDI        = 0x7,
+  FUNCT3_SLLI        = 0x1,
+  FUNCT3_SRAI_SRLI   = 0x5,
+  FUNCT3_SUB_ADD     = 0x0,
+  FUNCT3_SLL         = 0x1,
+  FUNCT3_SLT         = 0x2,
+  FUNCT3_SLTU        = 0x3,
+  FUNCT3_XOR         = 0x4,
+  FUNCT3_SRA_SRL     = 0x5,
+  FUNCT3_OR          = 0x6,
+  FUNCT3_AND         = 0x7,
+  FUNCT3_MUL         = 0x0,
+  FUNCT3_MULH        = 0x1,
+  FUNCT3_MULHSU      = 0x2,
+  FUNCT3_MULHU       = 0x3,
+  FUNCT3_DIV         = 0x4,
+  FUNCT3_DIVU        = 0x5,
+  FUNCT3_REM         = 0x6,
+  FUNCT3_REMU        = 0x7,
+  FUNCT3_SH1ADD      = 0x2,
+  FUNCT3_SH2ADD      = 0x4,
+  FUNCT3_SH3ADD      = 0x6,
+  FUNCT3_XNOR        = 0x4,
+  FUNCT3_ORN         = 0x6,
+  FUNCT3_ANDN        = 0x7,
+  FUNCT3_MIN         = 0x4,
+  FUNCT3_MINU        = 0x5,
+  FUNCT3_MAX         = 0x6,
+  FUNCT3_MAXU        = 0x7,
+  FUNCT3_ZEXT_H      = 0x4,
+  FUNCT3_ROL         = 0x1,
+  FUNCT3_ROR         = 0x5,
+  FUNCT3_FLW         = 0x2,
+  FUNCT3_FLD         = 0x3,
+  FUNCT3_FSW         = 0x2,
+  FUNCT3_FSD         = 0x3,
+  FUNCT3_FSGNJ       = 0x0,
+  FUNCT3_FSGNJN      = 0x1,
+  FUNCT3_FSGNJX      = 0x2,
+  FUNCT3_FMIN        = 0x0,
+  FUNCT3_FMAX        = 0x1,
+  FUNCT3_FLE         = 0x0,
+  FUNCT3_FLT         = 0x1,
+  FUNCT3_FEQ         = 0x2,
+  FUNCT3_FMV_X       = 0x0,
+  FUNCT3_FCLASS      = 0x1,
+  FUNCT3_PRIV        = 0x0, // ECALL, EBREAK
+  FUNCT3_CSRRW       = 0x1,
+  FUNCT3_CSRRS       = 0x2,
+  FUNCT3_CSRRC       = 0x3,
+  FUNCT3_CSRRWI      = 0x5,
+  FUNCT3_CSRRSI      = 0x6,
+  FUNCT3_CSRRCI      = 0x7,
+  // OP-V, the operand kinds
+  FUNCT3_OPIVV       = 0x0,
+  FUNCT3_OPMVV       = 0x2,
+  FUNCT3_OPIVI       = 0x3,
+  FUNCT3_OPIVX       = 0x4,
+  FUNCT3_OPMVX       = 0x6,
+  FUNCT3_OPCFG       = 0x7,
+  // vector loads and stores, the element width
+  FUNCT3_VE8         = 0x0,
+  FUNCT3_VE16        = 0x5,
+  FUNCT3_VE32        = 0x6,
+};
+
+enum FUNCT7 : u32 {
+  FUNCT7_SRAI        = 0x20,
+  FUNCT7_SRLI        = 0,
+  FUNCT7_SUB         = 0x20,
+  FUNCT7_ADD         = 0,
+  FUNCT7_SRA         = 0x20,
+  FUNCT7_SRL         = 0,
+  FUNCT7_MULDIV      = 0x1,
+  FUNCT7_SLLI        = 0,
+  FUNCT7_SHADD       = 0x10,
+  FUNCT7_ANDN        = 0x20, // and ORN, XNOR
+  FUNCT7_MINMAX      = 0x05,
+  FUNCT7_ZEXT_H      = 0x04,
+  FUNCT7_ROTATE      = 0x30, // and RORI
+  // OP-FP, the low bit is the format (0 single, 1 double)
+  FUNCT7_FADD        = 0x00,
+  FUNCT7_FSUB        = 0x04,
+  FUNCT7_FMUL        = 0x08,
+  FUNCT7_FDIV        = 0x0c,
+  FUNCT7_FSQRT       = 0x2c,
+  FUNCT7_FSGNJ       = 0x10,
+  FUNCT7_FMINMAX     = 0x14,
+  FUNCT7_FCVT_SD     = 0x20, // between the formats
+  FUNCT7_FCVT_W      = 0x60, // to integer
+  FUNCT7_FCVT_F      = 0x68, // from integer
+  FUNCT7_FMV_X       = 0x70, // and FCLASS
+  FUNCT7_FCMP        = 0x50,
+  FUNCT7_FMV_F       = 0x78,
+};
+
+enum FUNCT6 : u32 {
+  FUNCT6_VADD        = 0x00,
+  FUNCT6_VREDSUM     = 0x00, // to VREDMAX, 0x07
+  FUNCT6_VSUB        = 0x02,
+  FUNCT6_VRSUB       = 0x03,
+  FUNCT6_VMINU       = 0x04,
+  FUNCT6_VMIN        = 0x05,
+  FUNCT6_VMAXU       = 0x06,
+  FUNCT6_VMAX        = 0x07,
+  FUNCT6_VAND        = 0x09,
+  FUNCT6_VOR         = 0x0a,
+  FUNCT6_VXOR        = 0x0b,
+  FUNCT6_VWXUNARY0   = 0x10, // vmv.x.s, vcpop.m, vfirst.m and vmv.s.x
+  FUNCT6_VMUNARY0    = 0x14, // vid.v
+  FUNCT6_VMERGE      = 0x17,
+  FUNCT6_VMANDN      = 0x18, // to VMXNOR, 0x1f
+  FUNCT6_VMSEQ       = 0x18,
+  FUNCT6_VMSNE       = 0x19,
+  FUNCT6_VMSLTU      = 0x1a,
+  FUNCT6_VMSLT       = 0x1b,
+  FUNCT6_VMSLEU      = 0x1c,
+  FUNCT6_VMSLE       = 0x1d,
+  FUNCT6_VMSGTU      = 0x1e,
+  FUNCT6_VMSGT       = 0x1f,
+  FUNCT6_VMUL        = 0x25,
+  FUNCT6_VSLL        = 0x25,
+  FUNCT6_VMACC       = 0x2d,
+  FUNCT6_VSRL        = 0x28,
+  FUNCT6_VSRA        = 0x29,
+};
+
+// vector loads and stores: the addressing (mop) and the unit stride kinds
+// (lumop and sumop, in rs2)
+enum VMOP : u32 {
+  VMOP_UNIT          = 0x0,
+  VMOP_STRIDED       = 0x2,
+  VUMOP_NORMAL       = 0x00,
+  VUMOP_MASK         = 0x0b,
+  VUMOP_FF           = 0x10,
+};
+
+// the whole I immediate of the Zbb instructions with a fixed one
+enum FUNCT12 : u32 {
+  FUNCT12_CLZ        = 0x600,
+  FUNCT12_CTZ        = 0x601,
+  FUNCT12_CPOP       = 0x602,
+  FUNCT12_SEXT_B     = 0x604,
+  FUNCT12_SEXT_H     = 0x605,
+  FUNCT12_ORC_B      = 0x287,
+  FUNCT12_REV8       = 0x698,
+};
+
+// the CSRs there are, in the I immediate of the Zicsr instructions. the
+// ones with both top bits set are read only.
+enum CSR : u32 {
+  CSR_FFLAGS         = 0x001,
+  CSR_FRM            = 0x002,
+  CSR_FCSR           = 0x003,
+  CSR_VSTART         = 0x008,
+  CSR_VXSAT          = 0x009,
+  CSR_VXRM           = 0x00a,
+  CSR_VCSR           = 0x00f,
+  CSR_CYCLE          = 0xc00,
+  CSR_TIME           = 0xc01,
+  CSR_INSTRET        = 0xc02,
+  CSR_VL             = 0xc20,
+  CSR_VTYPE          = 0xc21,
+  CSR_VLENB          = 0xc22,
+  CSR_CYCLEH         = 0xc80,
+  CSR_TIMEH          = 0xc81,
+  CSR_INSTRETH       = 0xc82,
+};
+
+// MASK_LO_HI[i] = 1 for i = LO, ..., HI else 0
+enum MASK : u32 {
+  MASK_00_06         = 0x0000007f,
+  MASK_07_11         = 0x00000f80,
+  MASK_15_19         = 0x000f8000,
+  MASK_20_24         = 0x01f00000,
+  MASK_12_14         = 0x00007000,
+  MASK_25_31         = 0xfe000000,
+  MASK_20_31         = 0xfff00000,
+  MASK_08_11         = 0x00000f00,
+  MASK_25_30         = 0x7e000000,
+  MASK_07_07         = 0x00000080,
+  MASK_31_31         = 0x80000000,
+  MASK_12_31         = 0xfffff000,
+  MASK_21_30         = 0x7fe00000,
+  MASK_20_20         = 0x00100000,
+  MASK_12_19         = 0x000ff000,
+  MASK_25_26         = 0x06000000,
+  MASK_25_25         = 0x02000000,
+  MASK_27_31         = 0xf8000000,
+  MASK_26_31         = 0xfc000000,
+  MASK_26_27         = 0x0c000000,
+  MASK_28_31         = 0xf0000000,
+  MASK_OPCODE        = MASK_00_06,
+  MASK_RD            = MASK_07_11,
+  MASK_RS1           = MASK_15_19,
+  MASK_RS2           = MASK_20_24,
+  MASK_FUNCT3        = MASK_12_14,
+  MASK_FUNCT7        = MASK_25_31,
+  MASK_FMT           = MASK_25_26, // R4 format
+  MASK_RS3           = MASK_27_31,
+  MASK_VM            = MASK_25_25,
+  MASK_FUNCT6        = MASK_26_31,
+  MASK_MOP           = MASK_26_27,
+  MASK_NF_MEW        = MASK_28_31, // segments and wide elements, both unsupported
+  MASK_I_IMM_0       = MASK_20_31,
+  MASK_S_IMM_0       = MASK_07_11,
+  MASK_S_IMM_1       = MASK_25_31,
+  MASK_B_IMM_0       = MASK_08_11,
+  MASK_B_IMM_1       = MASK_25_30,
+  MASK_B_IMM_2       = MASK_07_07,
+  MASK_B_IMM_3       = MASK_31_31,
+  MASK_U_IMM_0       = MASK_12_31,
+  MASK_J_IMM_0       = MASK_21_30,
+  MASK_J_IMM_1       = MASK_20_20,
+  MASK_J_IMM_2       = MASK_12_19,
+  MASK_J_IMM_3       = MASK_31_31,
+};
+
+enum OFFSET : u32 {
+  OFFSET_OPCODE      = 0,
+  OFFSET_RD          = 7,
+  OFFSET_RS1         = 15,
+  OFFSET_RS2         = 20,
+  OFFSET_FUNCT3      = 12,
+  OFFSET_FUNCT7      = 25,
+  OFFSET_FMT         = 25,
+  OFFSET_RS3         = 27,
+  OFFSET_VM          = 25,
+  OFFSET_FUNCT6      = 26,
+  OFFSET_MOP         = 26,
+  OFFSET_NF_MEW      = 28,
+  OFFSET_I_IMM_0     = 20,
+  OFFSET_S_IMM_0     = 7,
+  OFFSET_S_IMM_1     = 25,
+  OFFSET_B_IMM_0     = 8,
+  OFFSET_B_IMM_1     = 25,
+  OFFSET_B_IMM_2     = 7,
+  OFFSET_B_IMM_3     = 31,
+  OFFSET_U_IMM_0     = 12,
+  OFFSET_J_IMM_0     = 21,
+  OFFSET_J_IMM_1     = 20,
+  OFFSET_J_IMM_2     = 12,
+  OFFSET_J_IMM_3     = 31,
+};
+
+// position of the immediate parts in their immediate
+enum POS : u32 {
+  POS_I_IMM_0        = 0,
+  POS_S_IMM_0        = 0,
+  POS_S_IMM_1        = 5,
+  POS_B_IMM_0        = 1,
+  POS_B_IMM_1        = 5,
+  POS_B_IMM_2        = 11,
+  POS_B_IMM_3        = 12,
+  POS_U_IMM_0        = 12,
+  POS_J_IMM_0        = 1,
+  POS_J_IMM_1        = 11,
+  POS_J_IMM_2        = 12,
+  POS_J_IMM_3        = 20,
+};
+
+// sign bit position for sign extension
+enum SXT_BIT : u32 {
+  SXT_BIT_I_IMM = 11,
+  SXT_BIT_S_IMM = 11,
+  SXT_BIT_B_IMM = 12,
+  SXT_BIT_U_IMM = 31,
+  SXT_BIT_J_IMM = 20,
+};
+
+i32 sxt(i32 sxt_bit, i32 x) {
+  auto shamt = 31 - sxt_bit; // shift off superflous bits
+  return (x << shamt) >> shamt;
+}
+
+#define SLICE(M, X)        (((X) & MASK_##M) >> OFFSET_##M)
+#define PART(IMM, PART, X) (SLICE(IMM##_IMM_##PART, X) << POS_##IMM##_IMM_##PART)
+
+u32 get_opcode(u32 x) { return SLICE(OPCODE, x); }
+u32 get_funct3(u32 x) { return SLICE(FUNCT3, x); }
+u32 get_funct7(u32 x) { return SLICE(FUNCT7, x); }
+u32 get_rd    (u32 x) { return SLICE(RD, x);     }
+u32 get_rs1   (u32 x) { return SLICE(RS1, x);    }
+u32 get_rs2   (u32 x) { return SLICE(RS2, x);    }
+u32 get_rs3   (u32 x) { return SLICE(RS3, x);    }
+u32 get_fmt   (u32 x) { return SLICE(FMT, x);    }
+u32 get_funct12(u32 x) { return SLICE(I_IMM_0, x); }
+u32 get_funct6(u32 x) { return SLICE(FUNCT6, x); }
+u32 get_vm    (u32 x) { return SLICE(VM, x);     }
+u32 get_mop   (u32 x) { return SLICE(MOP, x);    }
+u32 get_nf_mew(u32 x) { return SLICE(NF_MEW, x); }
+
+i32 get_I_imm(u32 x){
+  auto imm = PART(I, 0, x);
+  return sxt(SXT_BIT_I_IMM, imm);
+}
+
+i32 get_S_imm(u32 x){
+  auto imm = PART(S, 0, x) | PART(S, 1, x);
+  return sxt(SXT_BIT_S_IMM, imm);
+}
+
+i32 get_B_imm(u32 x){
+  auto imm = PART(B, 0, x) | PART(B, 1, x) | PART(B, 2, x) | PART(B, 3, x);
+  return sxt(SXT_BIT_B_IMM, imm);
+}
+
+i32 get_U_imm(u32 x){
+  auto imm = PART(U, 0, x); 
+  return sxt(SXT_BIT_U_IMM, imm);
+}
+
+i32 get_J_imm(u32 x){
+  auto imm = PART(J, 0, x) | PART(J, 1, x) | PART(J, 2, x) | PART(J, 3, x);
+  return sxt(SXT_BIT_J_IMM, imm);
+}
+
+i32 get_imm(u32 inst) {
+  switch (get_opcode(inst)) {
+  case OPCODE_LUI:    return get_U_imm(inst);
+  case OPCODE_AUIPC:  return get_U_imm(inst);
+  case OPCODE_JAL:    return get_J_imm(inst);
+  case OPCODE_JALR:   return get_I_imm(inst);
+  case OPCODE_BRANCH: return get_B_imm(inst);
+  case OPCODE_LOAD:   return get_I_imm(inst);
+  case OPCODE_STORE:  return get_S_imm(inst);
+  case OPCODE_OP_IMM: return get_I_imm(inst);
+  case OPCODE_SYSTEM: return get_I_imm(inst);
+  case OPCODE_LOAD_FP:  return get_I_imm(inst);
+  case OPCODE_STORE_FP: return get_S_imm(inst);
+  default: die("\nError: line ", __LINE__, ": ",
+               __func__, "(", to_hex(inst), "): bad opcode");
+           return -1; // unreachable!
+  }
+}
+
+Instruction decode(u32 inst) {
+  auto decode_OPCODE_BRANCH = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_BEQ:  return BEQ;
+    case FUNCT3_BNE:  return BNE;
+    case FUNCT3_BLT:  return BLT;
+    case FUNCT3_BGE:  return BGE;
+    case FUNCT3_BLTU: return BLTU;
+    case FUNCT3_BGEU: return BGEU;
+    default:          return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_LOAD = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_LB:  return LB;
+    case FUNCT3_LH:  return LH;
+    case FUNCT3_LW:  return LW;
+    case FUNCT3_LBU: return LBU;
+    case FUNCT3_LHU: return LHU;
+    default:         return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_STORE = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_SB: return SB;
+    case FUNCT3_SH: return SH;
+    case FUNCT3_SW: return SW;
+    default:        return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_OP_IMM = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_ADDI:   return ADDI;
+    case FUNCT3_SLTI:   return SLTI;
+    case FUNCT3_SLTIU:  return SLTIU;
+    case FUNCT3_XORI:   return XORI;
+    case FUNCT3_ORI:    return ORI;
+    case FUNCT3_ANDI:   return ANDI;
+    case FUNCT3_SLLI:
+      switch (get_funct12(inst)) {
+      case FUNCT12_CLZ:    return CLZ;
+      case FUNCT12_CTZ:    return CTZ;
+      case FUNCT12_CPOP:   return CPOP;
+      case FUNCT12_SEXT_B: return SEXT_B;
+      case FUNCT12_SEXT_H: return SEXT_H;
+      default:             return get_funct7(inst) == FUNCT7_SLLI ? SLLI : UNDEF;
+      }
+    case FUNCT3_SRAI_SRLI:
+      switch (get_funct12(inst)) {
+      case FUNCT12_ORC_B: return ORC_B;
+      case FUNCT12_REV8:  return REV8;
+      }
+      switch (get_funct7(inst)) {
+      case FUNCT7_SRAI:   return SRAI;
+      case FUNCT7_SRLI:   return SRLI;
+      case FUNCT7_ROTATE: return RORI;
+      default:            return UNDEF;
+      }
+    default:            return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_OP_MULDIV = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_MUL:    return MUL;
+    case FUNCT3_MULH:   return MULH;
+    case FUNCT3_MULHSU: return MULHSU;
+    case FUNCT3_MULHU:  return MULHU;
+    case FUNCT3_DIV:    return DIV;
+    case FUNCT3_DIVU:   return DIVU;
+    case FUNCT3_REM:    return REM;
+    case FUNCT3_REMU:   return REMU;
+    default:            return UNDEF;
+    }
+  };
+
+  // the Zba and Zbb ones with a funct7 of their own
+  auto decode_OPCODE_OP_ZB = [&]{
+    auto f3 = get_funct3(inst);
+    switch (get_funct7(inst)) {
+    case FUNCT7_SHADD:
+      switch (f3) {
+      case FUNCT3_SH1ADD: return SH1ADD;
+      case FUNCT3_SH2ADD: return SH2ADD;
+      case FUNCT3_SH3ADD: return SH3ADD;
+      default:            return UNDEF;
+      }
+    case FUNCT7_MINMAX:
+      switch (f3) {
+      case FUNCT3_MIN:    return MIN;
+      case FUNCT3_MINU:   return MINU;
+      case FUNCT3_MAX:    return MAX;
+      case FUNCT3_MAXU:   return MAXU;
+      default:            return UNDEF;
+      }
+    case FUNCT7_ROTATE:
+      switch (f3) {
+      case FUNCT3_ROL:    return ROL;
+      case FUNCT3_ROR:    return ROR;
+      default:            return UNDEF;
+      }
+    case FUNCT7_ZEXT_H:
+      return f3 == FUNCT3_ZEXT_H && get_rs2(inst) == 0 ? ZEXT_H : UNDEF;
+    default:
+      return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_SYSTEM = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_PRIV:   return EBREAK; // and ECALL, both stop the CPU
+    case FUNCT3_CSRRW:  return CSRRW;
+    case FUNCT3_CSRRS:  return CSRRS;
+    case FUNCT3_CSRRC:  return CSRRC;
+    case FUNCT3_CSRRWI: return CSRRWI;
+    case FUNCT3_CSRRSI: return CSRRSI;
+    case FUNCT3_CSRRCI: return CSRRCI;
+    default:            return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_OP = [&]{
+    auto f7 = get_funct7(inst);
+    if (f7 == FUNCT7_MULDIV) return decode_OPCODE_OP_MULDIV();
+    if (f7 != FUNCT7_ADD && f7 != FUNCT7_SUB) return decode_OPCODE_OP_ZB();
+    // ANDN, ORN and XNOR share funct7 with SUB
+    auto inverted = f7 == FUNCT7_ANDN;
+    switch (get_funct3(inst)) {
+    case FUNCT3_SUB_ADD:
+      switch (get_funct7(inst)) {
+      case FUNCT7_SUB: return SUB;
+      case FUNCT7_ADD: return ADD;
+      default:         return UNDEF;
+      }
+    case FUNCT3_SLL:   return SLL;
+    case FUNCT3_SLT:   return SLT;
+    case FUNCT3_SLTU:  return SLTU;
+    case FUNCT3_XOR:   return inverted ? XNOR : XOR;
+    case FUNCT3_SRA_SRL:
+      switch (get_funct7(inst)) {
+      case FUNCT7_SRA: return SRA;
+      case FUNCT7_SRL: return SRL;
+      default:         return UNDEF;
+      }
+    case FUNCT3_OR:    return inverted ? ORN : OR;
+    case FUNCT3_AND:   return inverted ? ANDN : AND;
+    default:           return UNDEF;
+    }
+  };
+
+  // unit stride, fault-only-first, mask and strided ones of 8, 16 and 32
+  // bit elements
+  auto decode_V_memory = [&](bool store){
+    auto f3 = get_funct3(inst);
+    if (get_nf_mew(inst) || (f3 != FUNCT3_VE8 && f3 != FUNCT3_VE16 && f3 != FUNCT3_VE32)) return UNDEF;
+    if (get_mop(inst) == VMOP_STRIDED) return store ? VSSE : VLSE;
+    if (get_mop(inst) != VMOP_UNIT) return UNDEF;
+    switch (get_rs2(inst)) {
+    case VUMOP_NORMAL: return store ? VSE : VLE;
+    case VUMOP_MASK:   return f3 == FUNCT3_VE8 && get_vm(inst) ? store ? VSM : VLM : UNDEF;
+    case VUMOP_FF:     return store ? UNDEF : VLEFF;
+    default:           return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_LOAD_FP = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_FLW: return FLW;
+    case FUNCT3_FLD: return FLD;
+    default:         return decode_V_memory(false);
+    }
+  };
+
+  auto decode_OPCODE_STORE_FP = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_FSW: return FSW;
+    case FUNCT3_FSD: return FSD;
+    default:         return decode_V_memory(true);
+    }
+  };
+
+  // the integer ones, vector-vector, -scalar or -immediate
+  auto decode_OPIV = [&]{
+    auto f3 = get_funct3(inst);
+    auto vv = f3 == FUNCT3_OPIVV;
+    auto vi = f3 == FUNCT3_OPIVI;
+    switch (get_funct6(inst)) {
+    case FUNCT6_VADD:   return VADD;
+    case FUNCT6_VSUB:   return vi ? UNDEF : VSUB;
+    case FUNCT6_VRSUB:  return vv ? UNDEF : VRSUB;
+    case FUNCT6_VMINU:  return vi ? UNDEF : VMINU;
+    case FUNCT6_VMIN:   return vi ? UNDEF : VMIN;
+    case FUNCT6_VMAXU:  return vi ? UNDEF : VMAXU;
+    case FUNCT6_VMAX:   return vi ? UNDEF : VMAX;
+    case FUNCT6_VAND:   return VAND;
+    case FUNCT6_VOR:    return VOR;
+    case FUNCT6_VXOR:   return VXOR;
+    // vmv.v.* is the unmasked vmerge, from v0
+    case FUNCT6_VMERGE: return get_vm(inst) && get_rs2(inst) ? UNDEF : VMERGE;
+    case FUNCT6_VMSEQ:  return VMSEQ;
+    case FUNCT6_VMSNE:  return VMSNE;
+    case FUNCT6_VMSLTU: return vi ? UNDEF : VMSLTU;
+    case FUNCT6_VMSLT:  return vi ? UNDEF : VMSLT;
+    case FUNCT6_VMSLEU: return VMSLEU;
+    case FUNCT6_VMSLE:  return VMSLE;
+    case FUNCT6_VMSGTU: return vv ? UNDEF : VMSGTU;
+    case FUNCT6_VMSGT:  return vv ? UNDEF : VMSGT;
+    case FUNCT6_VSLL:   return VSLL;
+    case FUNCT6_VSRL:   return VSRL;
+    case FUNCT6_VSRA:   return VSRA;
+    default:            return UNDEF;
+    }
+  };
+
+  // the vector-vector and vector-scalar ones of OPMVV and OPMVX
+  auto decode_OPMV = [&]{
+    auto f6 = get_funct6(inst);
+    auto vv = get_funct3(inst) == FUNCT3_OPMVV;
+    auto vm = get_vm(inst);
+    if (f6 <= FUNCT6_VREDSUM + 7) return vv ? Instruction(VREDSUM + f6 - FUNCT6_VREDSUM) : UNDEF;
+    if (f6 >= FUNCT6_VMANDN && f6 <= FUNCT6_VMANDN + 7) {
+      return vv && vm ? Instruction(VMANDN + f6 - FUNCT6_VMANDN) : UNDEF;
+    }
+    switch (f6) {
+    case FUNCT6_VWXUNARY0:
+      if (!vv) return vm && !get_rs2(inst) ? VMV_S_X : UNDEF;
+      switch (get_rs1(inst)) {
+      case 0x00: return vm ? VMV_X_S : UNDEF;
+      case 0x10: return VCPOP_M;
+      case 0x11: return VFIRST_M;
+      default:   return UNDEF;
+      }
+    case FUNCT6_VMUNARY0:
+      return vv && get_rs1(inst) == 0x11 && !get_rs2(inst) ? VID_V : UNDEF;
+    case FUNCT6_VMUL:  return VMUL;
+    case FUNCT6_VMACC: return VMACC;
+    default:           return UNDEF;
+    }
+  };
+
+  auto decode_OPCODE_OP_V = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_OPIVV: case FUNCT3_OPIVX: case FUNCT3_OPIVI:
+      return decode_OPIV();
+    case FUNCT3_OPMVV: case FUNCT3_OPMVX:
+      return decode_OPMV();
+    case FUNCT3_OPCFG:
+      if (!(inst >> 31)) return VSETVLI;
+      if (inst >> 30 == 3) return VSETIVLI;
+      return get_funct7(inst) == 0x40 ? VSETVL : UNDEF;
+    default:
+      return UNDEF;
+    }
+  };
+
+  // rounding modes 5 and 6 are reserved, 7 is frm
+  auto valid_rm = [&]{ return get_funct3(inst) != 5 && get_funct3(inst) != 6; };
+
+  // op is the single precision instruction, the double one is 24 further
+  auto fmt = [&](Instruction op, u32 fmt){
+    if (fmt > 1) return UNDEF;
+    return Instruction(op + fmt * (FMADD_D - FMADD_S));
+  };
+
+  auto decode_R4 = [&](Instruction op){
+    return valid_rm() ? fmt(op, get_fmt(inst)) : UNDEF;
+  };
+
+  auto decode_OPCODE_OP_FP = [&]{
+    auto f7 = get_funct7(inst);
+    auto f3 = get_funct3(inst);
+    auto rs2 = get_rs2(inst);
+    auto single = !(f7 & 1);
+    auto rounded = [&](Instruction op){ return valid_rm() ? fmt(op, f7 & 1) : UNDEF; };
+    switch (f7 & ~1u) {
+    case FUNCT7_FADD:  return rounded(FADD_S);
+    case FUNCT7_FSUB:  return rounded(FSUB_S);
+    case FUNCT7_FMUL:  return rounded(FMUL_S);
+    case FUNCT7_FDIV:  return rounded(FDIV_S);
+    case FUNCT7_FSQRT: return rs2 == 0 ? rounded(FSQRT_S) : UNDEF;
+    case FUNCT7_FSGNJ:
+      switch (f3) {
+      case FUNCT3_FSGNJ:  return fmt(FSGNJ_S, f7 & 1);
+      case FUNCT3_FSGNJN: return fmt(FSGNJN_S, f7 & 1);
+      case FUNCT3_FSGNJX: return fmt(FSGNJX_S, f7 & 1);
+      default:            return UNDEF;
+      }
+    case FUNCT7_FMINMAX:
+      switch (f3) {
+      case FUNCT3_FMIN: return fmt(FMIN_S, f7 & 1);
+      case FUNCT3_FMAX: return fmt(FMAX_S, f7 & 1);
+      default:          return UNDEF;
+      }
+    case FUNCT7_FCVT_SD:
+      if (!valid_rm()) return UNDEF;
+      if (single && rs2 == 1) return FCVT_S_D;
+      if (!single && rs2 == 0) return FCVT_D_S;
+      return UNDEF;
+    case FUNCT7_FCVT_W:
+      return rs2 == 0 ? rounded(FCVT_W_S) : rs2 == 1 ? rounded(FCVT_WU_S) : UNDEF;
+    case FUNCT7_FCVT_F:
+      return rs2 == 0 ? rounded(FCVT_S_W) : rs2 == 1 ? rounded(FCVT_S_WU) : UNDEF;
+    case FUNCT7_FMV_X:
+      if (rs2 != 0) return UNDEF;
+      if (f3 == FUNCT3_FCLASS) return fmt(FCLASS_S, f7 & 1);
+      return f3 == FUNCT3_FMV_X && single ? FMV_X_W : UNDEF;
+    case FUNCT7_FCMP:
+      switch (f3) {
+      case FUNCT3_FEQ: return fmt(FEQ_S, f7 & 1);
+      case FUNCT3_FLT: return fmt(FLT_S, f7 & 1);
+      case FUNCT3_FLE: return fmt(FLE_S, f7 & 1);
+      default:         return UNDEF;
+      }
+    case FUNCT7_FMV_F:
+      return rs2 == 0 && f3 == 0 && single ? FMV_W_X : UNDEF;
+    default:
+      return UNDEF;
+    }
+  };
+
+  switch (get_opcode(inst)) {
+  case OPCODE_LUI:    return LUI;
+  case OPCODE_AUIPC:  return AUIPC;
+  case OPCODE_JAL:    return JAL;
+  case OPCODE_JALR:   return JALR;
+  case OPCODE_BRANCH: return decode_OPCODE_BRANCH();
+  case OPCODE_LOAD:   return decode_OPCODE_LOAD();
+  case OPCODE_STORE:  return decode_OPCODE_STORE();
+  case OPCODE_OP_IMM: return decode_OPCODE_OP_IMM();
+  case OPCODE_OP:     return decode_OPCODE_OP();
+  case OPCODE_SYSTEM: return decode_OPCODE_SYSTEM();
+  case OPCODE_LOAD_FP:  return decode_OPCODE_LOAD_FP();
+  case OPCODE_STORE_FP: return decode_OPCODE_STORE_FP();
+  case OPCODE_MADD:     return decode_R4(FMADD_S);
+  case OPCODE_MSUB:     return decode_R4(FMSUB_S);
+  case OPCODE_NMSUB:    return decode_R4(FNMSUB_S);
+  case OPCODE_NMADD:    return decode_R4(FNMADD_S);
+  case OPCODE_OP_FP:    return decode_OPCODE_OP_FP();
+  case OPCODE_OP_V:     return decode_OPCODE_OP_V();
+  default:            return UNDEF;
+  }
+}
+
+// Zbb instructions of rs1 alone
+auto is_unary(u32 op) { return CLZ <= op && op <= REV8; }
+
+// F and D instructions that the FPU executes, all but the loads and stores
+auto is_fp(u32 op) { return FMADD_S <= op && op <= FCVT_D_S; }
+
+// Zicsr instructions, the immediate forms take rs1 as the value
+auto is_csr(u32 op) { return CSRRW <= op && op <= CSRRCI; }
+
+// F and D instructions with an integer destination
+auto fp_writes_x(u32 op) {
+  switch (op) {
+  case FCVT_W_S: case FCVT_WU_S: case FEQ_S: case FLT_S: case FLE_S: case FCLASS_S: case FMV_X_W:
+  case FCVT_W_D: case FCVT_WU_D: case FEQ_D: case FLT_D: case FLE_D: case FCLASS_D:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// F and D instructions with an integer source
+auto fp_reads_x(u32 op) {
+  return op == FCVT_S_W || op == FCVT_S_WU || op == FMV_W_X || op == FCVT_D_W || op == FCVT_D_WU;
+}
+
+// instructions whose rd is a floating point register
+auto writes_f(u32 op) {
+  return op == FLW || op == FLD || (is_fp(op) && !fp_writes_x(op));
+}
+
+// V instructions, the loads and stores and the rest
+auto is_vector(u32 op) { return VSETVLI <= op && op <= VID_V; }
+auto is_vmem(u32 op) { return VLE <= op && op <= VSM; }
+auto is_vstore(u32 op) { return VSE <= op && op <= VSM; }
+
+// V instructions with an integer destination
+auto v_writes_x(u32 op) {
+  return op == VSETVLI || op == VSETIVLI || op == VSETVL || op == VMV_X_S || op == VCPOP_M || op == VFIRST_M;
+}
+
+// instructions whose rd is a vector register (vs3 for stores)
+auto writes_v(u32 op) { return is_vector(op) && !v_writes_x(op); }
+
+// the operand kinds of the OP-V ones, in Decoded::imm
+enum VFORM : u32 { VFORM_VV, VFORM_VX, VFORM_VI };
+
+// Decoded::imm of a V instruction: vsetvli and vsetivli have their vtype,
+// loads and stores eew (in bytes) << 1 | vm, the rest simm5 << 3 | form << 1
+// | vm. vsetivli has its AVL in rs1, vlm and vsm always have eew 1, vm 1.
+i32 get_V_imm(u32 inst, u32 op) {
+  switch (op) {
+  case VSETVLI:  return i32(inst >> 20 & 0x7ff);
+  case VSETIVLI: return i32(inst >> 20 & 0x3ff);
+  case VSETVL:   return 0;
+  case VLM: case VSM: return 1 << 1 | 1;
+  }
+  if (is_vmem(op)) {
+    auto f3 = get_funct3(inst);
+    auto eew = f3 == FUNCT3_VE8 ? 1 : f3 == FUNCT3_VE16 ? 2 : 4;
+    return i32(eew << 1 | get_vm(inst));
+  }
+  auto form = [&]{
+    switch (get_funct3(inst)) {
+    case FUNCT3_OPIVX: case FUNCT3_OPMVX: return VFORM_VX;
+    case FUNCT3_OPIVI:                    return VFORM_VI;
+    default:                              return VFORM_VV;
+    }
+  }();
+  return sxt(4, get_rs1(inst)) << 3 | i32(form << 1 | get_vm(inst));
+}
+
+// RV32C: 16 bit forms of common instructions, all encodings whose low two
+// bits aren't 11. they start at any halfword, 32 bit instructions too then.
+auto is_compressed(u32 inst) { return (inst & 3) != 3; }
+
+// the 32 bit instruction the compressed one in the low half of c stands
+// for, 0 (illegal) for the reserved encodings and those of RV64 and RV128
+u32 expand(u32 c) {
+  // bits hi..lo of c, moved to at
+  auto bits = [&](u32 hi, u32 lo, u32 at = 0){ return (c >> lo & ((1u << (hi - lo + 1)) - 1)) << at; };
+  auto reg = [&](u32 lo){ return bits(lo + 4, lo); };
+  auto reg_ = [&](u32 lo){ return 8 + bits(lo + 2, lo); }; // x8 to x15
+  auto i_type = [](u32 opcode, u32 f3, u32 rd, u32 rs1, i32 imm){
+    return u32(imm) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | opcode;
+  };
+  auto s_type = [](u32 opcode, u32 f3, u32 rs1, u32 rs2, i32 imm){
+    return (u32(imm) >> 5) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (u32(imm) & 0x1f) << 7 | opcode;
+  };
+  auto r_type = [](u32 f7, u32 f3, u32 rd, u32 rs1, u32 rs2){
+    return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | OPCODE_OP;
+  };
+  auto b_type = [](u32 f3, u32 rs1, i32 imm){ // against x0
+    auto u = u32(imm);
+    return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | rs1 << 15 | f3 << 12
+         | (u >> 1 & 0xf) << 8 | (u >> 11 & 1) << 7 | OPCODE_BRANCH;
+  };
+  auto j_type = [](u32 rd, i32 imm){
+    auto u = u32(imm);
+    return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20
+         | (u >> 12 & 0xff) << 12 | rd << 7 | OPCODE_JAL;
+  };
+
+  auto imm6 = sxt(5, bits(12, 12, 5) | bits(6, 2));
+  auto shamt = bits(6, 2); // bit 12 set is RV64
+  auto word = bits(12, 10, 3) | bits(6, 6, 2) | bits(5, 5, 6);
+  auto dword = bits(12, 10, 3) | bits(6, 5, 6);
+  auto word_sp = bits(12, 12, 5) | bits(6, 4, 2) | bits(3, 2, 6);
+  auto dword_sp = bits(12, 12, 5) | bits(6, 5, 3) | bits(4, 2, 6);
+  auto jump = sxt(11, bits(12, 12, 11) | bits(11, 11, 4) | bits(10, 9, 8) | bits(8, 8, 10)
+                    | bits(7, 7, 6) | bits(6, 6, 7) | bits(5, 3, 1) | bits(2, 2, 5));
+  auto branch = sxt(8, bits(12, 12, 8) | bits(11, 10, 3) | bits(6, 5, 6) | bits(4, 3, 1) | bits(2, 2, 5));
+  auto rd = reg(7), rs2 = reg(2);
+
+  switch (bits(1, 0) << 3 | bits(15, 13)) {
+  // quadrant 0
+  case 0: {
+    auto imm = bits(12, 11, 4) | bits(10, 7, 6) | bits(6, 6, 2) | bits(5, 5, 3);
+    return imm ? i_type(OPCODE_OP_IMM, FUNCT3_ADDI, reg_(2), 2, imm) : 0; // c.addi4spn
+  }
+  case 1: return i_type(OPCODE_LOAD_FP, FUNCT3_FLD, reg_(2), reg_(7), dword);
+  case 2: return i_type(OPCODE_LOAD, FUNCT3_LW, reg_(2), reg_(7), word);
+  case 3: return i_type(OPCODE_LOAD_FP, FUNCT3_FLW, reg_(2), reg_(7), word);
+  case 5: return s_type(OPCODE_STORE_FP, FUNCT3_FSD, reg_(7), reg_(2), dword);
+  case 6: return s_type(OPCODE_STORE, FUNCT3_SW, reg_(7), reg_(2), word);
+  case 7: return s_type(OPCODE_STORE_FP, FUNCT3_FSW, reg_(7), reg_(2), word);
+  // quadrant 1
+  case 8:  return i_type(OPCODE_OP_IMM, FUNCT3_ADDI, rd, rd, imm6); // c.addi, c.nop
+  case 9:  return j_type(1, jump);                                  // c.jal
+  case 10: return i_type(OPCODE_OP_IMM, FUNCT3_ADDI, rd, 0, imm6);  // c.li
+  case 11:
+    if (rd == 2) {                                                  // c.addi16sp
+      auto imm = sxt(9, bits(12, 12, 9) | bits(6, 6, 4) | bits(5, 5, 6) | bits(4, 3, 7) | bits(2, 2, 5));
+      return imm ? i_type(OPCODE_OP_IMM, FUNCT3_ADDI, 2, 2, imm) : 0;
+    }
+    return imm6 ? u32(imm6) << 12 | rd << 7 | OPCODE_LUI : 0;
+  case 12: {
+    auto rd_ = reg_(7);
+    switch (bits(11, 10)) {
+    case 0: return bits(12, 12) ? 0 : i_type(OPCODE_OP_IMM, FUNCT3_SRAI_SRLI, rd_, rd_, shamt);
+    case 1: return bits(12, 12) ? 0 : i_type(OPCODE_OP_IMM, FUNCT3_SRAI_SRLI, rd_, rd_, FUNCT7_SRAI << 5 | shamt);
+    case 2: return i_type(OPCODE_OP_IMM, FUNCT3_ANDI, rd_, rd_, imm6);
+    }
+    if (bits(12, 12)) return 0;
+    switch (bits(6, 5)) {
+    case 0:  return r_type(FUNCT7_SUB, FUNCT3_SUB_ADD, rd_, rd_, reg_(2));
+    case 1:  return r_type(0, FUNCT3_XOR, rd_, rd_, reg_(2));
+    case 2:  return r_type(0, FUNCT3_OR, rd_, rd_, reg_(2));
+    default: return r_type(0, FUNCT3_AND, rd_, rd_, reg_(2));
+    }
+  }
+  case 13: return j_type(0, jump);                                  // c.j
+  case 14: return b_type(FUNCT3_BEQ, reg_(7), branch);
+  case 15: return b_type(FUNCT3_BNE, reg_(7), branch);
+  // quadrant 2
+  case 16: return bits(12, 12) ? 0 : i_type(OPCODE_OP_IMM, FUNCT3_SLLI, rd, rd, shamt);
+  case 17: return i_type(OPCODE_LOAD_FP, FUNCT3_FLD, rd, 2, dword_sp);
+  case 18: return rd ? i_type(OPCODE_LOAD, FUNCT3_LW, rd, 2, word_sp) : 0;
+  case 19: return i_type(OPCODE_LOAD_FP, FUNCT3_FLW, rd, 2, word_sp);
+  case 20:
+    if (!bits(12, 12)) {
+      if (rs2) return r_type(0, FUNCT3_SUB_ADD, rd, 0, rs2);        // c.mv
+      return rd ? i_type(OPCODE_JALR, 0, 0, rd, 0) : 0;             // c.jr
+    }
+    if (rs2) return r_type(0, FUNCT3_SUB_ADD, rd, rd, rs2);         // c.add
+    return rd ? i_type(OPCODE_JALR, 0, 1, rd, 0) : 0x00100073;      // c.jalr, c.ebreak
+  case 21: return s_type(OPCODE_STORE_FP, FUNCT3_FSD, 2, rs2, bits(12, 10, 3) | bits(9, 7, 6));
+  case 22: return s_type(OPCODE_STORE, FUNCT3_SW, 2, rs2, bits(12, 9, 2) | bits(8, 7, 6));
+  case 23: return s_type(OPCODE_STORE_FP, FUNCT3_FSW, 2, rs2, bits(12, 9, 2) | bits(8, 7, 6));
+  default: return 0;
+  }
+}
+
+// instruction with all fields extracted, as executed by CPU::exec
+struct Decoded {
+  u8 op;  // Instruction, indexes the executors
+  u8 rd;  // 32 (the write sink) if the instruction writes x0
+  u8 rs1;
+  u8 rs2 : 5;
+  u8 len : 3 = 4; // bytes, 2 if compressed
+  i32 imm; // sign extended, shift amount for SLLI/SRLI/SRAI
+};
+
+// inst is a compressed instruction in its low half or a 32 bit one
+Decoded predecode(u32 inst) {
+  auto len = u8(is_compressed(inst) ? 2 : 4);
+  if (len == 2) inst = expand(inst);
+  auto op = decode(inst);
+  // rd = 32 (the x0 sink) for x0 and for instructions without rd. a
+  // floating point or vector rd keeps f0 and v0.
+  auto has_rd = !(BEQ <= op && op <= BGEU) && !(SB <= op && op <= SW) && op != FSW && op != FSD
+             && op != EBREAK && op != UNDEF;
+  auto rd = has_rd ? get_rd(inst) : 0;
+  if (has_rd && !rd && !writes_f(op) && !writes_v(op)) rd = 32;
+
+  auto imm = [&]{
+    switch (op) {
+    case ADD: case SUB: case SLL: case SLT: case SLTU:
+    case XOR: case SRL: case SRA: case OR:  case AND:
+    case MUL: case MULH: case MULHSU: case MULHU:
+    case DIV: case DIVU: case REM: case REMU:
+    case SH1ADD: case SH2ADD: case SH3ADD:
+    case ANDN: case ORN: case XNOR: case MAX: case MAXU: case MIN: case MINU: case ROL: case ROR:
+    case CLZ: case CTZ: case CPOP: case SEXT_B: case SEXT_H: case ZEXT_H: case ORC_B: case REV8:
+    case EBREAK: case UNDEF: return 0;
+    case SLLI: case SRLI: case SRAI: case RORI: return get_imm(inst) & 0x1f;
+    case CSRRW: case CSRRS: case CSRRC: case CSRRWI: case CSRRSI: case CSRRCI: return get_imm(inst) & 0xfff;
+    default:
+      // rounding mode, and rs3 above it
+      if (is_fp(op)) return i32(get_funct3(inst) | get_rs3(inst) << 3);
+      if (is_vector(op)) return get_V_imm(inst, op);
+      return get_imm(inst);
+    }
+  };
+
+  return {
+    .op  = u8(op),
+    .rd  = u8(has_rd ? rd : 32),
+    .rs1 = u8(get_rs1(inst)),
+    .rs2 = u8(get_rs2(inst)),
+    .len = len,
+    .imm = imm(),
+  };
+}
+
+// mnemonics, indexed by Instruction
+const auto inst_names = std::array<std::string, UNDEF + 1> {
+  "lui", "auipc",
+  "jal", "jalr", "beq", "bne", "blt", "bge", "bltu", "bgeu",
+  "lb", "lh", "lw", "lbu", "lhu", "sb", "sh", "sw",
+  "addi", "slti", "sltiu", "xori", "ori", "andi", "slli", "srli", "srai",
+  "add", "sub", "sll", "slt", "sltu", "xor", "srl", "sra", "or", "and",
+  "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu",
+  "sh1add", "sh2add", "sh3add",
+  "andn", "orn", "xnor", "max", "maxu", "min", "minu", "rol", "ror", "rori",
+  "clz", "ctz", "cpop", "sext.b", "sext.h", "zext.h", "orc.b", "rev8",
+  "flw", "fsw", "fld", "fsd",
+  "fmadd.s", "fmsub.s", "fnmsub.s", "fnmadd.s", "fadd.s", "fsub.s", "fmul.s", "fdiv.s", "fsqrt.s",
+  "fsgnj.s", "fsgnjn.s", "fsgnjx.s", "fmin.s", "fmax.s", "fcvt.w.s", "fcvt.wu.s",
+  "feq.s", "flt.s", "fle.s", "fclass.s", "fcvt.s.w", "fcvt.s.wu", "fmv.x.w", "fmv.w.x",
+  "fmadd.d", "fmsub.d", "fnmsub.d", "fnmadd.d", "fadd.d", "fsub.d", "fmul.d", "fdiv.d", "fsqrt.d",
+  "fsgnj.d", "fsgnjn.d", "fsgnjx.d", "fmin.d", "fmax.d", "fcvt.w.d", "fcvt.wu.d",
+  "feq.d", "flt.d", "fle.d", "fclass.d", "fcvt.d.w", "fcvt.d.wu", "fcvt.s.d", "fcvt.d.s",
+  "vsetvli", "vsetivli", "vsetvl",
+  "vle", "vlse", "vleff", "vlm.v", "vse", "vsse", "vsm.v",
+  "vadd", "vsub", "vrsub", "vminu", "vmin", "vmaxu", "vmax", "vand", "vor", "vxor",
+  "vsll", "vsrl", "vsra", "vmul", "vmacc", "vmerge",
+  "vmseq", "vmsne", "vmsltu", "vmslt", "vmsleu", "vmsle", "vmsgtu", "vmsgt",
+  "vredsum.vs", "vredand.vs", "vredor.vs", "vredxor.vs",
+  "vredminu.vs", "vredmin.vs", "vredmaxu.vs", "vredmax.vs",
+  "vmandn.mm", "vmand.mm", "vmor.mm", "vmxor.mm", "vmorn.mm", "vmnand.mm", "vmnor.mm", "vmxnor.mm",
+  "vmv.x.s", "vmv.s.x", "vcpop.m", "vfirst.m", "vid.v",
+  "csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci",
+  "ebreak", "undef"
+};
+
+// result of the RV32M instruction op. division doesn't trap: by zero it
+// gives all ones (quotient) or the dividend (remainder), the one signed
+// overflow, -2^31 / -1, gives the dividend and remainder 0.
+u32 muldiv(u32 op, u32 a, u32 b) {
+  auto overflow = a == 0x80000000 && b == ~0u;
+  switch (op) {
+  case MUL:    return a * b;
+  case MULH:   return u32(u64(i64(i32(a)) * i64(i32(b))) >> 32);
+  case MULHSU: return u32(u64(i64(i32(a)) * i64(b)) >> 32);
+  case MULHU:  return u32(u64(a) * u64(b) >> 32);
+  case DIV:    return !b ? ~0u : overflow ? a : u32(i32(a) / i32(b));
+  case DIVU:   return !b ? ~0u : a / b;
+  case REM:    return !b ? a : overflow ? 0 : u32(i32(a) % i32(b));
+  case REMU:   return !b ? a : a % b;
+  default:     return 0;
+  }
+}
+
+// result of the Zba or Zbb instruction op, b is rs2 or the RORI shift
+// amount. unary ones ignore b.
+u32 bitmanip(u32 op, u32 a, u32 b) {
+  switch (op) {
+  case SH1ADD: return (a << 1) + b;
+  case SH2ADD: return (a << 2) + b;
+  case SH3ADD: return (a << 3) + b;
+  case ANDN:   return a & ~b;
+  case ORN:    return a | ~b;
+  case XNOR:   return ~(a ^ b);
+  case MAX:    return i32(a) < i32(b) ? b : a;
+  case MAXU:   return a < b ? b : a;
+  case MIN:    return i32(a) < i32(b) ? a : b;
+  case MINU:   return a < b ? a : b;
+  case ROL:    return std::rotl(a, b & 0x1f);
+  case ROR:    return std::rotr(a, b & 0x1f);
+  case RORI:   return std::rotr(a, b & 0x1f);
+  case CLZ:    return std::countl_zero(a);
+  case CTZ:    return std::countr_zero(a);
+  case CPOP:   return std::popcount(a);
+  case SEXT_B: return u32(i32(i8(a)));
+  case SEXT_H: return u32(i32(i16(a)));
+  case ZEXT_H: return a & 0xffff;
+  case ORC_B: {
+    // the top bit of each nonzero byte, spread over the byte
+    auto nonzero = (((a & 0x7f7f7f7f) + 0x7f7f7f7f) | a) & 0x80808080;
+    return (nonzero >> 7) * 0xff;
+  }
+  case REV8:   return std::byteswap(a);
+  default:     return 0;
+  }
+}
+
+auto csr_name(u32 csr) {
+  switch (csr) {
+  case CSR_FFLAGS:   return str("fflags");
+  case CSR_FRM:      return str("frm");
+  case CSR_FCSR:     return str("fcsr");
+  case CSR_VSTART:   return str("vstart");
+  case CSR_VXSAT:    return str("vxsat");
+  case CSR_VXRM:     return str("vxrm");
+  case CSR_VCSR:     return str("vcsr");
+  case CSR_CYCLE:    return str("cycle");
+  case CSR_TIME:     return str("time");
+  case CSR_INSTRET:  return str("instret");
+  case CSR_VL:       return str("vl");
+  case CSR_VTYPE:    return str("vtype");
+  case CSR_VLENB:    return str("vlenb");
+  case CSR_CYCLEH:   return str("cycleh");
+  case CSR_TIMEH:    return str("timeh");
+  case CSR_INSTRETH: return str("instreth");
+  default:           return str("0x", std::hex, csr);
+  }
+}
+
+// e32,m8,ta,mu style
+auto vtype_name(u32 vtype) {
+  static const auto lmuls = std::array<std::string, 8> {"m1", "m2", "m4", "m8", "m?", "mf8", "mf4", "mf2"};
+  return str("e", 8 << (vtype >> 3 & 7), ",", lmuls[vtype & 7], vtype & 0x40 ? ",ta" : ",tu",
+             vtype & 0x80 ? ",ma" : ",mu");
+}
+
+auto disasm_V(u32 inst) {
+  auto op = decode(inst);
+  auto x = [&](u32 r){ return str(std::setw(3), std::left, str("x", r)); };
+  auto v = [&](u32 r){ return str(std::setw(3), std::left, str("v", r)); };
+  auto rd = get_rd(inst), rs1 = get_rs1(inst), rs2 = get_rs2(inst);
+  auto masked = get_vm(inst) ? "" : " v0.t";
+  auto verb = [&](const auto&... name){ return str(std::setw(10), std::left, str(name...)); };
+
+  if (is_vmem(op)) {
+    auto f3 = get_funct3(inst);
+    auto bits = f3 == FUNCT3_VE8 ? 8 : f3 == FUNCT3_VE16 ? 16 : 32;
+    auto name = op == VLE ? str("vle", bits, ".v") : op == VLSE ? str("vlse", bits, ".v")
+              : op == VLEFF ? str("vle", bits, "ff.v") : op == VSE ? str("vse", bits, ".v")
+              : op == VSSE ? str("vsse", bits, ".v") : inst_names[op];
+    auto stride = op == VLSE || op == VSSE ? str(" ", x(rs2)) : "";
+    return str(verb(name), v(rd), " (x", rs1, ")", stride, masked);
+  }
+
+  auto form = get_V_imm(inst, op) >> 1 & 3;
+  auto src = form == VFORM_VV ? v(rs1) : form == VFORM_VX ? x(rs1) : str(sxt(4, rs1));
+  auto suffix = form == VFORM_VV ? ".vv" : form == VFORM_VX ? ".vx" : ".vi";
+  switch (op) {
+  case VSETVLI:  return str(verb(inst_names[op]), x(rd), " ", x(rs1), " ", vtype_name(inst >> 20 & 0x7ff));
+  case VSETIVLI: return str(verb(inst_names[op]), x(rd), " ", rs1, " ", vtype_name(inst >> 20 & 0x3ff));
+  case VSETVL:   return str(verb(inst_names[op]), x(rd), " ", x(rs1), " ", x(rs2));
+  case VMERGE:
+    if (get_vm(inst)) return str(verb("vmv.v.", suffix + 2), v(rd), " ", src);
+    return str(verb("vmerge", suffix, "m"), v(rd), " ", v(rs2), " ", src, " v0");
+  case VMACC:    return str(verb("vmacc", suffix), v(rd), " ", src, " ", v(rs2), masked);
+  case VMV_X_S:  return str(verb(inst_names[op]), x(rd), " ", v(rs2));
+  case VMV_S_X:  return str(verb(inst_names[op]), v(rd), " ", x(rs1));
+  case VCPOP_M: case VFIRST_M:
+    return str(verb(inst_names[op]), x(rd), " ", v(rs2), masked);
+  case VID_V:    return str(verb(inst_names[op]), v(rd), masked);
+  case UNDEF:    return str(verb(inst_names[op]), to_hex(inst));
+  default:       break;
+  }
+  if (VREDSUM <= op && op <= VMXNOR) return str(verb(inst_names[op]), v(rd), " ", v(rs2), " ", v(rs1), masked);
+  return str(verb(inst_names[op], suffix), v(rd), " ", v(rs2), " ", src, masked);
+}
+
+// in the compressed syntax, operands from the expanded instruction
+auto disasm_C(u32 inst) {
+  auto x = expand(inst);
+  auto op = decode(x);
+  auto quadrant = inst & 3, f3 = inst >> 13 & 7;
+  auto reg = [](bool f, u32 r){ return str(std::setw(3), std::left, str(f ? "f" : "x", r)); };
+  auto rd = get_rd(x), rs1 = get_rs1(x), rs2 = get_rs2(x);
+  auto imm = [&]{ return get_imm(x); };
+  auto addr = [&]{ return str(imm(), "(x", rs1, ")"); };
+  auto c = [](const auto& name, const auto&... operands){
+    return str(std::setw(10), std::left, str("c.", name, " "), operands...);
+  };
+  auto sp = quadrant == 2 ? "sp" : ""; // loads and stores relative to x2
+
+  switch (op) {
+  case ADDI:
+    if (quadrant == 0) return c("addi4spn", reg(0, rd), " ", reg(0, 2), " ", imm());
+    if (f3 == 3)       return c("addi16sp", reg(0, 2), " ", imm());
+    if (f3 == 2)       return c("li", reg(0, rd), " ", imm());
+    if (x == 0x13)     return c("nop");
+    return c("addi", reg(0, rd), " ", imm());
+  case LUI:    return c("lui", reg(0, rd), " ", imm() >> OFFSET_U_IMM_0);
+  case SLLI: case SRLI: case SRAI:
+    return c(inst_names[op], reg(0, rd), " ", imm() & 0x1f);
+  case ANDI:   return c("andi", reg(0, rd), " ", imm());
+  case SUB: case XOR: case OR: case AND:
+    return c(inst_names[op], reg(0, rd), " ", reg(0, rs2));
+  case ADD:    return c(inst >> 12 & 1 ? "add" : "mv", reg(0, rd), " ", reg(0, rs2));
+  case JAL:    return c(rd ? "jal" : "j", imm());
+  case JALR:   return c(rd ? "jalr" : "jr", reg(0, rs1));
+  case BEQ:    return c("beqz", reg(0, rs1), " ", imm());
+  case BNE:    return c("bnez", reg(0, rs1), " ", imm());
+  case EBREAK: return c("ebreak");
+  case LW: case FLW: case FLD:
+    return c(str(inst_names[op], sp), reg(op != LW, rd), " ", addr());
+  case SW: case FSW: case FSD:
+    return c(str(inst_names[op], sp), reg(op != SW, rs2), " ", addr());
+  default:
+    return str(std::setw(10), std::left, inst_names[UNDEF], to_hex(inst));
+  }
+}
+
+auto disasm(auto inst) {
+  if (is_compressed(inst)) return disasm_C(inst);
+  static const auto regnames = std::array<std::string, 32> {
+    "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9",
+    "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17", "x18", "x19",
+    "x20", "x21", "x22", "x23", "x24", "x25", "x26", "x27", "x28", "x29",
+    "x30", "x31"
+  };
+
+  auto imm = [&]{ return get_imm(inst); };
+  auto uimm = [&]{ return imm() >> OFFSET_U_IMM_0; };
+  auto rd  = [&]{ return str(std::setw(3), std::left, regnames[get_rd(inst)]);  };
+  auto rs1 = [&]{ return str(std::setw(3), std::left, regnames[get_rs1(inst)]); };
+  auto rs2 = [&]{ return str(std::setw(3), std::left, regnames[get_rs2(inst)]); };
+  auto freg = [&](u32 r){ return str(std::setw(3), std::left, str("f", r)); };
+  auto frd  = [&]{ return freg(get_rd(inst));  };
+  auto frs1 = [&]{ return freg(get_rs1(inst)); };
+  auto frs2 = [&]{ return freg(get_rs2(inst)); };
+  auto frs3 = [&]{ return freg(get_rs3(inst)); };
+  auto addr = [&]{ return str(imm(), "(", regnames[get_rs1(inst)], ")"); };
+  auto verb = [&]{ return str(std::setw(10), std::left, inst_names[decode(inst)]); };
+
+  switch (get_opcode(inst)) {
+  case OPCODE_LUI:    return str(verb(), rd(),  " ", uimm());
+  case OPCODE_AUIPC:  return str(verb(), rd(),  " ", uimm());
+  case OPCODE_JAL:    return str(verb(), rd(),  " ", imm());
+  case OPCODE_JALR:   return str(verb(), rd(),  " ", rs1(), " ", imm());
+  case OPCODE_BRANCH: return str(verb(), rs1(), " ", rs2(), " ", imm());
+  case OPCODE_LOAD:   return str(verb(), rd(),  " ", addr());
+  case OPCODE_STORE:  return str(verb(), rs2(), " ", addr());
+  case OPCODE_OP_IMM:
+  case OPCODE_OP:
+    if (is_unary(decode(inst))) return str(verb(), rd(), " ", rs1());
+    if (decode(inst) == RORI) return str(verb(), rd(), " ", rs1(), " ", imm() & 0x1f);
+    if (get_opcode(inst) == OPCODE_OP_IMM) return str(verb(), rd(), " ", rs1(), " ", imm());
+    return str(verb(), rd(), " ", rs1(), " ", rs2());
+  case OPCODE_SYSTEM: {
+    auto op = decode(inst);
+    if (op == UNDEF) return str(verb(), to_hex(inst));
+    if (!is_csr(op)) return str(verb());
+    auto csr = str(std::setw(3), std::left, csr_name(imm() & 0xfff));
+    if (op >= CSRRWI) return str(verb(), rd(), " ", csr, " ", get_rs1(inst));
+    return str(verb(), rd(), " ", csr, " ", rs1());
+  }
+  case OPCODE_LOAD_FP:
+    if (is_vector(decode(inst))) return disasm_V(inst);
+    return str(verb(), frd(),  " ", addr());
+  case OPCODE_STORE_FP:
+    if (is_vector(decode(inst))) return disasm_V(inst);
+    return str(verb(), frs2(), " ", addr());
+  case OPCODE_MADD: case OPCODE_MSUB: case OPCODE_NMSUB: case OPCODE_NMADD:
+    return str(verb(), frd(), " ", frs1(), " ", frs2(), " ", frs3());
+  case OPCODE_OP_FP: {
+    auto op = decode(inst);
+    auto dst = fp_writes_x(op) ? rd() : frd();
+    auto src = fp_reads_x(op) ? rs1() : frs1();
+    auto f7 = get_funct7(inst) & ~1u;
+    auto unary = f7 == FUNCT7_FSQRT || f7 == FUNCT7_FCVT_SD || f7 == FUNCT7_FCVT_W
+              || f7 == FUNCT7_FCVT_F || f7 == FUNCT7_FMV_X || f7 == FUNCT7_FMV_F;
+    return unary ? str(verb(), dst, " ", src) : str(verb(), dst, " ", src, " ", frs2());
+  }
+  case OPCODE_OP_V:   return disasm_V(inst);
+  default:            return str(verb(), to_hex(inst));
+  }
+}
+
+#endif // #ifndef ISA_HPP
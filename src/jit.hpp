@@ -0,0 +1,861 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+// translates hot basic blocks of predecoded rv32imfdc_zba_zbb_zve32x
+// instructions into x86-64, by way of the block IR and its passes (see
+// ir.hpp). F and D loads and stores are translated, and so are add, sub,
+// mul, div and sqrt while they round to nearest even (SSE, with the host's
+// default MXCSR). the rest of F and D calls FPU::step. V loads and stores call
+// the CPU's vmem_fast, the rest of V VPU::step. all three leave for the
+// interpreter when they return false.
+// clz, ctz and cpop become lzcnt, tzcnt and popcnt where the host has them.
+//
+// translated code runs on a Context: rbx holds the guest register file,
+// r12 the context, r14 the dmem base and r15 the MMU's TLB (or its page
+// attributes in guarded mode). guest registers stay in memory, so the
+// architectural state is precise at every instruction boundary and any
+// block can hand control back to the interpreter. pc is only written on
+// exits; a load or store that faults on a guard page is found by its host
+// address in accesses, which gives its pc.
+//
+// every block starts by taking its length off ctx.budget (or exits if the
+// budget doesn't cover it). static exits (branches, JAL, fall through) start
+// with a patchable jmp that is pointed straight at the target block once the
+// target is translated. JALR goes through a per-site inline cache, the last
+// target it left for, and returns (JALR through ra/t0, not linking) first
+// check the return address stack that calls push. loads/stores that miss the
+// TLB (unmapped, misaligned, device registers) and indirect jumps that miss
+// both leave through ctx.pc.
+//
+// while profiling, JAL and JALR that call or return (see Profiler::links)
+// call Profiler::jump before they leave, so the profiler's shadow stack
+// follows translated code too. a block has the calls or it doesn't, so
+// setting or clearing profiler takes a flush().
+//
+// translated floating point arithmetic leaves its exception flags in MXCSR,
+// like the FPU's (see FPU::settle).
+//
+// all links point into the arena, flush() drops them together with the code.
+//
+// the arena is W^X: a memfd mapped twice, executable at arena and writable at
+// arena + rw, so no page is ever both. code is addressed (and jumps are
+// encoded) in the executable view, every write goes through the other one.
+
+#if defined(__x86_64__)
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "isa.hpp"
+#include "fpu.hpp"
+#include "vpu.hpp"
+#include "ir.hpp"
+#include "mmu.hpp"
+#include "profiler.hpp"
+
+struct JIT {
+  static constexpr u32 ras_size = 16; // power of two
+
+  struct Context {
+    u32* regs;
+    u8* dmem;
+    void* mmu; // MMU::tlb, or MMU::attr if guarded
+    u64 budget; // instructions left to execute
+    u32 pc;
+    u8* miss; // inline cache of the JALR that left through pc, if any
+
+    // return address stack, a ring of return pcs and the code that
+    // continues there. an entry only matches its own return pc (empty
+    // entries are odd), so overflow or longjmp just cost a miss.
+    u32 ras_top;
+    u32 ras_pc[ras_size];
+    u8* ras_code[ras_size];
+  };
+
+  // kept across runs for the return address stack
+  Context ctx = {};
+
+  struct Block {
+    u8* code; // nullptr if the first instruction can't be translated
+    u32 len;
+  };
+
+  // dmem is a guard page reservation, only pages that aren't plain RAM
+  // (see MMU::attr) need a check
+  bool guarded = false;
+
+  // IR passes for blocks translated from now on
+  u8 passes = IR::PASS_ALL;
+
+  // the data address space, set by the CPU. stores to device registers
+  // aren't forwarded to loads
+  const MMU* mmu = nullptr;
+
+  // floating point and vector registers, set by the CPU
+  FPU* fpu = nullptr;
+  VPU* vpu = nullptr;
+
+  // vector loads and stores that take the fast path, or return false
+  void* cpu = nullptr;
+  bool (*vmem)(void* cpu, Decoded d) = nullptr;
+
+  // the profiler that calls and returns report to, see the top
+  Profiler* profiler = nullptr;
+
+  // host instructions for CLZ, CTZ and CPOP
+  bool lzcnt = false;
+  bool tzcnt = false;
+  bool popcnt = false;
+
+  static constexpr u32 hot = 50;             // executions before translating
+  static constexpr u32 max_block_len = 256;  // instructions per block
+  static constexpr size_t max_block_size = 64 * 1024;
+  static constexpr size_t arena_size = 32 * 1024 * 1024;
+  size_t capacity = arena_size; // of the arena, tests lower it to flush often
+  size_t flushes = 0;
+
+  u8* arena = nullptr; // executable view
+  ptrdiff_t rw = 0;    // writable view - arena
+  u8* top = nullptr;   // first free byte
+  u8* code = nullptr;  // first byte after enter/exit
+  u8* enter = nullptr; // void enter(Context*, u8* block)
+  u8* exit = nullptr;
+
+  std::unordered_map<u32, Block> blocks;
+  std::unordered_map<u32, u32> hits;
+  // patch sites of exits to not yet translated targets
+  std::unordered_map<u32, std::vector<u8*>> pending;
+
+  // guarded: the guest pc of every load and store, by host instruction, and
+  // the instructions of its block from there on, which a fault on a guard
+  // page has to refund (see CPU::uncount)
+  struct Access { u32 pc; u32 refund; };
+  std::unordered_map<u8*, Access> accesses;
+
+  // -- x86-64 encoding ----------------------------------------------------
+
+  enum : u8 { EAX = 0, ECX = 1 };
+  enum : u8 { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7,
+              CC_L = 0xc, CC_GE = 0xd, CC_G = 0xf };
+  // /digit of the 0x81 (imm32) and 0xc1/0xd3 (shift) groups
+  enum : u8 { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6,
+              ALU_CMP = 7, SH_ROL = 0, SH_ROR = 1, SH_SHL = 4, SH_SHR = 5, SH_SAR = 7 };
+
+  // the writable view of the arena at p
+  auto writable(u8* p) { return p + rw; }
+
+  auto emit(std::initializer_list<u8> bytes) {
+    for (auto b : bytes) *writable(top++) = b;
+  }
+
+  auto emit32(u32 x) {
+    std::memcpy(writable(top), &x, 4);
+    top += 4;
+  }
+
+  auto emit64(u64 x) {
+    std::memcpy(writable(top), &x, 8);
+    top += 8;
+  }
+
+  // modrm for [rbx + 4*r], the guest register r
+  auto guest(u8 reg, u32 r) {
+    auto disp = 4 * r;
+    if (disp < 0x80) emit({u8(0x40 | reg << 3 | 3), u8(disp)});
+    else           { emit({u8(0x80 | reg << 3 | 3)}); emit32(disp); }
+  }
+
+  auto load_guest(u8 reg, u32 r)   { emit({0x8b}); guest(reg, r); }           // mov reg, [r]
+  auto store_guest(u32 r)          { emit({0x89}); guest(EAX, r); }           // mov [r], eax
+  auto store_guest_imm(u32 r, u32 x) { emit({0xc7}); guest(0, r); emit32(x); } // mov [r], x
+  auto alu_guest(u8 op, u32 r)     { emit({op}); guest(EAX, r); }             // op eax, [r]
+  auto alu_imm(u8 ext, u32 x)      { emit({0x81, u8(0xc0 | ext << 3)}); emit32(x); }
+  auto shift_imm(u8 ext, u8 x)     { emit({0xc1, u8(0xc0 | ext << 3), x}); }
+  auto shift_cl(u8 ext)            { emit({0xd3, u8(0xc0 | ext << 3)}); }
+  auto setcc(u8 cc)                { emit({0x0f, u8(0x90 | cc), 0xc0, 0x0f, 0xb6, 0xc0}); }
+
+  // jumps return the address of their rel32 for patch()
+  auto jcc(u8 cc) { emit({0x0f, u8(0x80 | cc)}); auto site = top; emit32(0); return site; }
+  auto jmp()      { emit({0xe9}); auto site = top; emit32(0); return site; }
+
+  auto patch(u8* site, u8* target) {
+    auto rel = i32(target - (site + 4));
+    std::memcpy(writable(site), &rel, 4);
+  }
+
+  // [r12 + offset] operands on the context
+  auto budget_cmp(u32 n) { emit({0x49, 0x81, 0x7c, 0x24, offsetof(Context, budget)}); emit32(n); }
+  auto budget_sub(u32 n) { emit({0x49, 0x81, 0x6c, 0x24, offsetof(Context, budget)}); emit32(n); }
+  auto budget_add(u32 n) { emit({0x49, 0x81, 0x44, 0x24, offsetof(Context, budget)}); emit32(n); }
+  auto set_pc(u32 pc)    { emit({0x41, 0xc7, 0x44, 0x24, offsetof(Context, pc)}); emit32(pc); }
+  auto set_pc_eax()      { emit({0x41, 0x89, 0x44, 0x24, offsetof(Context, pc)}); }
+
+  JIT() {
+    std::fill(std::begin(ctx.ras_pc), std::end(ctx.ras_pc), 1);
+
+    auto fd = memfd_create("rvvm-jit", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, arena_size)) die("jit: could not create code arena");
+    arena = (u8*)mmap(nullptr, arena_size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    auto view = (u8*)mmap(nullptr, arena_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (arena == MAP_FAILED || view == MAP_FAILED) die("jit: could not map code arena");
+    rw = view - arena;
+    top = arena;
+
+    __builtin_cpu_init();
+    lzcnt = __builtin_cpu_supports("lzcnt");
+    tzcnt = __builtin_cpu_supports("bmi");
+    popcnt = __builtin_cpu_supports("popcnt");
+
+    static_assert(offsetof(Context, regs) == 0);
+    static_assert(offsetof(Context, dmem) == 8);
+    static_assert(offsetof(Context, mmu) == 16);
+    static_assert(sizeof(MMU::Entry) == 16);
+    static_assert(sizeof(Decoded) == 8); // passed in rsi to FPU::step
+
+    enter = top;
+    emit({0x53, 0x41, 0x54, 0x41, 0x56, 0x41, 0x57, 0x50}); // push rbx, r12, r14, r15, rax
+    emit({0x49, 0x89, 0xfc});                               // mov r12, rdi
+    emit({0x48, 0x8b, 0x1f});                               // mov rbx, [rdi + regs]
+    emit({0x4c, 0x8b, 0x77, 0x08});                         // mov r14, [rdi + dmem]
+    emit({0x4c, 0x8b, 0x7f, 0x10});                         // mov r15, [rdi + mmu]
+    emit({0xff, 0xe6});                                     // jmp rsi
+
+    exit = top;
+    emit({0x58, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5c, 0x5b}); // pop rax, r15, r14, r12, rbx
+    emit({0xc3});                                           // ret
+
+    code = top;
+  }
+
+  JIT(const JIT&) = delete;
+  JIT& operator=(const JIT&) = delete;
+
+  ~JIT() {
+    munmap(writable(arena), arena_size);
+    munmap(arena, arena_size);
+  }
+
+  auto run(Context& ctx, u8* block) {
+    ((void (*)(Context*, u8*))enter)(&ctx, block);
+  }
+
+  // throw away all translations and every link into them. the old code
+  // becomes int3, so a link that was missed traps instead of running
+  // whatever gets translated there next
+  auto flush() {
+    std::memset(writable(code), 0xcc, top - code);
+    blocks.clear();
+    pending.clear();
+    accesses.clear();
+    std::fill(std::begin(ctx.ras_pc), std::end(ctx.ras_pc), 1);
+    ctx.miss = nullptr;
+    top = code;
+    flushes++;
+  }
+
+  // inline cache layout, site is the address of the cached pc:
+  //   cmp eax, pc; jne miss; jmp block
+  auto link(u8* site, u32 pc, u8* block) {
+    std::memcpy(writable(site), &pc, 4);
+    patch(site + 11, block);
+  }
+
+  // translated block starting at pc, translates pc once it got hot.
+  // returns nullptr while pc is cold or if it can't be translated.
+  // if the last run left through an inline cache miss, that cache now
+  // points at the block.
+  Block* lookup(u32 pc, const std::vector<Decoded>& icache) {
+    auto miss = std::exchange(ctx.miss, nullptr);
+    auto found = [&](Block& block) -> Block* {
+      if (!block.code) return nullptr;
+      if (miss) link(miss, pc, block.code);
+      return &block;
+    };
+    if (auto it = blocks.find(pc); it != blocks.end()) return found(it->second);
+    if (++hits[pc] < hot) return nullptr;
+    if (top + max_block_size > arena + capacity) {
+      flush();
+      miss = nullptr;
+    }
+    return found(blocks[pc] = translate(pc, icache));
+  }
+
+  // -- translation --------------------------------------------------------
+
+  static auto translatable(u8 op) {
+    return !is_csr(op) && op != EBREAK && op != UNDEF;
+  }
+
+  static auto ends_block(u8 op) {
+    return op == JAL || op == JALR || (BEQ <= op && op <= BGEU);
+  }
+
+  static auto is_link(u8 r) { return r == 1 || r == 5; }
+
+  // CPOP on hosts without popcnt
+  static u32 popcount(u32 x) { return std::popcount(x); }
+
+  static void jump(Profiler* profiler, Decoded d, u32 target) { profiler->jump(d, target); }
+
+  // [r12 + disp32 + scale*rcx] operands on the return address stack
+  auto ras_top(u8 op) { emit({0x41, op, 0x8c, 0x24}); emit32(offsetof(Context, ras_top)); } // op ecx
+  auto ras_pc(std::initializer_list<u8> op, u8 reg) {
+    emit({0x41}); emit(op); emit({u8(0x80 | reg << 3 | 4), 0x8c}); emit32(offsetof(Context, ras_pc));
+  }
+  auto ras_code(u8 op) { emit({0x49, op, 0x94, 0xcc}); emit32(offsetof(Context, ras_code)); } // op rdx
+
+  // pushes the return pc, returns the site of the continuation's address
+  // for patch()
+  auto push_return(u32 ret) {
+    ras_top(0x8b);                                          // mov ecx, [top]
+    emit({0x83, 0xc1, 0x01});                               // add ecx, 1
+    emit({0x83, 0xe1, ras_size - 1});                       // and ecx, ras_size - 1
+    ras_top(0x89);                                          // mov [top], ecx
+    ras_pc({0xc7}, 0); emit32(ret);                         // mov [pcs + 4*rcx], ret
+    emit({0x48, 0x8d, 0x15}); auto site = top; emit32(0);   // lea rdx, [continuation]
+    ras_code(0x89);                                         // mov [codes + 8*rcx], rdx
+    return site;
+  }
+
+  // jumps to the continuation if eax is the return pc on top of the stack
+  auto predict_return() {
+    ras_top(0x8b);                                          // mov ecx, [top]
+    ras_pc({0x3b}, EAX);                                    // cmp eax, [pcs + 4*rcx]
+    auto miss = jcc(CC_NE);
+    ras_code(0x8b);                                         // mov rdx, [codes + 8*rcx]
+    emit({0x83, 0xe9, 0x01});                               // sub ecx, 1
+    emit({0x83, 0xe1, ras_size - 1});                       // and ecx, ras_size - 1
+    ras_top(0x89);                                          // mov [top], ecx
+    emit({0xff, 0xe2});                                     // jmp rdx
+    patch(miss, top);
+  }
+
+  // leave for the pc in eax through an inline cache, see link()
+  auto exit_indirect() {
+    emit({0x3d}); auto site = top; emit32(1);               // cmp eax, pc (none yet)
+    auto miss = jcc(CC_NE);
+    patch(jmp(), top);
+    patch(miss, top);
+    set_pc_eax();
+    emit({0x48, 0xb8}); emit64(u64(site));                 // mov rax, site
+    emit({0x49, 0x89, 0x44, 0x24, offsetof(Context, miss)});  // mov [r12 + miss], rax
+    patch(jmp(), exit);
+  }
+
+  // leave the block towards a statically known pc, chained if possible
+  auto exit_to(u32 target) {
+    auto site = jmp();
+    patch(site, top);
+    set_pc(target);
+    patch(jmp(), exit);
+
+    if (auto it = blocks.find(target); it != blocks.end() && it->second.code) {
+      patch(site, it->second.code);
+    } else {
+      pending[target].push_back(site);
+    }
+  }
+
+  Block translate(u32 pc, const std::vector<Decoded>& icache) {
+    auto first = (pc & 0xfffff) / 2;
+
+    u32 len = 0;
+    for (auto i = first; i < icache.size() && len < max_block_len; i += icache[i].len / 2) {
+      auto op = icache[i].op;
+      if (!translatable(op)) break;
+      len++;
+      if (ends_block(op)) break;
+    }
+    if (!len) return {nullptr, 0};
+
+    auto ir = IR(icache, first, len, pc);
+    ir.run(passes, [&](u32 addr, u32 n) {
+      auto region = mmu ? mmu->find(addr, n) : nullptr;
+      return region && region->attr != ATTR_MMIO;
+    });
+
+    // out of line exits back to the interpreter, refunding the instructions
+    // of the block that didn't execute
+    struct SideExit { u8* site; u32 refund; u32 pc; };
+    auto side_exits = std::vector<SideExit>();
+
+    auto block = top;
+    budget_cmp(len);
+    side_exits.push_back({jcc(CC_B), 0, pc});
+    budget_sub(len);
+
+    auto terminated = false;
+    u8* continuation = nullptr; // of a call, where returns come back to
+    for (auto& [d, k] : ir.insts) {
+      auto ipc = ir.pcs[k];
+      auto writes_rd = d.rd != IR::no_rd;
+
+      auto address = [&]{
+        if (!d.rs1) { emit({0xb8}); emit32(d.imm); return; } // mov eax, imm
+        load_guest(EAX, d.rs1);
+        if (d.imm) alu_imm(ALU_ADD, d.imm);
+      };
+      // leaves to the interpreter unless the access can go straight to the
+      // host. guarded: checks the page attribute, the host address is
+      // r14 + rax. stores that run into the next page leave too, since that
+      // page's attribute isn't checked. otherwise looks up the TLB, the host
+      // address is rdx + rax.
+      auto translate_address = [&](u8 access, u32 size){
+        emit({0x89, 0xc2});                                   // mov edx, eax
+        emit({0xc1, 0xea, MMU::page_bits});                   // shr edx, page_bits
+        if (guarded) {
+          auto direct = access == MMU::READ ? ATTR_CLEAN : ATTR_RAM;
+          emit({0x41, 0x80, 0x3c, 0x17, direct});             // cmp byte [r15 + rdx], direct
+          side_exits.push_back({jcc(CC_A), len - k, ipc});
+          if (access == MMU::WRITE && size > 1) {
+            emit({0x89, 0xc2});                               // mov edx, eax
+            emit({0x81, 0xe2}); emit32(~MMU::page_mask);      // and edx, offset mask
+            emit({0x81, 0xfa}); emit32(~MMU::page_mask + 1 - size); // cmp edx, page size - size
+            side_exits.push_back({jcc(CC_A), len - k, ipc});
+          }
+          return;
+        }
+        static_assert(MMU::tlb_size == 256);
+        auto tlb = u32(access * sizeof(MMU::tlb[0]));
+        emit({0x0f, 0xb6, 0xd2});                             // movzx edx, dl
+        emit({0xc1, 0xe2, 0x04});                             // shl edx, 4
+        emit({0x89, 0xc1});                                   // mov ecx, eax
+        emit({0x81, 0xe1}); emit32(MMU::page_mask | (size - 1)); // and ecx, mask
+        emit({0x41, 0x3b, 0x8c, 0x17});                       // cmp ecx, [r15 + rdx + tag]
+        emit32(tlb + offsetof(MMU::Entry, tag));
+        side_exits.push_back({jcc(CC_NE), len - k, ipc});
+        emit({0x49, 0x8b, 0x94, 0x17});                       // mov rdx, [r15 + rdx + addend]
+        emit32(tlb + offsetof(MMU::Entry, addend));
+      };
+      // op reg, [host address]
+      auto access = [&](std::initializer_list<u8> op, u8 reg, u32 size = 4){
+        if (guarded) accesses[top] = {ipc, len - k};
+        if (size == 2) emit({0x66});
+        if (size == 8 || guarded) emit({u8(0x40 | (size == 8) << 3 | guarded)});
+        emit(op);
+        emit({u8(reg << 3 | 4), u8(guarded ? 0x06 : 0x02)});  // [r14 + rax] / [rdx + rax]
+      };
+      auto load = [&](std::initializer_list<u8> op){
+        address();
+        translate_address(MMU::READ, d.op == LW ? 4 : (d.op == LH || d.op == LHU) ? 2 : 1);
+        access(op, EAX);
+        if (writes_rd) store_guest(d.rd);
+      };
+      auto store = [&](std::initializer_list<u8> op, u8 size){
+        address();
+        translate_address(MMU::WRITE, size);
+        load_guest(ECX, d.rs2);
+        access(op, ECX, size);
+      };
+      auto freg = [&](u32 r){                                 // mov rcx, &f[r]
+        emit({0x48, 0xb9}); emit64(u64(&fpu->f[r]));
+      };
+      auto fload = [&](u32 size){
+        address();
+        translate_address(MMU::READ, size);
+        access({0x8b}, EAX, size);                            // mov (r)eax, [host]
+        freg(d.rd);
+        if (size == 8) emit({0x48});
+        emit({0x89, 0x01});                                   // mov [rcx], (r)eax
+        if (size == 4) { emit({0xc7, 0x41, 0x04}); emit32(~0u); } // mov dword [rcx + 4], -1
+      };
+      auto fstore = [&](u32 size){
+        address();
+        translate_address(MMU::WRITE, size);
+        freg(d.rs2);
+        if (size == 8) emit({0x48});
+        emit({0x8b, 0x09});                                   // mov (r)ecx, [rcx]
+        access({0x89}, ECX, size);
+      };
+      // fn(arg, d) for FPU::step, VPU::step and vmem. rbx, r12, r14 and r15
+      // are callee saved, and rsp is 16 byte aligned since enter. illegal
+      // instructions, and loads and stores past the fast path, return false
+      // and run again in the interpreter
+      auto call_step = [&](void* fn, void* arg){
+        auto image = u64(0);
+        std::memcpy(&image, &d, sizeof(d));
+        emit({0x48, 0xbf}); emit64(u64(arg));                 // mov rdi, arg
+        emit({0x48, 0xbe}); emit64(image);                    // mov rsi, d
+        emit({0x48, 0xb8}); emit64(u64(fn));                  // mov rax, fn
+        emit({0xff, 0xd0});                                   // call rax
+        emit({0x84, 0xc0});                                   // test al, al
+        side_exits.push_back({jcc(CC_E), len - k, ipc});
+      };
+      auto call_fpu = [&]{ call_step((void*)&FPU::step, fpu); };
+      // jump(profiler, d, target) for calls and returns as decoded, before a
+      // pass turned a JALR into a JAL. the target of a JALR is in eax, which
+      // this clobbers
+      auto call_profiler = [&]{
+        auto& original = icache[(ipc & 0xfffff) / 2];
+        if (!profiler || !Profiler::links(original)) return false;
+        if (d.op == JALR) emit({0x89, 0xc2});                 // mov edx, eax
+        else            { emit({0xba}); emit32(ipc + d.imm); } // mov edx, target
+        auto image = u64(0);
+        std::memcpy(&image, &original, sizeof(original));
+        emit({0x48, 0xbf}); emit64(u64(profiler));            // mov rdi, profiler
+        emit({0x48, 0xbe}); emit64(image);                    // mov rsi, d
+        emit({0x48, 0xb8}); emit64(u64(&jump));               // mov rax, jump
+        emit({0xff, 0xd0});                                   // call rax
+        return true;
+      };
+      // xmm <- f[r], the canonical NaN for a single that isn't NaN boxed
+      auto fp_get = [&](u8 xmm, u32 r, bool single){
+        freg(r);
+        emit({u8(single ? 0xf3 : 0xf2), 0x0f, 0x10, u8(xmm << 3 | 1)}); // movs(s|d) xmm, [rcx]
+        if (!single) return;
+        emit({0x83, 0x79, 0x04, 0xff});                       // cmp dword [rcx + 4], -1
+        emit({0x74, 0x09});                                   // je boxed
+        emit({0xb8}); emit32(FPU::nan_s);                     // mov eax, nan
+        emit({0x66, 0x0f, 0x6e, u8(0xc0 | xmm << 3)});        // movd xmm, eax
+      };
+      // add, sub, mul, div and sqrt when they round to nearest even: a
+      // static RNE, or a dynamic one while frm is RNE. NaN results become the
+      // canonical NaN.
+      auto fp_arith = [&](u8 op, bool single){
+        auto rm = u32(d.imm & 7);
+        if (rm != FPU::RM_RNE && rm != FPU::RM_DYN) return call_fpu();
+        u8* other_rm = nullptr;
+        if (rm == FPU::RM_DYN) {
+          emit({0x48, 0xb8}); emit64(u64(&fpu->fcsr));        // mov rax, &fcsr
+          emit({0xf6, 0x00, 0xe0});                           // test byte [rax], frm
+          other_rm = jcc(CC_NE);
+        }
+        auto prefix = u8(single ? 0xf3 : 0xf2);
+        fp_get(0, d.rs1, single);
+        if (op != 0x51) fp_get(1, d.rs2, single);
+        emit({prefix, 0x0f, op, u8(op == 0x51 ? 0xc0 : 0xc1)}); // op xmm0, xmm1 (sqrt xmm0, xmm0)
+        if (!single) emit({0x66});
+        emit({0x0f, 0x2e, 0xc0});                             // ucomis(s|d) xmm0, xmm0
+        emit({0x7b, u8(single ? 0x09 : 0x0f)});               // jnp done
+        if (single) {
+          emit({0xb8}); emit32(FPU::nan_s);                   // mov eax, nan
+          emit({0x66, 0x0f, 0x6e, 0xc0});                     // movd xmm0, eax
+        } else {
+          emit({0x48, 0xb8}); emit64(FPU::nan_d);             // mov rax, nan
+          emit({0x66, 0x48, 0x0f, 0x6e, 0xc0});               // movq xmm0, rax
+        }
+        freg(d.rd);
+        emit({prefix, 0x0f, 0x11, 0x01});                     // movs(s|d) [rcx], xmm0
+        if (single) { emit({0xc7, 0x41, 0x04}); emit32(~0u); } // mov dword [rcx + 4], -1
+        if (!other_rm) return;
+        auto done = jmp();
+        patch(other_rm, top);
+        call_fpu();
+        patch(done, top);
+      };
+      auto op_imm = [&](u8 ext){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        alu_imm(ext, d.imm);
+        store_guest(d.rd);
+      };
+      auto op_reg = [&](u8 op){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        alu_guest(op, d.rs2);
+        store_guest(d.rd);
+      };
+      auto set_imm = [&](u8 cc){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        alu_imm(ALU_CMP, d.imm);
+        setcc(cc);
+        store_guest(d.rd);
+      };
+      auto set_reg = [&](u8 cc){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        alu_guest(0x3b, d.rs2);
+        setcc(cc);
+        store_guest(d.rd);
+      };
+      auto shift_by_imm = [&](u8 ext){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        shift_imm(ext, d.imm);
+        store_guest(d.rd);
+      };
+      auto shift_by_reg = [&](u8 ext){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        load_guest(ECX, d.rs2);
+        shift_cl(ext);
+        store_guest(d.rd);
+      };
+      // edx:eax = eax * [rs2], 0xf7 /4 (mul) or /5 (imul)
+      auto mul_high = [&](u8 ext){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        emit({0xf7}); guest(ext, d.rs2);
+        emit({0x89, 0xd0});                                   // mov eax, edx
+        store_guest(d.rd);
+      };
+      // x86 division traps where RV32M defines a result, so divisors 0
+      // and (signed) -1 take a path of their own
+      auto divide = [&](bool is_signed, bool rem){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        load_guest(ECX, d.rs2);
+        emit({0x85, 0xc9});                                   // test ecx, ecx
+        auto by_zero = jcc(CC_E);
+        auto by_minus_one = (u8*)nullptr;
+        if (is_signed) {
+          emit({0x83, 0xf9, 0xff});                           // cmp ecx, -1
+          by_minus_one = jcc(CC_E);
+          emit({0x99, 0xf7, 0xf9});                           // cdq; idiv ecx
+        } else {
+          emit({0x31, 0xd2, 0xf7, 0xf1});                     // xor edx, edx; div ecx
+        }
+        if (rem) emit({0x89, 0xd0});                          // mov eax, edx
+        auto done = jmp();
+        patch(by_zero, top);
+        if (!rem) emit({0x83, 0xc8, 0xff});                   // or eax, -1
+        if (is_signed) {
+          auto done_zero = jmp();
+          patch(by_minus_one, top);
+          if (rem) emit({0x31, 0xc0});                        // xor eax, eax
+          else     emit({0xf7, 0xd8});                        // neg eax
+          patch(done_zero, top);
+        }
+        patch(done, top);
+        store_guest(d.rd);
+      };
+      // lea eax, [rcx + scale*rax], sib picks the scale
+      auto shift_add = [&](u8 sib){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        load_guest(ECX, d.rs2);
+        emit({0x8d, 0x04, sib});
+        store_guest(d.rd);
+      };
+      // eax = [rs1] op ~[rs2]
+      auto op_inverted = [&](u8 op){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs2);
+        emit({0xf7, 0xd0});                                   // not eax
+        alu_guest(op, d.rs1);
+        store_guest(d.rd);
+      };
+      // min/max: rs1, or rs2 if cc holds between them
+      auto select = [&](u8 cc){
+        if (!writes_rd) return;
+        load_guest(EAX, d.rs1);
+        load_guest(ECX, d.rs2);
+        emit({0x39, 0xc8});                                   // cmp eax, ecx
+        emit({0x0f, u8(0x40 | cc), 0xc1});                    // cmovcc eax, ecx
+        store_guest(d.rd);
+      };
+      // op eax, [rs1]
+      auto unary = [&](std::initializer_list<u8> op){
+        if (!writes_rd) return;
+        emit(op); guest(EAX, d.rs1);
+        store_guest(d.rd);
+      };
+      auto count_leading = [&]{
+        if (lzcnt) return unary({0xf3, 0x0f, 0xbd});          // lzcnt
+        if (!writes_rd) return;
+        emit({0xb9}); emit32(~0u);                            // mov ecx, -1
+        emit({0x0f, 0xbd}); guest(EAX, d.rs1);                // bsr eax, [rs1]
+        emit({0x0f, 0x44, 0xc1});                             // cmovz eax, ecx
+        emit({0xf7, 0xd8, 0x83, 0xc0, 0x1f});                 // neg eax; add eax, 31
+        store_guest(d.rd);
+      };
+      auto count_trailing = [&]{
+        if (tzcnt) return unary({0xf3, 0x0f, 0xbc});          // tzcnt
+        if (!writes_rd) return;
+        emit({0xb9}); emit32(32);                             // mov ecx, 32
+        emit({0x0f, 0xbc}); guest(EAX, d.rs1);                // bsf eax, [rs1]
+        emit({0x0f, 0x44, 0xc1});                             // cmovz eax, ecx
+        store_guest(d.rd);
+      };
+      auto count_ones = [&]{
+        if (popcnt) return unary({0xf3, 0x0f, 0xb8});         // popcnt
+        if (!writes_rd) return;
+        emit({0x8b}); guest(7, d.rs1);                        // mov edi, [rs1]
+        emit({0x48, 0xb8}); emit64(u64(&popcount));          // mov rax, popcount
+        emit({0xff, 0xd0});                                   // call rax
+        store_guest(d.rd);
+      };
+      auto branch = [&](u8 cc){
+        load_guest(EAX, d.rs1);
+        alu_guest(0x3b, d.rs2);                               // cmp eax, [rs2]
+        auto taken = jcc(cc);
+        exit_to(ipc + d.len);
+        patch(taken, top);
+        exit_to(ipc + d.imm);
+        terminated = true;
+      };
+
+      switch (d.op) {
+      case LUI:   if (writes_rd) store_guest_imm(d.rd, d.imm);       break;
+      case AUIPC: if (writes_rd) store_guest_imm(d.rd, ipc + d.imm); break;
+      case JAL:
+        call_profiler();
+        if (writes_rd) store_guest_imm(d.rd, ipc + d.len);
+        if (is_link(d.rd)) continuation = push_return(ipc + d.len);
+        exit_to(ipc + d.imm);
+        terminated = true;
+        break;
+      case JALR:
+        address();
+        emit({0x83, 0xe0, 0xfe});                             // and eax, ~1
+        if (call_profiler()) {
+          address();
+          emit({0x83, 0xe0, 0xfe});                           // and eax, ~1
+        }
+        if (writes_rd) store_guest_imm(d.rd, ipc + d.len);
+        if (is_link(d.rd)) continuation = push_return(ipc + d.len);
+        else if (is_link(d.rs1)) predict_return();
+        exit_indirect();
+        terminated = true;
+        break;
+      case BEQ:   branch(CC_E);  break;
+      case BNE:   branch(CC_NE); break;
+      case BLT:   branch(CC_L);  break;
+      case BGE:   branch(CC_GE); break;
+      case BLTU:  branch(CC_B);  break;
+      case BGEU:  branch(CC_AE); break;
+      case LB:    load({0x0f, 0xbe}); break;                     // movsx eax, byte
+      case LH:    load({0x0f, 0xbf}); break;                     // movsx eax, word
+      case LW:    load({0x8b});       break;                     // mov eax, dword
+      case LBU:   load({0x0f, 0xb6}); break;                     // movzx eax, byte
+      case LHU:   load({0x0f, 0xb7}); break;                     // movzx eax, word
+      case SB:    store({0x88}, 1);   break;                     // mov byte, cl
+      case SH:    store({0x89}, 2);   break;                     // mov word, cx
+      case SW:    store({0x89}, 4);   break;                     // mov dword, ecx
+      case ADDI:  op_imm(ALU_ADD);       break;
+      case SLTI:  set_imm(CC_L);         break;
+      case SLTIU: set_imm(CC_B);         break;
+      case XORI:  op_imm(ALU_XOR);       break;
+      case ORI:   op_imm(ALU_OR);        break;
+      case ANDI:  op_imm(ALU_AND);       break;
+      case SLLI:  shift_by_imm(SH_SHL);  break;
+      case SRLI:  shift_by_imm(SH_SHR);  break;
+      case SRAI:  shift_by_imm(SH_SAR);  break;
+      case ADD:   op_reg(0x03);          break;
+      case SUB:   op_reg(0x2b);          break;
+      case SLL:   shift_by_reg(SH_SHL);  break;
+      case SLT:   set_reg(CC_L);         break;
+      case SLTU:  set_reg(CC_B);         break;
+      case XOR:   op_reg(0x33);          break;
+      case SRL:   shift_by_reg(SH_SHR);  break;
+      case SRA:   shift_by_reg(SH_SAR);  break;
+      case OR:    op_reg(0x0b);          break;
+      case AND:   op_reg(0x23);          break;
+      case MUL:
+        if (!writes_rd) break;
+        load_guest(EAX, d.rs1);
+        emit({0x0f, 0xaf}); guest(EAX, d.rs2);                // imul eax, [rs2]
+        store_guest(d.rd);
+        break;
+      case MULH:  mul_high(5);           break;
+      case MULHU: mul_high(4);           break;
+      case MULHSU:
+        if (!writes_rd) break;
+        emit({0x48, 0x63}); guest(EAX, d.rs1);                // movsxd rax, [rs1]
+        load_guest(ECX, d.rs2);
+        emit({0x48, 0x0f, 0xaf, 0xc1});                       // imul rax, rcx
+        emit({0x48, 0xc1, 0xe8, 0x20});                       // shr rax, 32
+        store_guest(d.rd);
+        break;
+      case DIV:   divide(true,  false);  break;
+      case DIVU:  divide(false, false);  break;
+      case REM:   divide(true,  true);   break;
+      case REMU:  divide(false, true);   break;
+      case SH1ADD: shift_add(0x41);      break;
+      case SH2ADD: shift_add(0x81);      break;
+      case SH3ADD: shift_add(0xc1);      break;
+      case ANDN:  op_inverted(0x23);     break;
+      case ORN:   op_inverted(0x0b);     break;
+      case XNOR:
+        if (!writes_rd) break;
+        load_guest(EAX, d.rs1);
+        alu_guest(0x33, d.rs2);
+        emit({0xf7, 0xd0});                                   // not eax
+        store_guest(d.rd);
+        break;
+      case MAX:   select(CC_L);          break;
+      case MAXU:  select(CC_B);          break;
+      case MIN:   select(CC_G);          break;
+      case MINU:  select(CC_A);          break;
+      case ROL:   shift_by_reg(SH_ROL);  break;
+      case ROR:   shift_by_reg(SH_ROR);  break;
+      case RORI:  shift_by_imm(SH_ROR);  break;
+      case CLZ:   count_leading();       break;
+      case CTZ:   count_trailing();      break;
+      case CPOP:  count_ones();          break;
+      case SEXT_B: unary({0x0f, 0xbe});  break;                  // movsx eax, byte
+      case SEXT_H: unary({0x0f, 0xbf});  break;                  // movsx eax, word
+      case ZEXT_H: unary({0x0f, 0xb7});  break;                  // movzx eax, word
+      case ORC_B:
+        // 0xff for the bytes that don't compare equal to zero
+        if (!writes_rd) break;
+        emit({0x66, 0x0f, 0x6e}); guest(0, d.rs1);           // movd xmm0, [rs1]
+        emit({0x66, 0x0f, 0xef, 0xc9});                       // pxor xmm1, xmm1
+        emit({0x66, 0x0f, 0x74, 0xc1});                       // pcmpeqb xmm0, xmm1
+        emit({0x66, 0x0f, 0x7e, 0xc0});                       // movd eax, xmm0
+        emit({0xf7, 0xd0});                                   // not eax
+        store_guest(d.rd);
+        break;
+      case REV8:
+        if (!writes_rd) break;
+        load_guest(EAX, d.rs1);
+        emit({0x0f, 0xc8});                                   // bswap eax
+        store_guest(d.rd);
+        break;
+      case FLW:   fload(4);              break;
+      case FSW:   fstore(4);             break;
+      case FLD:   fload(8);              break;
+      case FSD:   fstore(8);             break;
+      case FADD_S:  fp_arith(0x58, true);  break;
+      case FSUB_S:  fp_arith(0x5c, true);  break;
+      case FMUL_S:  fp_arith(0x59, true);  break;
+      case FDIV_S:  fp_arith(0x5e, true);  break;
+      case FSQRT_S: fp_arith(0x51, true);  break;
+      case FADD_D:  fp_arith(0x58, false); break;
+      case FSUB_D:  fp_arith(0x5c, false); break;
+      case FMUL_D:  fp_arith(0x59, false); break;
+      case FDIV_D:  fp_arith(0x5e, false); break;
+      case FSQRT_D: fp_arith(0x51, false); break;
+      case IR::SET_PC: set_pc(d.imm);    break;
+      default:
+        if (is_vmem(d.op)) call_step((void*)vmem, cpu);
+        else if (is_vector(d.op)) call_step((void*)&VPU::step, vpu);
+        else call_fpu(); // the rest of F and D
+      }
+    }
+
+    // cut short by max_block_len, the end of imem or an untranslatable instruction
+    if (!terminated) exit_to(ir.pcs[len]);
+
+    if (continuation) {
+      patch(continuation, top);
+      exit_to(ir.pcs[len]);
+    }
+
+    for (auto [site, refund, exit_pc] : side_exits) {
+      patch(site, top);
+      if (refund) budget_add(refund);
+      set_pc(exit_pc);
+      patch(jmp(), exit);
+    }
+
+    if (auto it = pending.find(pc); it != pending.end()) {
+      for (auto site : it->second) patch(site, block);
+      pending.erase(it);
+    }
+
+    return {block, len};
+  }
+};
+
+#endif // #if defined(__x86_64__)
+
+#endif // #ifndef JIT_HPP
@@ -0,0 +1,201 @@
+#ifndef MMU_HPP
+#define MMU_HPP
+
+// guest data address space: a list of regions (RAM, ROM or device registers)
+// and a direct mapped software TLB in front of them.
+//
+// a TLB entry maps one guest page straight to host memory. RAM pages go into
+// the read and write TLB, ROM pages only into the read TLB and pages holding
+// device registers never, so every access that hits can go to the host
+// directly and everything else takes the slow path through the regions.
+//
+// with dirty tracking on, every RAM page written since the last reset is
+// marked in a bitmap. a page can only be written through the fast path once
+// a slow path store cached it, so the slow path does all the marking and a
+// reset simply forgets all cached write permissions.
+
+#include <cstring>
+#include <vector>
+
+#include "isa.hpp"
+
+// ATTR_CLEAN only appears in MMU::attr: RAM not written since the last
+// dirty reset, read directly but written through the slow path
+enum Attr : u8 { ATTR_RAM, ATTR_CLEAN, ATTR_NONE, ATTR_ROM, ATTR_MMIO };
+
+// memory mapped device, offsets are relative to the start of its region
+struct Device {
+  virtual ~Device() = default;
+  virtual u32 read(u32 offset, u32 size) = 0;
+  virtual void write(u32 offset, u32 x, u32 size) = 0;
+};
+
+// thrown by a store into the watched range, before it takes effect
+struct Watchpoint {
+  u32 addr;
+};
+
+struct Region {
+  u32 base;
+  u32 size;
+  Attr attr;
+  u8* host;       // RAM, ROM
+  Device* device; // MMIO
+
+  // [addr, addr + n) lies in the region
+  auto contains(u32 addr, u32 n) const {
+    return u64(addr) - base + n <= size && addr >= base;
+  }
+};
+
+struct MMU {
+  static constexpr u32 page_bits = 12;
+  static constexpr u32 page_mask = ~((1u << page_bits) - 1);
+  static constexpr u32 tlb_size = 256;
+
+  enum : u8 { READ, WRITE };
+
+  // the tag is the guest page address, host = addend + guest address.
+  // an access of n bytes hits if (addr & (page_mask | (n - 1))) == tag,
+  // so misaligned accesses always take the slow path.
+  struct Entry {
+    u32 tag = ~0u;
+    uintptr_t addend = 0;
+  };
+
+  Entry tlb[2][tlb_size];
+
+  // later regions cover earlier ones
+  std::vector<Region> regions;
+
+  // guarded mode: ATTR_RAM (or ATTR_CLEAN) for pages that live at
+  // direct + addr, so the fast path needs no TLB and out of range pages
+  // fault on their own
+  u8* direct = nullptr;
+  std::vector<u8> attr;
+
+  // one bit per guest page, empty unless dirty tracking is on
+  std::vector<u64> dirty;
+
+  // stores into [watch_base, watch_base + watch_size) throw a Watchpoint.
+  // the watched pages stay out of the write TLB, guarded mode isn't covered.
+  u32 watch_base = 0;
+  u32 watch_size = 0;
+
+  auto flush() {
+    for (auto& t : tlb) for (auto& e : t) e = Entry();
+  }
+
+  auto watch(u32 base, u32 size) {
+    watch_base = base;
+    watch_size = size;
+    flush();
+  }
+
+  // whether [addr, addr + n) overlaps the watched range
+  bool watched(u32 addr, u32 n) const {
+    return watch_size && addr <= watch_base + (watch_size - 1) && watch_base <= addr + (n - 1);
+  }
+
+  auto map(Region region) {
+    regions.push_back(region);
+    flush();
+    if (direct && !(region.attr == ATTR_RAM && region.host == direct + region.base)) {
+      for (u64 page = region.base >> page_bits;
+           page <= (u64(region.base) + region.size - 1) >> page_bits; page++) {
+        attr[page] = region.attr == ATTR_RAM ? ATTR_NONE : region.attr;
+      }
+    }
+  }
+
+  auto map_ram(u32 base, u32 size, u8* host)  { map({base, size, ATTR_RAM, host, nullptr}); }
+  auto map_rom(u32 base, u32 size, u8* host)  { map({base, size, ATTR_ROM, host, nullptr}); }
+  auto map_device(u32 base, u32 size, Device* device) {
+    map({base, size, ATTR_MMIO, nullptr, device});
+  }
+
+  // switch to guarded mode, with guest address 0 at host address base
+  auto guard(u8* base) {
+    direct = base;
+    attr.assign(size_t(1) << (32 - page_bits), ATTR_RAM);
+  }
+
+  // starts dirty tracking, or clears the dirty set
+  auto reset_dirty() {
+    dirty.assign((size_t(1) << (32 - page_bits)) / 64, 0);
+    for (auto& e : tlb[WRITE]) e = Entry();
+    for (auto& a : attr) if (a == ATTR_RAM) a = ATTR_CLEAN;
+  }
+
+  auto mark_dirty(u32 addr) {
+    if (dirty.empty()) return;
+    auto page = addr >> page_bits;
+    dirty[page / 64] |= u64(1) << (page % 64);
+    if (direct && attr[page] == ATTR_CLEAN) attr[page] = ATTR_RAM;
+  }
+
+  // f(guest page address) for every dirty page in [base, base + size)
+  auto for_each_dirty(u32 base, u64 size, auto f) const {
+    for (u64 page = base >> page_bits; page < (base + size + (1u << page_bits) - 1) >> page_bits; page++) {
+      if (dirty[page / 64] >> (page % 64) & 1) f(u32(page << page_bits));
+    }
+  }
+
+  const Region* find(u32 addr, u32 n) const {
+    for (auto r = regions.rbegin(); r != regions.rend(); r++) {
+      if (r->contains(addr, n)) return &*r;
+    }
+    return nullptr;
+  }
+
+  // host memory behind [addr, addr + n), if that is a single RAM or ROM region
+  const u8* host(u32 addr, u32 n) const {
+    auto r = find(addr, n);
+    return r && r->attr != ATTR_MMIO ? r->host + (addr - r->base) : nullptr;
+  }
+
+  // caches the page of addr unless part of it belongs to a device
+  auto fill(u8 access, u32 addr, const Region& r) {
+    auto page = addr & page_mask;
+    if (!r.contains(page, 1u << page_bits)) return;
+    auto overlaps = [&](u32 base, u32 size) {
+      return size && base <= page + ((1u << page_bits) - 1) && page <= base + (size - 1);
+    };
+    for (auto& other : regions) {
+      if (other.attr == ATTR_MMIO && overlaps(other.base, other.size)) return;
+    }
+    if (access == WRITE && overlaps(watch_base, watch_size)) return;
+    tlb[access][(addr >> page_bits) % tlb_size] = {page, uintptr_t(r.host + (page - r.base)) - page};
+  }
+
+  [[noreturn]] static void invalid(const char* what, u32 addr) {
+    fault("\nError: ", what, ": invalid memory access @", to_hex(addr), '\n');
+    __builtin_unreachable();
+  }
+
+  template<typename T>
+  T load(u32 addr) {
+    auto r = find(addr, sizeof(T));
+    if (!r) invalid("load", addr);
+    if (r->attr == ATTR_MMIO) return T(r->device->read(addr - r->base, sizeof(T)));
+    fill(READ, addr, *r);
+    auto x = T();
+    std::memcpy(&x, r->host + (addr - r->base), sizeof(T));
+    return x;
+  }
+
+  template<typename T>
+  auto store(u32 addr, T x) {
+    auto r = find(addr, sizeof(T));
+    if (!r) invalid("store", addr);
+    if (r->attr == ATTR_ROM) invalid("store to ROM", addr);
+    if (watched(addr, sizeof(T))) throw Watchpoint{addr};
+    if (r->attr == ATTR_MMIO) return r->device->write(addr - r->base, u32(x), sizeof(T));
+    mark_dirty(addr);
+    mark_dirty(addr + sizeof(T) - 1);
+    fill(WRITE, addr, *r);
+    std::memcpy(r->host + (addr - r->base), &x, sizeof(T));
+  }
+};
+
+#endif // #ifndef MMU_HPP
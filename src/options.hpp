@@ -0,0 +1,37 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+// the command line options rvvm and rvvm-batch share: the engine and the
+// CPU's Config
+
+#include <cctype>
+#include <string>
+
+#include "cpu.hpp"
+
+// 64k, 16M, 1G, ...
+size_t parse_size(std::string x) {
+  auto suffix = std::string("kmg").find(std::tolower(x.back()));
+  auto size = std::stoul(x);
+  return suffix == std::string::npos ? size : size << (10 * (suffix + 1));
+}
+
+// applies arg if it's one of the shared options, returns whether it was
+bool parse_cpu_option(const std::string& arg, CPU::Engine& engine, Config& config) {
+  if      (arg == "--engine=interp")     engine = CPU::ENGINE_INTERP;
+  else if (arg == "--engine=threaded")   engine = CPU::ENGINE_THREADED;
+  else if (arg == "--engine=jit")        engine = CPU::ENGINE_JIT;
+  else if (arg.starts_with("--ram="))    config.ram_size = parse_size(arg.substr(6));
+  else if (arg == "--huge-pages=thp")    config.huge_pages = HUGE_PAGES_THP;
+  else if (arg == "--huge-pages=hugetlb") config.huge_pages = HUGE_PAGES_HUGETLB;
+  else if (arg == "--guard-pages")       config.guard_pages = true;
+  else if (arg == "--console-thread")    config.console_thread = true;
+  else if (arg.starts_with("--jit-passes=")) config.jit_passes = IR::parse_passes(arg.substr(13));
+  else if (arg.starts_with("--vlen="))    config.vlen = std::stoul(arg.substr(7));
+  else if (arg.starts_with("--cpi="))     config.cpi = std::stod(arg.substr(6));
+  else if (arg.starts_with("--timebase=")) config.timebase = std::stoull(arg.substr(11));
+  else return false;
+  return true;
+}
+
+#endif // #ifndef OPTIONS_HPP
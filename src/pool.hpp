@@ -0,0 +1,141 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+// pre-warmed CPUs forked copy on write from a booted template.
+//
+// the template runs the program's setup once, up to a marker: an ecall, or
+// the first store into an input region. its dmem lives in a memfd, and every
+// instance maps that memfd privately, so instances share all pages with the
+// template until they write them. released instances are reset by mapping the
+// memfd over their dmem again, which keeps their JIT translations warm.
+
+#include <mutex>
+
+#include "cpu.hpp"
+
+struct Pool {
+  std::string prog_dir;
+  Config config;
+
+  // the template, stopped at the fork point
+  std::unique_ptr<CPU> base;
+
+  // the template's architectural state at the fork point, which fork() and
+  // reset() give every instance. dmem comes from the memfd instead.
+  struct State {
+    std::array<u32, 33> regs;
+    std::array<u64, 32> fregs;
+    u32 fcsr;
+    std::vector<u8> vregs;
+    u32 vl;
+    u32 vtype;
+    u32 vcsr;
+    u32 pc;
+    u64 executed;
+
+    State() = default;
+    State(const CPU& cpu)
+      : regs(cpu.regs), fregs(cpu.fpu.f), fcsr(cpu.fpu.fcsr), vregs(cpu.vpu.v), vl(cpu.vpu.vl),
+        vtype(cpu.vpu.vtype), vcsr(cpu.vpu.vcsr), pc(cpu.pc), executed(cpu.executed) {}
+  } state;
+
+  // the other half of State(const CPU&)
+  auto restore_state(CPU& cpu) const {
+    cpu.regs = state.regs;
+    cpu.fpu.f = state.fregs;
+    cpu.fpu.fcsr = state.fcsr;
+    cpu.vpu.v = state.vregs;
+    cpu.vpu.vl = state.vl;
+    cpu.vpu.vtype = state.vtype;
+    cpu.vpu.vcsr = state.vcsr;
+    cpu.pc = state.pc;
+    cpu.executed = state.executed;
+  }
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<CPU>> warm;
+
+  static constexpr size_t max_boot = 1UL << 32; // instructions
+
+  // boots the template up to the first ecall, or with input_size up to the
+  // first store into [input_base, input_base + input_size), then forks
+  // prewarm instances. the template always boots on the interpreter, which
+  // stops precisely at the store.
+  Pool(const std::string& prog_dir, const Config& config = {}, size_t prewarm = 0,
+       u32 input_base = 0, u32 input_size = 0)
+    : prog_dir(prog_dir), config(config) {
+    auto template_config = config;
+    template_config.guard_pages = false;
+    template_config.console_thread = false;
+    template_config.shareable = true;
+    base = std::make_unique<CPU>(prog_dir, template_config);
+    base->engine = CPU::ENGINE_INTERP;
+    base->mmu.watch(input_base, input_size);
+
+    auto watched = false;
+    try {
+      while (!base->halted && base->executed < max_boot) base->steps(1);
+    } catch (const Watchpoint&) {
+      watched = true;
+    } catch (const Fault& e) {
+      die("pool: template faulted while booting. ", e.what());
+    }
+    base->mmu.watch(0, 0);
+    base->console.flush();
+
+    auto ecall = base->halted && base->fetch() == 0x00000073;
+    if (!watched && !ecall) die("pool: template never reached its fork point");
+    if (ecall) {
+      base->halted = false;
+      base->pc += 4;
+    }
+
+    state = State(*base);
+
+    for (size_t i = 0; i < prewarm; i++) warm.push_back(fork());
+  }
+
+  Pool(const Pool&) = delete;
+  Pool& operator=(const Pool&) = delete;
+
+  // puts a CPU back to the fork point
+  auto reset(CPU& cpu) {
+    map_fork(base->dmem_fd, cpu.dmem_size, cpu.dmem);
+    restore_state(cpu);
+    cpu.halted = false;
+    if (!cpu.mmu.dirty.empty()) cpu.mmu.reset_dirty();
+    cpu.checkpoint_id = 0;
+    cpu.checkpoints = 0;
+  }
+
+  std::unique_ptr<CPU> fork() {
+    auto fork_config = config;
+    fork_config.fork_fd = base->dmem_fd;
+    auto cpu = std::make_unique<CPU>(prog_dir, fork_config);
+    restore_state(*cpu);
+    return cpu;
+  }
+
+  // a CPU at the fork point, warm if one is left
+  std::unique_ptr<CPU> acquire() {
+    {
+      auto lock = std::lock_guard(mutex);
+      if (!warm.empty()) {
+        auto cpu = std::move(warm.back());
+        warm.pop_back();
+        return cpu;
+      }
+    }
+    return fork();
+  }
+
+  // hands a CPU from acquire() back for reuse
+  auto release(std::unique_ptr<CPU> cpu) {
+    cpu->console.flush();
+    reset(*cpu);
+    auto lock = std::lock_guard(mutex);
+    warm.push_back(std::move(cpu));
+  }
+};
+
+#endif // #ifndef POOL_HPP
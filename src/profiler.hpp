@@ -0,0 +1,148 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+// sampling guest profiler.
+//
+// a shadow call stack follows the guest's calls (JAL/JALR with rd = x1) and
+// returns (jalr x0, 0(x1)), every interval instructions the stack and pc are
+// recorded. x5 counts as a link register as well, as in the return address
+// stack hints of the spec: millicode like libgcc's __modsi3 returns through
+// it. the samples come out in the folded stack format of flamegraph tools,
+// one "frame;frame;...;leaf count" line per distinct stack. frames are the
+// called addresses, or with an ELF symbol table the functions holding them.
+//
+// the shadow stack needs the instrumented execution loops (see
+// CPU::steps) or, on the JIT engine, blocks translated with calls to
+// jump() (see jit.hpp). sampling itself only splits steps() into slices.
+
+#include <elf.h>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include "isa.hpp"
+
+// function symbols of an ELF file, to name guest addresses
+struct Symbols {
+  std::map<u32, std::string> by_addr;
+
+  Symbols() = default;
+
+  // the functions in filename's .symtab, or all its code labels if it has
+  // no function symbols (hand written assembly). the addresses have to match
+  // the loaded image
+  Symbols(const std::string& filename) {
+    auto in = std::ifstream(filename, std::ios::binary);
+    if (!in) die("could not open ", filename);
+    auto elf = std::vector<char>(std::istreambuf_iterator<char>(in), {});
+
+    auto at = [&](size_t offset, size_t n) {
+      if (offset + n > elf.size()) die(filename, ": truncated ELF file");
+      return elf.data() + offset;
+    };
+    auto& ehdr = *(const Elf32_Ehdr*)at(0, sizeof(Elf32_Ehdr));
+    if (std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) || ehdr.e_ident[EI_CLASS] != ELFCLASS32) {
+      die(filename, " is not a 32 bit ELF file");
+    }
+    auto section = [&](size_t i) -> auto& {
+      return *(const Elf32_Shdr*)at(ehdr.e_shoff + i * ehdr.e_shentsize, sizeof(Elf32_Shdr));
+    };
+
+    auto labels = std::map<u32, std::string>();
+    for (size_t i = 0; i < ehdr.e_shnum; i++) {
+      auto& symtab = section(i);
+      if (symtab.sh_type != SHT_SYMTAB) continue;
+      auto& strtab = section(symtab.sh_link);
+      for (size_t k = 1; k < symtab.sh_size / sizeof(Elf32_Sym); k++) {
+        auto& sym = *(const Elf32_Sym*)at(symtab.sh_offset + k * sizeof(Elf32_Sym), sizeof(Elf32_Sym));
+        auto type = ELF32_ST_TYPE(sym.st_info);
+        if (type != STT_FUNC && type != STT_NOTYPE) continue;
+        if (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= ehdr.e_shnum) continue;
+        if (!(section(sym.st_shndx).sh_flags & SHF_EXECINSTR)) continue;
+        if (sym.st_name >= strtab.sh_size) continue;
+        auto chars = at(strtab.sh_offset + sym.st_name, 1);
+        auto name = std::string(chars, strnlen(chars, elf.data() + elf.size() - chars));
+        // local labels of the assembler
+        if (name.empty() || name.starts_with(".L")) continue;
+        (type == STT_FUNC ? by_addr : labels)[sym.st_value] = name;
+      }
+    }
+    if (by_addr.empty()) by_addr = std::move(labels);
+    if (by_addr.empty()) die(filename, ": no symbols");
+  }
+
+  // the symbol at or below addr
+  auto name(u32 addr) const {
+    auto it = by_addr.upper_bound(addr);
+    if (it == by_addr.begin()) return to_hex(addr);
+    return std::prev(it)->second;
+  }
+
+  auto empty() const { return by_addr.empty(); }
+};
+
+struct Profiler {
+  u64 interval;  // instructions between samples
+  u64 countdown; // to the next sample
+
+  // called addresses, the outermost is where profiling began. calls past
+  // max_depth only count towards depth
+  static constexpr size_t max_depth = 1024;
+  std::array<u32, max_depth> stack;
+  size_t depth = 1;
+
+  // (stack, pc) -> samples
+  std::map<std::vector<u32>, u64> samples;
+
+  Profiler(u64 interval, u32 pc) : interval(interval), countdown(interval) {
+    stack[0] = pc & 0xfffff;
+  }
+
+  static auto link(u8 r) { return r == 1 || r == 5; }
+
+  // the jumps that call or return, worth a call to jump()
+  static auto links(const Decoded& d) {
+    return (d.op == JAL && link(d.rd)) || (d.op == JALR && (link(d.rd) || link(d.rs1)));
+  }
+
+  // follows a JAL or JALR to target
+  auto jump(const Decoded& d, u32 target) {
+    auto ret = d.op == JALR && link(d.rs1) && d.rs1 != d.rd;
+    if (ret && depth > 1) depth--;
+    if (link(d.rd)) {
+      if (depth < max_depth) stack[depth] = target & 0xfffff; // as fetched
+      depth++;
+    }
+  }
+
+  auto sample(u32 pc) {
+    auto key = std::vector<u32>(stack.begin(), stack.begin() + std::min(depth, max_depth));
+    key.push_back(pc & 0xfffff);
+    samples[key]++;
+  }
+
+  // one line per distinct stack, named by symbols if there are any. without
+  // symbols the leaf is the innermost called address, with them the
+  // function holding the pc, which also catches tail calls
+  auto folded(const Symbols& symbols = {}) const {
+    auto stacks = std::map<std::string, u64>();
+    for (auto& [key, count] : samples) {
+      auto line = std::string();
+      auto last = std::string();
+      for (size_t i = 0; i + 1 < key.size(); i++) {
+        last = symbols.empty() ? to_hex(key[i]) : symbols.name(key[i]);
+        line += (i ? ";" : "") + last;
+      }
+      if (!symbols.empty()) {
+        auto leaf = symbols.name(key.back());
+        if (leaf != last) line += ";" + leaf;
+      }
+      stacks[line] += count;
+    }
+    auto out = std::string();
+    for (auto& [line, count] : stacks) out += str(line, " ", count, "\n");
+    return out;
+  }
+};
+
+#endif // #ifndef PROFILER_HPP
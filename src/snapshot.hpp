@@ -0,0 +1,189 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+// CPU checkpoints on disk.
+//
+// the first checkpoint of a chain is a full image: x, f and v registers, imem
+// and every nonzero page of dmem. every later one only holds the dmem pages
+// stored to since the one before (see MMU::reset_dirty), so restoring means
+// applying the full image and then each incremental checkpoint in order.
+//
+// file layout, host byte order:
+//   Snapshot header
+//   32 * vlenb bytes of vector registers
+//   imem_size bytes of imem (full image only)
+//   page records: u32 guest address, u32 PAGE_ZERO or PAGE_DATA, page data
+//   u32 ~0
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+
+#include "cpu.hpp"
+
+struct Snapshot {
+  char magic[8];
+  u32 version;
+  u32 seq;      // position in the chain, 0 for the full image
+  u64 id;       // of the chain
+  u64 executed;
+  u64 imem_size;
+  u64 dmem_size;
+  u32 pc;
+  u32 halted;
+  u32 regs[32];
+  u64 fregs[32];
+  u32 fcsr;
+  u32 vl;
+  u32 vtype;
+  u32 vcsr;
+  u32 vlenb;
+
+  static constexpr char rvvm_magic[8] = {'r', 'v', 'v', 'm', 's', 'n', 'a', 'p'};
+  static constexpr u32 rvvm_version = 4;
+  static constexpr u32 page_size = 1u << MMU::page_bits;
+
+  enum : u32 { PAGE_ZERO, PAGE_DATA, PAGE_END = ~0u };
+};
+
+auto checkpoint_file(const std::string& prefix, u32 seq) {
+  return str(prefix, ".", seq);
+}
+
+auto is_zero(const u8* data, size_t n) {
+  static const u8 zeros[Snapshot::page_size] = {};
+  return std::memcmp(data, zeros, n) == 0;
+}
+
+// writes the next checkpoint of cpu's chain to filename, a full image if the
+// chain is empty. the file only appears once it is complete.
+auto checkpoint(CPU& cpu, const std::string& filename) {
+  auto full = cpu.checkpoints == 0;
+  if (full) {
+    auto rd = std::random_device();
+    cpu.checkpoint_id = u64(rd()) << 32 | rd();
+  }
+
+  auto header = Snapshot();
+  std::memcpy(header.magic, Snapshot::rvvm_magic, sizeof(header.magic));
+  header.version = Snapshot::rvvm_version;
+  header.seq = cpu.checkpoints;
+  header.id = cpu.checkpoint_id;
+  header.executed = cpu.executed;
+  header.imem_size = full ? cpu.imem_size : 0;
+  header.dmem_size = cpu.dmem_size;
+  header.pc = cpu.pc;
+  header.halted = cpu.halted;
+  std::copy_n(cpu.regs.begin(), 32, header.regs);
+  std::copy_n(cpu.fpu.f.begin(), 32, header.fregs);
+  header.fcsr = cpu.fpu.fcsr;
+  header.vl = cpu.vpu.vl;
+  header.vtype = cpu.vpu.vtype;
+  header.vcsr = cpu.vpu.vcsr;
+  header.vlenb = cpu.vpu.vlenb;
+
+  auto tmp = filename + ".tmp";
+  auto out = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+  if (!out) die("could not open ", tmp);
+  auto write = [&](const void* data, size_t n) { out.write((const char*)data, n); };
+
+  write(&header, sizeof(header));
+  write(cpu.vpu.v.data(), cpu.vpu.v.size());
+  if (full) write(cpu.imem, cpu.imem_size);
+
+  auto page = [&](u32 addr, bool skip_zero) {
+    auto data = cpu.dmem + addr;
+    auto n = std::min<size_t>(Snapshot::page_size, cpu.dmem_size - addr);
+    auto zero = is_zero(data, n);
+    if (zero && skip_zero) return;
+    u32 record[] = {addr, zero ? Snapshot::PAGE_ZERO : Snapshot::PAGE_DATA};
+    write(record, sizeof(record));
+    if (!zero) write(data, n);
+  };
+
+  if (full) {
+    for (size_t addr = 0; addr < cpu.dmem_size; addr += Snapshot::page_size) page(addr, true);
+  } else {
+    cpu.mmu.for_each_dirty(0, cpu.dmem_size, [&](u32 addr) { page(addr, false); });
+  }
+  u32 end = Snapshot::PAGE_END;
+  write(&end, sizeof(end));
+
+  out.close();
+  if (!out) die("could not write ", tmp);
+  if (std::rename(tmp.c_str(), filename.c_str())) die("could not rename ", tmp);
+
+  cpu.mmu.reset_dirty();
+  cpu.checkpoints++;
+}
+
+// applies the checkpoint in filename, which has to be the next one of cpu's
+// chain (or a full image, which starts a new one). cpu has to run the same
+// program with at least as much dmem.
+auto restore(CPU& cpu, const std::string& filename) {
+  auto in = std::ifstream(filename, std::ios::binary);
+  if (!in) die("could not open ", filename);
+  auto read = [&](void* data, size_t n) {
+    if (!in.read((char*)data, n)) die("truncated snapshot ", filename);
+  };
+
+  auto header = Snapshot();
+  read(&header, sizeof(header));
+  if (std::memcmp(header.magic, Snapshot::rvvm_magic, sizeof(header.magic)) ||
+      header.version != Snapshot::rvvm_version) {
+    die(filename, " is not a snapshot");
+  }
+  if (header.dmem_size > cpu.dmem_size) die(filename, ": dmem larger than the CPU's");
+  if (header.vlenb != cpu.vpu.vlenb) die(filename, ": vlen ", 8 * header.vlenb, " instead of the CPU's ", cpu.vpu.vlen);
+  read(cpu.vpu.v.data(), cpu.vpu.v.size());
+
+  auto full = header.seq == 0;
+  if (full) {
+    auto imem = std::vector<u8>(header.imem_size);
+    read(imem.data(), imem.size());
+    if (imem.size() != cpu.imem_size || !std::equal(imem.begin(), imem.end(), cpu.imem)) {
+      die(filename, ": snapshot of a different program");
+    }
+    // pages missing from a full image are zero
+    for (size_t addr = 0; addr < cpu.dmem_size; addr += Snapshot::page_size) {
+      auto n = std::min<size_t>(Snapshot::page_size, cpu.dmem_size - addr);
+      if (!is_zero(cpu.dmem + addr, n)) std::memset(cpu.dmem + addr, 0, n);
+    }
+  } else if (header.id != cpu.checkpoint_id || header.seq != cpu.checkpoints) {
+    die(filename, ": not the next checkpoint of the chain");
+  }
+
+  for (;;) {
+    u32 addr;
+    read(&addr, sizeof(addr));
+    if (addr == Snapshot::PAGE_END) break;
+    u32 kind;
+    read(&kind, sizeof(kind));
+    if (addr % Snapshot::page_size || addr >= header.dmem_size) die(filename, ": bad page ", to_hex(addr));
+    auto n = std::min<size_t>(Snapshot::page_size, header.dmem_size - addr);
+    if (kind == Snapshot::PAGE_ZERO) std::memset(cpu.dmem + addr, 0, n);
+    else read(cpu.dmem + addr, n);
+  }
+
+  std::copy_n(header.regs, 32, cpu.regs.begin());
+  std::copy_n(header.fregs, 32, cpu.fpu.f.begin());
+  cpu.fpu.fcsr = header.fcsr;
+  cpu.vpu.vl = header.vl;
+  cpu.vpu.vtype = header.vtype;
+  cpu.vpu.vcsr = header.vcsr;
+  cpu.pc = header.pc;
+  cpu.halted = header.halted;
+  cpu.executed = header.executed;
+  cpu.checkpoint_id = header.id;
+  cpu.checkpoints = header.seq + 1;
+  cpu.mmu.reset_dirty();
+}
+
+// restores prefix.0, prefix.1, ... as far as they exist, returns how many
+auto restore_chain(CPU& cpu, const std::string& prefix) {
+  auto n = 0u;
+  while (std::filesystem::exists(checkpoint_file(prefix, n))) restore(cpu, checkpoint_file(prefix, n++));
+  return n;
+}
+
+#endif // #ifndef SNAPSHOT_HPP
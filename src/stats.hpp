@@ -0,0 +1,91 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+// execution statistics: instruction mix, a per-pc histogram, branch
+// directions and memory traffic by access size.
+//
+// counting happens in the instrumented instantiations of the execution loops
+// (a template parameter, see CPU::steps_any), the others are the same code as
+// before. CPU::stats switches between the two at the next steps() call.
+
+#include <vector>
+
+#include "isa.hpp"
+
+struct Stats {
+  std::array<u64, UNDEF + 1> instructions = {0};
+  std::vector<u64> pcs; // per imem halfword
+
+  // per conditional branch, BEQ to BGEU
+  std::array<u64, BGEU - BEQ + 1> taken = {0};
+  std::array<u64, BGEU - BEQ + 1> not_taken = {0};
+
+  // accesses by size, 1, 2, 4, 8 and any other number of bytes, and the
+  // bytes they moved. a vector load or store is one access of all of its
+  // elements.
+  std::array<u64, 5> loads = {0};
+  std::array<u64, 5> stores = {0};
+  u64 load_bytes = 0;
+  u64 store_bytes = 0;
+
+  Stats(size_t imem_halfwords) : pcs(imem_halfwords) {}
+
+  static constexpr auto size_index(size_t n) { return n == 1 ? 0 : n == 2 ? 1 : n == 4 ? 2 : n == 8 ? 3 : 4; }
+
+  auto count(u32 pc, u8 op) {
+    instructions[op]++;
+    pcs[(pc & 0xfffff) / 2]++;
+  }
+  auto branch(u8 op, bool is_taken) { (is_taken ? taken : not_taken)[op - BEQ]++; }
+  auto load(size_t n) { loads[size_index(n)]++; load_bytes += n; }
+  auto store(size_t n) { stores[size_index(n)]++; store_bytes += n; }
+
+  auto reset() { *this = Stats(pcs.size()); }
+
+  // one JSON object, the histogram only holds the pcs that ran
+  auto to_json() const {
+    auto join = [](auto& items) {
+      auto out = std::string();
+      for (auto& x : items) out += str(out.empty() ? "" : ",", x);
+      return out;
+    };
+
+    auto total = u64(0);
+    auto mix = std::vector<std::string>();
+    for (size_t op = 0; op < instructions.size(); op++) {
+      total += instructions[op];
+      if (instructions[op]) mix.push_back(str("\"", inst_names[op], "\":", instructions[op]));
+    }
+
+    auto hist = std::vector<std::string>();
+    for (size_t i = 0; i < pcs.size(); i++) {
+      if (pcs[i]) hist.push_back(str("\"", to_hex(u32(2 * i)), "\":", pcs[i]));
+    }
+
+    auto branches = std::vector<std::string>();
+    for (size_t i = 0; i < taken.size(); i++) {
+      auto n = taken[i] + not_taken[i];
+      if (!n) continue;
+      branches.push_back(str("\"", inst_names[BEQ + i], "\":{\"taken\":", taken[i],
+                             ",\"not_taken\":", not_taken[i], ",\"taken_ratio\":", double(taken[i]) / n, "}"));
+    }
+
+    auto traffic = [&](auto& counts, u64 bytes) {
+      auto sizes = std::vector<std::string>();
+      for (size_t i = 0; i < counts.size(); i++) {
+        auto size = i + 1 < counts.size() ? str(1 << i) : str("other");
+        sizes.push_back(str("\"", size, "\":", counts[i]));
+      }
+      return str("{\"count\":{", join(sizes), "},\"bytes\":", bytes, "}");
+    };
+
+    return str("{\"total\":", total,
+               ",\"instructions\":{", join(mix), "}",
+               ",\"branches\":{", join(branches), "}",
+               ",\"loads\":", traffic(loads, load_bytes),
+               ",\"stores\":", traffic(stores, store_bytes),
+               ",\"pcs\":{", join(hist), "}}");
+  }
+};
+
+#endif // #ifndef STATS_HPP
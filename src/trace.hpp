@@ -0,0 +1,387 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+// binary execution traces.
+//
+// every retired instruction becomes one fixed width TraceRecord in the
+// buffer of the Tracer of the CPU (and so of the thread) running it. full
+// buffers go to a TraceWriter, whose background thread delta encodes and
+// compresses them and appends them to the trace file as one chunk each.
+// TraceReader iterates a trace one chunk at a time.
+//
+// records are delta encoded: pc against the pc before it plus 4, the other
+// fields against their values the last time the same pc (hashed into
+// prediction_slots) ran. in a loop most deltas are 0 or a constant stride.
+// the deltas go zigzag varint encoded into one byte column per field, and
+// zlib compresses each column on its own. columns that barely compress
+// (e.g. rd of a hash function) are stored as they are for a while, zlib
+// spends most of its time on them for little gain.
+//
+// file layout, host byte order:
+//   magic "rvvmtrce", u32 version
+//   chunks: TraceChunk header, then per column (pc, inst, rd, addr, value)
+//           its stored bytes, zlib data or the bytes as they are
+//
+// the deltas continue across the chunks of a stream, so a stream has to be
+// read from its start.
+//
+// writing and reading a trace needs zlib (-lz), including this doesn't.
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#include "isa.hpp"
+
+struct TraceRecord {
+  u32 pc;
+  u32 inst;
+  u32 rd;    // the value written to rd, 0 without rd
+  u32 addr;  // loads and stores (their first element if vector), 0 otherwise
+  u32 value; // loaded (extended) or stored (truncated) value, 0 otherwise
+};
+
+constexpr char trace_magic[8] = {'r', 'v', 'v', 'm', 't', 'r', 'c', 'e'};
+constexpr u32 trace_version = 1;
+constexpr size_t trace_fields = sizeof(TraceRecord) / sizeof(u32);
+
+struct TraceChunk {
+  u32 stream; // the Tracer it came from
+  u32 records;
+  u32 size[trace_fields];   // bytes of each column
+  u32 stored[trace_fields]; // bytes in the file, equal to size if not compressed
+};
+
+// the delta encoding state of one stream, the same on both sides
+struct TraceDeltas {
+  static constexpr size_t prediction_slots = 1 << 16;
+
+  u32 pc = 0;
+  std::vector<u32> last = std::vector<u32>((trace_fields - 1) * prediction_slots);
+
+  static auto slot(u32 pc) { return (pc >> 2) % prediction_slots; }
+
+  static auto put(u8*& out, u32 x) {
+    x = (x << 1) ^ u32(i32(x) >> 31);
+    while (x >= 0x80) {
+      *out++ = u8(x | 0x80);
+      x >>= 7;
+    }
+    *out++ = u8(x);
+  }
+
+  // false past end
+  static auto get(const u8*& in, const u8* end, u32& x) {
+    x = 0;
+    for (auto shift = 0; shift < 35; shift += 7) {
+      if (in == end) return false;
+      auto b = *in++;
+      x |= u32(b & 0x7f) << shift;
+      if (!(b & 0x80)) {
+        x = (x >> 1) ^ -(x & 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // appends r to the columns at out[field]
+  auto encode(const TraceRecord& r, u8** out) {
+    put(out[0], r.pc - pc - 4);
+    pc = r.pc;
+    auto fields = (const u32*)&r;
+    auto s = slot(r.pc);
+    for (size_t f = 1; f < trace_fields; f++) {
+      auto& x = last[(f - 1) * prediction_slots + s];
+      put(out[f], fields[f] - x);
+      x = fields[f];
+    }
+  }
+
+  // false if a column ends early
+  auto decode(TraceRecord& r, const u8** in, const u8* const* end) {
+    auto fields = (u32*)&r;
+    u32 delta;
+    if (!get(in[0], end[0], delta)) return false;
+    r.pc = pc += delta + 4;
+    auto s = slot(r.pc);
+    for (size_t f = 1; f < trace_fields; f++) {
+      auto& x = last[(f - 1) * prediction_slots + s];
+      if (!get(in[f], end[f], delta)) return false;
+      fields[f] = x += delta;
+    }
+    return true;
+  }
+};
+
+struct TraceWriter;
+
+// records of one CPU, not thread safe
+struct Tracer {
+  TraceWriter& writer;
+  u32 stream;
+  std::vector<TraceRecord> buffer;
+  TraceRecord* next;
+  TraceRecord* end;
+
+  // the access of the instruction being executed
+  u32 addr = 0;
+  u32 value = 0;
+
+  Tracer(TraceWriter& writer, u32 stream);
+  ~Tracer() { flush(); }
+
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+
+  auto access(u32 a, u32 v) {
+    addr = a;
+    value = v;
+  }
+
+  auto retire(u32 pc, u32 inst, u32 rd) {
+    *next++ = {pc, inst, rd, addr, value};
+    addr = value = 0;
+    if (next == end) flush();
+  }
+
+  // hands the records so far to the writer
+  void flush();
+};
+
+struct TraceWriter {
+  static constexpr size_t chunk_records = 1 << 16;
+  static constexpr size_t max_queued = 8; // chunks, recording waits beyond
+
+  std::string filename;
+  std::ofstream out;
+
+  struct Chunk {
+    u32 stream;
+    std::vector<TraceRecord> records;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<Chunk> queue;
+  std::vector<std::vector<TraceRecord>> spare; // buffers for reuse
+  u32 streams = 0;
+  bool done = false;
+  std::thread thread;
+
+  TraceWriter(const std::string& filename)
+    : filename(filename), out(filename, std::ios::binary | std::ios::trunc) {
+    if (!out) die("could not open ", filename);
+    out.write(trace_magic, sizeof(trace_magic));
+    out.write((const char*)&trace_version, sizeof(trace_version));
+    thread = std::thread([this]{ compress_loop(); });
+  }
+
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  // writes out everything submitted, the Tracers have to be gone by now
+  ~TraceWriter() {
+    {
+      auto lock = std::lock_guard(mutex);
+      done = true;
+    }
+    changed.notify_all();
+    thread.join();
+    out.close();
+    if (!out) die("could not write ", filename);
+  }
+
+  // a new stream, one per CPU
+  auto tracer() {
+    auto lock = std::lock_guard(mutex);
+    return std::make_unique<Tracer>(*this, streams++);
+  }
+
+  // queues records for compression, returns an empty buffer of chunk_records
+  auto submit(u32 stream, std::vector<TraceRecord>&& records) {
+    auto lock = std::unique_lock(mutex);
+    if (!records.empty()) {
+      changed.wait(lock, [&]{ return queue.size() < max_queued; });
+      queue.push_back({stream, std::move(records)});
+      changed.notify_all();
+    }
+    auto buffer = std::vector<TraceRecord>();
+    if (!spare.empty()) {
+      buffer = std::move(spare.back());
+      spare.pop_back();
+    }
+    buffer.resize(chunk_records);
+    return buffer;
+  }
+
+  // columns that saved less than a quarter are stored as they are for the
+  // next raw_chunks chunks of their stream
+  static constexpr size_t raw_chunks = 16;
+
+  void compress_loop() {
+    struct Stream {
+      TraceDeltas deltas;
+      std::array<size_t, trace_fields> raw = {0}; // chunks left to store raw
+    };
+    auto streams = std::map<u32, Stream>();
+    auto columns = std::vector<u8>();
+    auto compressed = std::vector<u8>();
+    for (;;) {
+      auto chunk = Chunk();
+      {
+        auto lock = std::unique_lock(mutex);
+        changed.wait(lock, [&]{ return done || !queue.empty(); });
+        if (queue.empty()) return;
+        chunk = std::move(queue.front());
+        queue.pop_front();
+      }
+      changed.notify_all();
+
+      auto& records = chunk.records;
+      auto n = records.size();
+      auto& stream = streams[chunk.stream];
+
+      // a varint takes up to 5 bytes, each column gets room for the worst case
+      auto column_size = 5 * n;
+      columns.resize(trace_fields * column_size);
+      u8* at[trace_fields];
+      for (size_t f = 0; f < trace_fields; f++) at[f] = columns.data() + f * column_size;
+      for (auto& r : records) stream.deltas.encode(r, at);
+
+      auto header = TraceChunk{chunk.stream, u32(n), {}, {}};
+      const u8* data[trace_fields];
+      compressed.resize(trace_fields * compressBound(column_size));
+      auto next = compressed.data();
+      for (size_t f = 0; f < trace_fields; f++) {
+        auto begin = columns.data() + f * column_size;
+        header.size[f] = header.stored[f] = u32(at[f] - begin);
+        data[f] = begin;
+        if (stream.raw[f]) {
+          stream.raw[f]--;
+          continue;
+        }
+        auto size = compressBound(header.size[f]);
+        if (compress2(next, &size, begin, header.size[f], Z_BEST_SPEED) != Z_OK) {
+          die("trace: compression failed");
+        }
+        if (size >= header.size[f] - header.size[f] / 4) stream.raw[f] = raw_chunks;
+        if (size >= header.size[f]) continue;
+        header.stored[f] = u32(size);
+        data[f] = next;
+        next += size;
+      }
+
+      out.write((const char*)&header, sizeof(header));
+      for (size_t f = 0; f < trace_fields; f++) out.write((const char*)data[f], header.stored[f]);
+
+      auto lock = std::lock_guard(mutex);
+      spare.push_back(std::move(records));
+    }
+  }
+};
+
+inline Tracer::Tracer(TraceWriter& writer, u32 stream)
+  : writer(writer), stream(stream) {
+  buffer.resize(TraceWriter::chunk_records);
+  next = buffer.data();
+  end = next + buffer.size();
+}
+
+inline void Tracer::flush() {
+  buffer.resize(next - buffer.data());
+  buffer = writer.submit(stream, std::move(buffer));
+  next = buffer.data();
+  end = next + buffer.size();
+}
+
+// the records of a trace file in the order they were written, chunk by chunk.
+// the records of one stream are in execution order, chunks of different
+// streams interleave.
+//
+//   auto trace = TraceReader("primes.trace");
+//   for (auto r = TraceRecord(); trace.next(r); ) ...
+struct TraceReader {
+  std::string filename;
+  std::ifstream in;
+  std::vector<TraceRecord> chunk;
+  size_t i = 0;
+  u32 current = 0; // stream of the chunk
+
+  std::map<u32, TraceDeltas> deltas; // by stream
+  std::vector<u8> compressed;
+  std::vector<u8> columns;
+
+  TraceReader(const std::string& filename) : filename(filename), in(filename, std::ios::binary) {
+    if (!in) die("could not open ", filename);
+    char magic[sizeof(trace_magic)];
+    u32 version = 0;
+    in.read(magic, sizeof(magic));
+    in.read((char*)&version, sizeof(version));
+    if (!in || std::memcmp(magic, trace_magic, sizeof(magic)) || version != trace_version) {
+      die(filename, " is not a trace");
+    }
+  }
+
+  // the stream of the record last returned by next()
+  auto stream() const { return current; }
+
+  // the next record into r, false at the end of the trace
+  auto next(TraceRecord& r) {
+    while (i == chunk.size()) {
+      if (!read_chunk()) return false;
+    }
+    r = chunk[i++];
+    return true;
+  }
+
+  bool read_chunk() {
+    auto header = TraceChunk();
+    if (!in.read((char*)&header, sizeof(header))) {
+      if (in.gcount()) die("truncated trace ", filename);
+      return false;
+    }
+
+    const u8* at[trace_fields];
+    const u8* end[trace_fields];
+    auto total = size_t(0);
+    for (size_t f = 0; f < trace_fields; f++) {
+      if (header.stored[f] > header.size[f] || header.size[f] > 5 * size_t(header.records)) {
+        die("corrupt trace ", filename);
+      }
+      total += header.size[f];
+    }
+    columns.resize(total);
+    for (size_t f = 0, offset = 0; f < trace_fields; offset += header.size[f++]) {
+      auto column = columns.data() + offset;
+      if (header.stored[f] == header.size[f]) {
+        if (!in.read((char*)column, header.size[f])) die("truncated trace ", filename);
+      } else {
+        compressed.resize(header.stored[f]);
+        if (!in.read((char*)compressed.data(), compressed.size())) die("truncated trace ", filename);
+        auto size = uLongf(header.size[f]);
+        if (uncompress(column, &size, compressed.data(), compressed.size()) != Z_OK || size != header.size[f]) {
+          die("corrupt trace ", filename);
+        }
+      }
+      at[f] = column;
+      end[f] = column + header.size[f];
+    }
+
+    auto& state = deltas[header.stream];
+    chunk.resize(header.records);
+    for (auto& r : chunk) {
+      if (!state.decode(r, at, end)) die("corrupt trace ", filename);
+    }
+    current = header.stream;
+    i = 0;
+    return true;
+  }
+};
+
+#endif // #ifndef TRACE_HPP
@@ -5,12 +5,85 @@
 #include "bits.hpp"
 #include "rv.hpp"
 
+#include <array>
+#include <bitset>
+#include <memory>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
 namespace rvvm {
 
 using namespace olib;
 
+// sparse guest memory: a two level page table over the 32 bit address space,
+// 4 KiB pages are allocated (zeroed) on first write
+struct Memory {
+  static constexpr u32 page_bits  = 12;
+  static constexpr u32 page_size  = 1 << page_bits;
+  static constexpr u32 table_bits = 10; // address = dir | table | offset
+
+  using Page  = std::array<u8, page_size>;
+
+  struct Table {
+    std::array<std::unique_ptr<Page>, 1 << table_bits> pages;
+    // one bit per page written since the last clear_dirty()
+    std::bitset<1 << table_bits> dirty;
+  };
+
+  std::array<std::unique_ptr<Table>, 1 << table_bits> dir;
+
+  static u32 dir_index(u32 i)   {return i >> (page_bits + table_bits);}
+  static u32 table_index(u32 i) {return slice(i, page_bits, page_bits + table_bits - 1);}
+  static u32 offset(u32 i)      {return i & (page_size - 1);}
+
+  // page holding address i, nullptr if it was never written
+  Page* page(u32 i) const {
+    auto& table = dir[dir_index(i)];
+    return table ? table->pages[table_index(i)].get() : nullptr;
+  }
+
+  Page& touch(u32 i) {
+    auto& table = dir[dir_index(i)];
+    if (!table) table = std::make_unique<Table>();
+    table->dirty[table_index(i)] = true;
+    auto& page = table->pages[table_index(i)];
+    if (!page) page = std::make_unique<Page>(Page{});
+    return *page;
+  }
+
+  u8 read(u32 i) const {
+    auto p = page(i);
+    return p ? (*p)[offset(i)] : 0;
+  }
+
+  void write(u32 i, u8 b) {touch(i)[offset(i)] = b;}
+
+  bool is_dirty(u32 i) const {
+    auto& table = dir[dir_index(i)];
+    return table && table->dirty[table_index(i)];
+  }
+
+  void clear_dirty() {
+    for (auto& table : dir)
+      if (table) table->dirty.reset();
+  }
+
+  // f(base address, page) for every allocated page in address order
+  template<typename F>
+  void for_each_page(F f) const {
+    for (u32 d = 0; d < dir.size(); d++) {
+      if (!dir[d]) continue;
+      for (u32 t = 0; t < dir[d]->pages.size(); t++) {
+        if (auto& p = dir[d]->pages[t])
+          f(d << (page_bits + table_bits) | t << page_bits, *p);
+      }
+    }
+  }
+};
+
 struct Machine {
-  map<u32, u8> mem;
+  Memory mem;
   vector<u32> regs = vector<u32>(33);
   u32 pc;
 
@@ -32,6 +105,12 @@ struct Machine {
 
   string str();
 
+  // checkpoints: registers, pc and either every allocated page (full) or
+  // only the pages written since the previous save (incremental). restore
+  // applies a full checkpoint, then the incremental ones in order.
+  void save(std::ostream& out, bool incremental);
+  void restore(std::istream& in);
+
   void operator()(u32 i);
   void operator()(){operator()(lw(pc));}
 };
@@ -41,12 +120,19 @@ struct Machine {
 u32 Machine::load(u8 n, u32 i) {
   if (n > 2) n = 4; // only load 1, 2 or 4 bytes
 
-  u32 w;
+  u32 w = 0;
+
+  // aligned accesses never cross a page: one host load (little endian host)
+  if (i % n == 0) {
+    if (auto p = mem.page(i))
+      std::memcpy(&w, p->data() + Memory::offset(i), n);
+    return w;
+  }
+
   for (auto j = 0; j < n; j++) {
     auto l = j * 8;
     auto u = l + 7;
-    auto to = mem.contains(i + j) ? mem[i + j] : 0;
-    set_slice(w, to, l, u);
+    set_slice(w, mem.read(i + j), l, u);
   }
 
   // sxt
@@ -57,10 +143,15 @@ u32 Machine::load(u8 n, u32 i) {
 void Machine::store(u8 n, u32 w, u32 i) {
   if (n > 2) n = 4; // only store 1, 2 or 4 bytes
 
+  if (i % n == 0) {
+    std::memcpy(mem.touch(i).data() + Memory::offset(i), &w, n);
+    return;
+  }
+
   for (auto j = 0; j < n; j++) {
     auto l = j * 8;
     auto u = l + 7;
-    mem[i + j] = slice(w, l, u);
+    mem.write(i + j, slice(w, l, u));
   }
 }
 
@@ -94,33 +185,31 @@ string Machine::str() {
       ss << register_line(i);
   };
 
-  // holds the word aligned (divisible by 4) byte adress 'memory_line_index'
-  // such that memory_line_index <= index <= memory_line_index + 3
+  // prints the nonzero words of the allocated pages, word aligned
   auto print_memory = [&]{
-    auto memory_line_index      = 0;
-    auto prev_memory_line_index = 0;
+    u32 prev_memory_line_index = 0;
     auto empty_line = "\n              ...             \n\n";
-    auto byte = [&](auto i) { return mem.contains(i) ? hex(mem[i]) : ".."; };
-    auto memory_line = [&](auto i) {
+    auto memory_line = [&](u32 memory_line_index, const u8* bytes) {
       stringstream ss;
       ss << "│"   << hex_pretty(memory_line_index)
-         << "│"   << byte(i)
-         << " │ " << byte(i + 1)
-         << " │ " << byte(i + 2)
-         << " │ " << byte(i + 3) << "│\n";
+         << "│"   << hex(bytes[0])
+         << " │ " << hex(bytes[1])
+         << " │ " << hex(bytes[2])
+         << " │ " << hex(bytes[3]) << "│\n";
       return ss.str();
     };
 
-    for (const auto [index, val] : mem) {
-      // this index has been printed in previous memory line:
-      if (0 < index && index <= memory_line_index + 3) continue;
-      // get the current memory cells memory line index:
-      memory_line_index = index - (index % 4);
-      // if the adjacent difference is greater than 4, we skipped a line:
-      if (memory_line_index - prev_memory_line_index > 4) ss << empty_line;
-      ss << memory_line(index);
-      prev_memory_line_index = memory_line_index;
-    }
+    mem.for_each_page([&](u32 base, const Memory::Page& page) {
+      for (u32 j = 0; j < Memory::page_size; j += 4) {
+        auto bytes = page.data() + j;
+        if (!(bytes[0] | bytes[1] | bytes[2] | bytes[3])) continue;
+        auto memory_line_index = base + j;
+        // if the adjacent difference is greater than 4, we skipped a line:
+        if (memory_line_index - prev_memory_line_index > 4) ss << empty_line;
+        ss << memory_line(memory_line_index, bytes);
+        prev_memory_line_index = memory_line_index;
+      }
+    });
   };
 
   print_registers();
@@ -130,6 +219,52 @@ string Machine::str() {
   return ss.str();
 }
 
+// layout, host byte order: magic, u32 incremental, u32 pc, u32 regs[32],
+// then (u32 page address, page) records up to a ~0 address
+constexpr char checkpoint_magic[8] = {'r', 'v', 'v', 'm', 'm', 'a', 'c', 'h'};
+
+void Machine::save(std::ostream& out, bool incremental) {
+  auto put = [&](const void* data, size_t n) {out.write((const char*)data, n);};
+  auto put32 = [&](u32 w) {put(&w, 4);};
+
+  put(checkpoint_magic, sizeof(checkpoint_magic));
+  put32(incremental);
+  put32(pc);
+  for (auto i : range_(32)) put32(regs[i]);
+
+  mem.for_each_page([&](u32 base, const Memory::Page& page) {
+    if (incremental && !mem.is_dirty(base)) return;
+    put32(base);
+    put(page.data(), page.size());
+  });
+  put32(~0u);
+
+  if (!out) throw std::runtime_error("checkpoint: write failed");
+  mem.clear_dirty();
+}
+
+void Machine::restore(std::istream& in) {
+  auto get = [&](void* data, size_t n) {
+    if (!in.read((char*)data, n)) throw std::runtime_error("checkpoint: truncated");
+  };
+  auto get32 = [&] {u32 w; get(&w, 4); return w;};
+
+  char magic[sizeof(checkpoint_magic)];
+  get(magic, sizeof(magic));
+  if (std::memcmp(magic, checkpoint_magic, sizeof(magic)))
+    throw std::runtime_error("checkpoint: bad magic");
+
+  auto incremental = get32();
+  if (!incremental) for (auto& table : mem.dir) table.reset();
+  pc = get32();
+  for (auto i : range_(32)) regs[i] = get32();
+
+  for (auto base = get32(); base != ~0u; base = get32())
+    get(mem.touch(base).data(), Memory::page_size);
+
+  mem.clear_dirty();
+}
+
 void Machine::operator()(u32 i) {
   auto instr = Instruction(i);
   auto& rd = regs[instr.rd];
@@ -0,0 +1,375 @@
+#ifndef VPU_HPP
+#define VPU_HPP
+
+// a Zve32x subset of the V extension: vset{i}vl{i}, integer arithmetic,
+// compares, merges, reductions, mask logicals and the scalar moves. the
+// loads and stores go through the MMU, see CPU::vmem.
+//
+// the 32 registers of vlen bits are one byte array, a register group just
+// runs on into the following registers. tails and masked off elements are
+// left undisturbed (which agnostic allows as well). unmasked element-wise
+// ops and reductions take a host vector at a time, with GCC vector
+// extensions built once for AVX2 and once for SSE2 and picked by cpuid.
+// masked ones, compares and the mask ops go element by element.
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "isa.hpp"
+
+struct VPU {
+  u32 vlen;  // bits per register
+  u32 vlenb; // bytes per register
+  std::vector<u8> v;
+  u32 vl = 0;
+  u32 vtype;
+  u32 vcsr = 0; // vxrm in bits 2:1, vxsat in bit 0, nothing but the CSRs uses them
+  u32* x;    // the integer registers, x[32] is the x0 sink
+  bool avx2 = false;
+
+  static constexpr u32 vill = 0x80000000;
+
+  VPU(u32* x, u32 vlen) : vlen(vlen), vlenb(vlen / 8), v(32 * vlenb), vtype(vill), x(x) {
+    if (vlen < 32 || vlen > 65536 || (vlen & (vlen - 1))) die("vlen has to be a power of two from 32 to 65536");
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    avx2 = __builtin_cpu_supports("avx2");
+#endif
+  }
+
+  // for calls from translated code
+  static bool step(VPU* vpu, Decoded d) {
+    return vpu->exec(d);
+  }
+
+  // element bytes, and LMUL in eighths
+  static u32 sew(u32 vtype) { return 1u << (vtype >> 3 & 7); }
+  static u32 lmul8(u32 vtype) { auto m = vtype & 7; return m < 4 ? 8u << m : 8u >> (8 - m); }
+  u32 sew() const { return sew(vtype); }
+  u32 lmul8() const { return lmul8(vtype); }
+  u32 vlmax(u32 vtype) const { return vlenb * lmul8(vtype) / (8 * sew(vtype)); }
+
+  // SEW up to 32 bits, no LMUL of 16ths, no fractional LMUL that would
+  // leave an element less than SEW, nothing in the reserved bits
+  bool valid(u32 vtype) const {
+    return !(vtype >> 8) && (vtype >> 3 & 7) <= 2 && (vtype & 7) != 4 && 2 * sew(vtype) <= lmul8(vtype)
+        && vlmax(vtype) > 0;
+  }
+
+  bool mask(u32 r, u32 i) const { return v[r * vlenb + i / 8] >> (i % 8) & 1; }
+  bool active(bool vm, u32 i) const { return vm || mask(0, i); }
+
+  void set_mask(u32 r, u32 i, bool b) {
+    auto& byte = v[r * vlenb + i / 8];
+    byte = u8((byte & ~(1 << (i % 8))) | b << (i % 8));
+  }
+
+  u8* reg(u32 r) { return v.data() + r * vlenb; }
+
+  template<typename T> T get(u32 r, u32 i) const {
+    T e;
+    std::memcpy(&e, &v[r * vlenb + i * sizeof(T)], sizeof(T));
+    return e;
+  }
+
+  template<typename T> void set(u32 r, u32 i, T e) {
+    std::memcpy(&v[r * vlenb + i * sizeof(T)], &e, sizeof(T));
+  }
+
+  // what a load or store touches: n elements of eew bytes from register vd
+  // on. nothing if it's illegal under vtype.
+  struct Access {
+    u32 vd, eew, n;
+    bool vm;
+  };
+
+  std::optional<Access> access(const Decoded& d) const {
+    if (vtype & vill) return std::nullopt;
+    if (d.op == VLM || d.op == VSM) return Access{d.rd, 1, (vl + 7) / 8, true};
+    auto eew = u32(d.imm) >> 1;
+    auto emul8 = eew * lmul8() / sew();
+    if (emul8 < 1 || emul8 > 64 || d.rd % std::max(1u, emul8 / 8)) return std::nullopt;
+    return Access{d.rd, eew, vl, bool(d.imm & 1)};
+  }
+
+  void set_vl(const Decoded& d) {
+    auto next = d.op == VSETVL ? x[d.rs2] : u32(d.imm);
+    // rs1 = x0 asks for VLMAX, or to keep vl if rd is x0 too
+    auto avl = d.op == VSETIVLI ? d.rs1 : d.rs1 ? x[d.rs1] : d.rd != 32 ? ~0u : vl;
+    if (valid(next)) {
+      vtype = next;
+      vl = std::min(avl, vlmax(vtype));
+    } else {
+      vtype = vill;
+      vl = 0;
+    }
+    x[d.rd] = vl;
+  }
+
+  // r = op of a (vs2) and b (vs1, the scalar or the immediate), d is vd for
+  // vmacc. works on host vectors and on single elements alike, r is an out
+  // parameter as AVX2 vectors can't be returned without AVX2.
+  template<typename T, u8 op>
+  [[gnu::always_inline]] static inline void apply(auto& r, const auto& a, const auto& b, [[maybe_unused]] const auto& d) {
+    constexpr auto shamt = T(8 * sizeof(T) - 1);
+    if constexpr (op == VADD) r = a + b;
+    else if constexpr (op == VSUB) r = a - b;
+    else if constexpr (op == VRSUB) r = b - a;
+    else if constexpr (op == VMINU || op == VMIN) r = a < b ? a : b;
+    else if constexpr (op == VMAXU || op == VMAX) r = a < b ? b : a;
+    else if constexpr (op == VAND) r = a & b;
+    else if constexpr (op == VOR) r = a | b;
+    else if constexpr (op == VXOR) r = a ^ b;
+    else if constexpr (op == VSLL) r = a << (b & shamt);
+    else if constexpr (op == VSRL || op == VSRA) r = a >> (b & shamt);
+    else if constexpr (op == VMUL) r = a * b;
+    else if constexpr (op == VMACC) r = a * b + d;
+    else if constexpr (op == VMERGE) r = b;
+    else if constexpr (op == VMSEQ) r = a == b;
+    else if constexpr (op == VMSNE) r = a != b;
+    else if constexpr (op == VMSLTU || op == VMSLT) r = a < b;
+    else if constexpr (op == VMSLEU || op == VMSLE) r = a <= b;
+    else r = a > b; // VMSGTU, VMSGT
+  }
+
+  // scalar apply
+  template<typename T, u8 op>
+  static T element(T a, T b, T d) {
+    T r;
+    apply<T, op>(r, a, b, d);
+    return r;
+  }
+
+  template<typename T> static T load(const u8* a, u32 i) {
+    T e;
+    std::memcpy(&e, a + i * sizeof(T), sizeof(T));
+    return e;
+  }
+
+  // d[i] = op(a[i], b ? b[i] : s, d[i]) for i < n, W bytes at a time
+  template<u32 W, typename T, u8 op>
+  [[gnu::always_inline]] static inline void lanes(u8* d, const u8* a, const u8* b, T s, u32 n) {
+    typedef T V __attribute__((vector_size(W)));
+    constexpr u32 k = W / sizeof(T);
+    auto vs = V{} + s;
+    auto i = u32(0);
+    // no lambdas here, they wouldn't inherit the AVX2 target
+    for (; i + k <= n; i += k) {
+      V va, vb = vs, vd;
+      std::memcpy(&va, a + i * sizeof(T), W);
+      if (b) std::memcpy(&vb, b + i * sizeof(T), W);
+      if constexpr (op == VMACC) std::memcpy(&vd, d + i * sizeof(T), W);
+      apply<T, op>(vd, va, vb, vd);
+      std::memcpy(d + i * sizeof(T), &vd, W);
+    }
+    for (; i < n; i++) {
+      auto e = element<T, op>(load<T>(a, i), b ? load<T>(b, i) : s, load<T>(d, i));
+      std::memcpy(d + i * sizeof(T), &e, sizeof(T));
+    }
+  }
+
+  // op over acc and a[i] for i < n, W bytes at a time
+  template<u32 W, typename T, u8 op>
+  [[gnu::always_inline]] static inline T fold(const u8* a, u32 n, T acc) {
+    typedef T V __attribute__((vector_size(W)));
+    constexpr u32 k = W / sizeof(T);
+    auto i = u32(0);
+    if (n >= k) {
+      V va, vacc;
+      std::memcpy(&vacc, a, W);
+      for (i = k; i + k <= n; i += k) {
+        std::memcpy(&va, a + i * sizeof(T), W);
+        apply<T, op>(vacc, vacc, va, vacc);
+      }
+      for (u32 j = 0; j < k; j++) acc = element<T, op>(acc, vacc[j], acc);
+    }
+    for (; i < n; i++) acc = element<T, op>(acc, load<T>(a, i), acc);
+    return acc;
+  }
+
+#if defined(__x86_64__)
+  template<typename T, u8 op> [[gnu::target("avx2")]]
+  static void lanes_avx2(u8* d, const u8* a, const u8* b, T s, u32 n) { lanes<32, T, op>(d, a, b, s, n); }
+
+  template<typename T, u8 op> [[gnu::target("avx2")]]
+  static T fold_avx2(const u8* a, u32 n, T acc) { return fold<32, T, op>(a, n, acc); }
+#endif
+
+  // vd = op(vs2, vs1 or the scalar b) over the active elements
+  template<typename T, u8 op>
+  void map(const Decoded& d, T b) {
+    auto vs1 = (d.imm >> 1 & 3) == VFORM_VV ? reg(d.rs1) : nullptr;
+    if (d.imm & 1) {
+#if defined(__x86_64__)
+      if (avx2) return lanes_avx2<T, op>(reg(d.rd), reg(d.rs2), vs1, b, vl);
+#endif
+      return lanes<16, T, op>(reg(d.rd), reg(d.rs2), vs1, b, vl);
+    }
+    for (u32 i = 0; i < vl; i++) {
+      if (!mask(0, i)) continue;
+      set(d.rd, i, element<T, op>(get<T>(d.rs2, i), vs1 ? get<T>(d.rs1, i) : b, get<T>(d.rd, i)));
+    }
+  }
+
+  // vd[0] = op over vs1[0] and the active elements of vs2
+  template<typename T, u8 op>
+  void reduce(const Decoded& d) {
+    if (!vl) return;
+    auto acc = get<T>(d.rs1, 0);
+    if (d.imm & 1) {
+#if defined(__x86_64__)
+      if (avx2) return set(d.rd, 0, fold_avx2<T, op>(reg(d.rs2), vl, acc));
+#endif
+      return set(d.rd, 0, fold<16, T, op>(reg(d.rs2), vl, acc));
+    }
+    for (u32 i = 0; i < vl; i++) {
+      if (mask(0, i)) acc = element<T, op>(acc, get<T>(d.rs2, i), acc);
+    }
+    set(d.rd, 0, acc);
+  }
+
+  // mask vd = op(vs2, vs1 or the scalar b) over the active elements. vd
+  // may be the first register of vs2: bit i is in byte i / 8 <= i, of an
+  // element read already.
+  template<typename T, u8 op>
+  void compare(const Decoded& d, T b) {
+    auto vv = (d.imm >> 1 & 3) == VFORM_VV;
+    for (u32 i = 0; i < vl; i++) {
+      if (active(d.imm & 1, i)) set_mask(d.rd, i, element<T, op>(get<T>(d.rs2, i), vv ? get<T>(d.rs1, i) : b, 0));
+    }
+  }
+
+  // vd = mask ? vs1 or the scalar : vs2
+  template<typename T>
+  void merge(const Decoded& d, T b) {
+    auto vv = (d.imm >> 1 & 3) == VFORM_VV;
+    for (u32 i = 0; i < vl; i++) set(d.rd, i, mask(0, i) ? vv ? get<T>(d.rs1, i) : b : get<T>(d.rs2, i));
+  }
+
+  // vd = op(vs2, vs1) on the first vl mask bits, a byte at a time
+  void logical(const Decoded& d) {
+    auto fn = [&](u8 a, u8 b) -> u8 {
+      switch (d.op) {
+      case VMANDN: return a & ~b;
+      case VMAND:  return a & b;
+      case VMOR:   return a | b;
+      case VMXOR:  return a ^ b;
+      case VMORN:  return a | ~b;
+      case VMNAND: return ~(a & b);
+      case VMNOR:  return ~(a | b);
+      default:     return ~(a ^ b);
+      }
+    };
+    auto vd = reg(d.rd), vs2 = reg(d.rs2), vs1 = reg(d.rs1);
+    auto full = vl / 8;
+    for (u32 k = 0; k < full; k++) vd[k] = fn(vs2[k], vs1[k]);
+    if (vl % 8) {
+      auto keep = u8(0xff << (vl % 8));
+      vd[full] = u8((vd[full] & keep) | (fn(vs2[full], vs1[full]) & ~keep));
+    }
+  }
+
+  // U and S are the unsigned and signed SEW types
+  template<typename U, typename S>
+  bool exec_as(const Decoded& d) {
+    auto group = std::max(1u, lmul8() / 8);
+    auto vv = (d.imm >> 1 & 3) == VFORM_VV;
+    auto b = U((d.imm >> 1 & 3) == VFORM_VX ? x[d.rs1] : u32(d.imm >> 3));
+    // register groups have to start at a multiple of LMUL
+    auto aligned = [&](auto... r) { return ((r % group == 0) && ...); };
+    auto sources = aligned(d.rs2) && (!vv || aligned(d.rs1));
+
+    switch (d.op) {
+    case VADD: case VSUB: case VRSUB: case VMINU: case VMIN: case VMAXU: case VMAX:
+    case VAND: case VOR: case VXOR: case VSLL: case VSRL: case VSRA: case VMUL: case VMACC: case VMERGE:
+      if (!sources || !aligned(d.rd)) return false;
+      break;
+    case VMSEQ: case VMSNE: case VMSLTU: case VMSLT: case VMSLEU: case VMSLE: case VMSGTU: case VMSGT:
+      if (!sources) return false;
+      break;
+    case VREDSUM: case VREDAND: case VREDOR: case VREDXOR:
+    case VREDMINU: case VREDMIN: case VREDMAXU: case VREDMAX:
+      if (!aligned(d.rs2)) return false;
+      break;
+    case VID_V:
+      if (!aligned(d.rd)) return false;
+      break;
+    }
+
+    switch (d.op) {
+    case VADD:     map<U, VADD>(d, b);     break;
+    case VSUB:     map<U, VSUB>(d, b);     break;
+    case VRSUB:    map<U, VRSUB>(d, b);    break;
+    case VMINU:    map<U, VMINU>(d, b);    break;
+    case VMIN:     map<S, VMIN>(d, S(b));  break;
+    case VMAXU:    map<U, VMAXU>(d, b);    break;
+    case VMAX:     map<S, VMAX>(d, S(b));  break;
+    case VAND:     map<U, VAND>(d, b);     break;
+    case VOR:      map<U, VOR>(d, b);      break;
+    case VXOR:     map<U, VXOR>(d, b);     break;
+    case VSLL:     map<U, VSLL>(d, b);     break;
+    case VSRL:     map<U, VSRL>(d, b);     break;
+    case VSRA:     map<S, VSRA>(d, S(b));  break;
+    case VMUL:     map<U, VMUL>(d, b);     break;
+    case VMACC:    map<U, VMACC>(d, b);    break;
+    case VMERGE:
+      if (d.imm & 1) map<U, VMERGE>(d, b);
+      else merge<U>(d, b);
+      break;
+    case VMSEQ:    compare<U, VMSEQ>(d, b);     break;
+    case VMSNE:    compare<U, VMSNE>(d, b);     break;
+    case VMSLTU:   compare<U, VMSLTU>(d, b);    break;
+    case VMSLT:    compare<S, VMSLT>(d, S(b));  break;
+    case VMSLEU:   compare<U, VMSLEU>(d, b);    break;
+    case VMSLE:    compare<S, VMSLE>(d, S(b));  break;
+    case VMSGTU:   compare<U, VMSGTU>(d, b);    break;
+    case VMSGT:    compare<S, VMSGT>(d, S(b));  break;
+    case VREDSUM:  reduce<U, VADD>(d);  break;
+    case VREDAND:  reduce<U, VAND>(d);  break;
+    case VREDOR:   reduce<U, VOR>(d);   break;
+    case VREDXOR:  reduce<U, VXOR>(d);  break;
+    case VREDMINU: reduce<U, VMINU>(d); break;
+    case VREDMIN:  reduce<S, VMIN>(d);  break;
+    case VREDMAXU: reduce<U, VMAXU>(d); break;
+    case VREDMAX:  reduce<S, VMAX>(d);  break;
+    case VMV_X_S:  x[d.rd] = u32(i32(get<S>(d.rs2, 0))); break;
+    case VMV_S_X:  if (vl) set(d.rd, 0, U(x[d.rs1])); break;
+    case VID_V:
+      for (u32 i = 0; i < vl; i++) if (active(d.imm & 1, i)) set(d.rd, i, U(i));
+      break;
+    case VCPOP_M: {
+      auto n = 0u;
+      for (u32 i = 0; i < vl; i++) n += active(d.imm & 1, i) && mask(d.rs2, i);
+      x[d.rd] = n;
+      break;
+    }
+    case VFIRST_M: {
+      auto first = ~0u;
+      for (u32 i = 0; i < vl && first == ~0u; i++) if (active(d.imm & 1, i) && mask(d.rs2, i)) first = i;
+      x[d.rd] = first;
+      break;
+    }
+    default:
+      logical(d);
+    }
+    return true;
+  }
+
+  // false if d is illegal under the current vtype
+  bool exec(const Decoded& d) {
+    if (d.op == VSETVLI || d.op == VSETIVLI || d.op == VSETVL) {
+      set_vl(d);
+      return true;
+    }
+    if (vtype & vill) return false;
+    switch (sew()) {
+    case 1:  return exec_as<u8, i8>(d);
+    case 2:  return exec_as<u16, i16>(d);
+    default: return exec_as<u32, i32>(d);
+    }
+  }
+};
+
+#endif // #ifndef VPU_HPP
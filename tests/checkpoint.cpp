@@ -0,0 +1,40 @@
+// an incremental checkpoint holds every page written since the one before,
+// also the second page of a store that straddles two
+//
+//   g++ -std=c++23 -O2 -o checkpoint tests/checkpoint.cpp && ./checkpoint
+
+#include "guest.hpp"
+#include "../src/snapshot.hpp"
+
+auto word(const CPU& cpu, u32 addr) {
+  return *(const u32*)(cpu.dmem + addr);
+}
+
+int main() {
+  // a loop that gets hot enough to be translated. it adds 0x10001 to x1 and
+  // stores it at 0x1ffc and at 0x1ffe, which puts its upper half into the
+  // first bytes of the page at 0x2000
+  auto program = write_program({lui(2, 2), addi(2, 2, -4), lui(5, 0x10), addi(5, 5, 1), addi(1, 0, 0),
+                                add(1, 1, 5), sw(1, 2, 0), sw(1, 2, 2), jal(0, -12)});
+
+  for_each_config([&](CPU::Engine engine, const Config& config, std::string what) {
+    auto cpu = CPU(program, config);
+    cpu.engine = engine;
+    auto prefix = str(program, "/", int(engine), config.guard_pages);
+
+    cpu.steps(5 + 4 * 100);
+    checkpoint(cpu, checkpoint_file(prefix, 0));
+    cpu.steps(4 * 100);
+    checkpoint(cpu, checkpoint_file(prefix, 1));
+
+    auto restored = CPU(program, config);
+    check(restore_chain(restored, prefix) == 2, what, "chain isn't two checkpoints");
+    for (auto addr : { 0x1ffcu, 0x2000u }) {
+      check(word(restored, addr) == word(cpu, addr), what, "restored ", to_hex(addr), " as ",
+            to_hex(word(restored, addr)), ", expected ", to_hex(word(cpu, addr)));
+    }
+  });
+
+  if (failures) return 1;
+  print("ok");
+}
@@ -0,0 +1,53 @@
+// a guest fault leaves pc on the faulting instruction and executed counting
+// the instructions before it, on every engine
+//
+//   g++ -std=c++23 -O2 -o fault tests/fault.cpp && ./fault
+
+#include "guest.hpp"
+
+int main() {
+  // x2 = 0xffffffff is outside of dmem
+  struct Case { const char* name; std::string program; u32 pc; u64 executed; };
+  auto cases = {
+    Case{"lw",       write_program({addi(2, 0, -1), addi(1, 0, 1), lw(4, 2, 0), ebreak}), 8, 2},
+    Case{"sw",       write_program({addi(2, 0, -1), addi(1, 0, 1), sw(1, 2, 0), ebreak}), 8, 2},
+    Case{"flw",      write_program({addi(2, 0, -1), addi(1, 0, 1), flw(1, 2, 0), ebreak}), 8, 2},
+    Case{"fsw",      write_program({addi(2, 0, -1), addi(1, 0, 1), fsw(1, 2, 0), ebreak}), 8, 2},
+    Case{"lw+lw",    write_program({addi(2, 0, -1), lw(4, 2, 0), lw(5, 2, 0), ebreak}), 4, 1},
+    Case{"sw+addi",  write_program({addi(2, 0, -1), sw(1, 2, 0), addi(1, 1, 1), ebreak}), 4, 1},
+    // a loop that gets hot enough to be translated, its lw strides 64 KiB
+    // from 0x4ffe and straddles the end of the 5001216 bytes of (guarded)
+    // dmem on the 77th iteration
+    Case{"hot lw",   write_program({lui(2, 5), addi(2, 2, -2), lui(5, 0x10), addi(1, 0, 0),
+                                    addi(1, 1, 1), lw(4, 2, 0), add(2, 2, 5), jal(0, -12)}),
+         20, 4 + 76 * 4 + 1},
+    // the same with a vector load of 16 bytes, which leaves dmem entirely
+    Case{"hot vle8", write_program({lui(2, 5), addi(2, 2, -2), lui(5, 0x10), vsetvli(6, 0, 0),
+                                    addi(1, 1, 1), vle8_v(1, 2), add(2, 2, 5), jal(0, -12)}),
+         20, 4 + 76 * 4 + 1},
+    // dynamic rounding with a reserved frm is illegal, also in a loop that
+    // was translated while frm was still RNE
+    Case{"frm 5",    write_program({csrrwi(0, 0x002, 5), fadd_s(1, 1, 1), ebreak}), 4, 1},
+    Case{"hot frm",  write_program({addi(1, 0, 60), fadd_s(1, 1, 1), addi(1, 1, -1), bne(1, 0, -8),
+                                    csrrwi(0, 0x002, 7), jal(0, -16)}),
+         4, 1 + 60 * 3 + 2},
+  };
+
+  for (auto& c : cases) {
+    for_each_engine(c.program, [&](CPU& cpu, std::string what) {
+      what = str(c.name, " ", what);
+      auto faulted = false;
+      try {
+        cpu.steps(1000);
+      } catch (const Fault&) {
+        faulted = true;
+      }
+      check(faulted, what, "no fault");
+      check(cpu.pc == c.pc, what, "pc ", to_hex(cpu.pc), ", expected ", to_hex(c.pc));
+      check(cpu.executed == c.executed, what, "executed ", cpu.executed, ", expected ", c.executed);
+    });
+  }
+
+  if (failures) return 1;
+  print("ok");
+}
@@ -0,0 +1,70 @@
+// F and D arithmetic gives the interpreter's results and flags on every engine:
+// NaN boxing, canonical NaNs, exception flags, frm and ties away from zero
+//
+//   g++ -std=c++23 -O2 -o fpu tests/fpu.cpp && ./fpu
+
+#include "guest.hpp"
+
+int main() {
+  // dmem: 1.0, 0.0, -1.0 and 3.0 as doubles, 1.0f and 3.0f. both loops run
+  // often enough to be translated, the second one rounds towards zero.
+  auto program = write_program({
+    addi(1, 0, 60), addi(2, 0, 60),
+    fld(1, 0, 0), fld(2, 0, 8), fld(3, 0, 16), fld(4, 0, 24), flw(11, 0, 32), flw(12, 0, 36),
+    fdiv_d(5, 1, 2),    // inf, DZ
+    fsqrt_d(6, 3),      // canonical NaN, NV
+    fdiv_d(7, 3, 4),    // NX
+    fadd_d(8, 1, 4), fsub_d(9, 2, 2), fmul_d(10, 4, 4),
+    fdiv_s(13, 11, 12), fsqrt_s(15, 12), fmul_s(16, 11, 12), fsub_s(17, 12, 11),
+    fadd_s(14, 1, 11),  // f1 isn't NaN boxed: canonical NaN
+    addi(1, 1, -1), bne(1, 0, -19 * 4),
+    csrrwi(0, 0x002, FPU::RM_RTZ),
+    fdiv_d(18, 3, 4), fdiv_s(19, 11, 12), addi(2, 2, -1), bne(2, 0, -3 * 4),
+    ebreak,
+  }, {0, 0x3ff00000, 0, 0, 0, 0xbff00000, 0, 0x40080000, 0x3f800000, 0x40400000});
+
+  auto ref = CPU(program);
+  ref.steps(10000);
+  auto flags = FPU::FLAG_DZ | FPU::FLAG_NV | FPU::FLAG_NX;
+  check(ref.halted, "interp didn't halt");
+  check((ref.fpu.fcsr & flags) == flags, "interp fcsr ", to_hex(ref.fpu.fcsr));
+  check(ref.fpu.f[14] == (FPU::boxed | FPU::nan_s) && ref.fpu.f[6] == FPU::nan_d, "interp NaNs");
+  check(ref.fpu.f[19] != ref.fpu.f[13], "interp ignored frm");
+
+  for_each_engine(program, [&](CPU& cpu, std::string what) {
+    cpu.steps(10000);
+    check(cpu.halted, what, "didn't halt");
+    if (cpu.engine == CPU::ENGINE_JIT) check(!cpu.jit.blocks.empty(), what, "nothing translated");
+    check(cpu.fpu.fcsr == ref.fpu.fcsr, what, "fcsr ", to_hex(cpu.fpu.fcsr), ", expected ", to_hex(ref.fpu.fcsr));
+    for (u32 r = 0; r < 32; r++) {
+      check(cpu.fpu.f[r] == ref.fpu.f[r], what, "f", r, " ", cpu.fpu.f[r], ", expected ", ref.fpu.f[r]);
+    }
+  });
+
+  // dmem: 1.0, 2^-53 and -1.0 as doubles, 1.0f and 2^-24f, and 1 + 2^-24 as
+  // a double. every result is a tie that RMM rounds up in magnitude. fflags
+  // is read after them, then cleared, and the loop ends with exact arithmetic.
+  auto ties = write_program({
+    csrrwi(0, 0x002, FPU::RM_RMM), addi(1, 0, 60),
+    fld(1, 0, 0), fld(2, 0, 8), fld(3, 0, 16), flw(4, 0, 24), flw(5, 0, 28), fld(10, 0, 32),
+    fadd_d(6, 1, 2), fsub_d(7, 3, 2), fadd_s(8, 4, 5), fcvt_s_d(9, 10),
+    csrrs(3, 0x001, 0), csrrwi(0, 0x001, 0), fadd_d(11, 1, 1),
+    addi(1, 1, -1), bne(1, 0, -14 * 4),
+    ebreak,
+  }, {0, 0x3ff00000, 0, 0x3ca00000, 0, 0xbff00000, 0x3f800000, 0x33800000, 0x10000000, 0x3ff00000});
+
+  for_each_engine(ties, [&](CPU& cpu, std::string what) {
+    what = str("ties ", what);
+    cpu.steps(10000);
+    check(cpu.halted, what, "didn't halt");
+    check(cpu.fpu.f[6] == 0x3ff0000000000001 && cpu.fpu.f[7] == 0xbff0000000000001, what, "doubles ",
+          cpu.fpu.f[6], " ", cpu.fpu.f[7]);
+    check(cpu.fpu.f[8] == (FPU::boxed | 0x3f800001) && cpu.fpu.f[9] == (FPU::boxed | 0x3f800001), what, "singles ",
+          cpu.fpu.f[8], " ", cpu.fpu.f[9]);
+    check(cpu.regs[3] == FPU::FLAG_NX, what, "fflags read ", cpu.regs[3]);
+    check(cpu.fpu.fcsr == FPU::RM_RMM << 5, what, "fcsr ", to_hex(cpu.fpu.fcsr));
+  });
+
+  if (failures) return 1;
+  print("ok");
+}
@@ -0,0 +1,60 @@
+// a fused pair of the threaded engine that faults in either half leaves the
+// interpreter's state: pc on the faulting instruction, executed up to it and
+// the first half's rd written only if the first half ran
+//
+//   g++ -std=c++23 -O2 -o fusion tests/fusion.cpp && ./fusion
+
+#include "guest.hpp"
+
+int main() {
+  // x2 = 0xffffffff is outside of dmem, dmem word 1 is 0x1234. every pair
+  // is one of T_FUSIONS, rd and value are the first half's
+  struct Case { const char* name; std::string program; u32 pc; u64 executed; u32 rd, value; };
+  auto cases = {
+    Case{"lw+lw, first",    write_program({addi(2, 0, -1), lw(4, 2, 0), lw(5, 0, 4), ebreak}, {0, 0x1234}),
+         4, 1, 4, 0},
+    Case{"lw+lw, second",   write_program({addi(2, 0, -1), lw(4, 0, 4), lw(5, 2, 0), ebreak}, {0, 0x1234}),
+         8, 2, 4, 0x1234},
+    Case{"sw+addi",         write_program({addi(2, 0, -1), addi(1, 0, 7), sw(1, 2, 0), addi(1, 1, 1), ebreak}),
+         8, 2, 1, 7},
+    Case{"sb+addi",         write_program({addi(2, 0, -1), addi(1, 0, 7), sb(1, 2, 0), addi(1, 1, 1), ebreak}),
+         8, 2, 1, 7},
+    Case{"lbu+bne, first",  write_program({addi(2, 0, -1), lbu(4, 2, 0), bne(4, 0, 8), ebreak, ebreak}),
+         4, 1, 4, 0},
+  };
+
+  auto run = [](CPU& cpu) {
+    try {
+      cpu.steps(100);
+    } catch (const Fault&) {
+      return true;
+    }
+    return false;
+  };
+
+  for (auto& c : cases) {
+    auto ref = CPU(c.program);
+    check(run(ref), c.name, " interp: no fault");
+    check(ref.pc == c.pc && ref.executed == c.executed, c.name, " interp: pc ", to_hex(ref.pc), ", executed ",
+          ref.executed);
+    check(ref.regs[c.rd] == c.value, c.name, " interp: x", c.rd, " ", to_hex(ref.regs[c.rd]));
+
+    for (auto guard_pages : { false, true }) {
+      auto config = Config();
+      config.guard_pages = guard_pages;
+      auto cpu = CPU(c.program, config);
+      cpu.engine = CPU::ENGINE_THREADED;
+      auto what = str(c.name, " threaded", guard_pages ? " guarded" : "", ": ");
+
+      check(run(cpu), what, "no fault");
+      check(cpu.pc == ref.pc, what, "pc ", to_hex(cpu.pc), ", expected ", to_hex(ref.pc));
+      check(cpu.executed == ref.executed, what, "executed ", cpu.executed, ", expected ", ref.executed);
+      for (u32 r = 0; r < 32; r++) {
+        check(cpu.regs[r] == ref.regs[r], what, "x", r, " ", to_hex(cpu.regs[r]), ", expected ", to_hex(ref.regs[r]));
+      }
+    }
+  }
+
+  if (failures) return 1;
+  print("ok");
+}
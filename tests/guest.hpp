@@ -0,0 +1,128 @@
+#ifndef TESTS_GUEST_HPP
+#define TESTS_GUEST_HPP
+
+// hand assembled guest programs for the tests
+
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include "../src/cpu.hpp"
+
+constexpr u32 i_type(u32 opcode, u32 funct3, u32 rd, u32 rs1, i32 imm) {
+  return u32(imm) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+constexpr u32 s_type(u32 opcode, u32 funct3, u32 rs2, u32 rs1, i32 imm) {
+  return (u32(imm) >> 5) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | (u32(imm) & 31) << 7 | opcode;
+}
+
+constexpr u32 lui(u32 rd, u32 imm)           { return imm << 12 | rd << 7 | 0x37; }
+constexpr u32 add(u32 rd, u32 rs1, u32 rs2)  { return rs2 << 20 | rs1 << 15 | rd << 7 | 0x33; }
+constexpr u32 jal(u32 rd, i32 offset) {
+  auto x = u32(offset);
+  return (x >> 20 & 1) << 31 | (x >> 1 & 0x3ff) << 21 | (x >> 11 & 1) << 20 | (x >> 12 & 0xff) << 12
+       | rd << 7 | 0x6f;
+}
+constexpr u32 addi(u32 rd, u32 rs1, i32 imm) { return i_type(0x13, 0, rd, rs1, imm); }
+constexpr u32 lw(u32 rd, u32 rs1, i32 imm)   { return i_type(0x03, 2, rd, rs1, imm); }
+constexpr u32 sw(u32 rs2, u32 rs1, i32 imm)  { return s_type(0x23, 2, rs2, rs1, imm); }
+constexpr u32 lbu(u32 rd, u32 rs1, i32 imm)  { return i_type(0x03, 4, rd, rs1, imm); }
+constexpr u32 sb(u32 rs2, u32 rs1, i32 imm)  { return s_type(0x23, 0, rs2, rs1, imm); }
+constexpr u32 flw(u32 rd, u32 rs1, i32 imm)  { return i_type(0x07, 2, rd, rs1, imm); }
+constexpr u32 fsw(u32 rs2, u32 rs1, i32 imm) { return s_type(0x27, 2, rs2, rs1, imm); }
+constexpr u32 r_type(u32 opcode, u32 funct3, u32 funct7, u32 rd, u32 rs1, u32 rs2) {
+  return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+constexpr u32 b_type(u32 funct3, u32 rs1, u32 rs2, i32 offset) {
+  auto x = u32(offset);
+  return (x >> 12 & 1) << 31 | (x >> 5 & 0x3f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12
+       | (x >> 1 & 0xf) << 8 | (x >> 11 & 1) << 7 | 0x63;
+}
+constexpr u32 beq(u32 rs1, u32 rs2, i32 offset)   { return b_type(0, rs1, rs2, offset); }
+constexpr u32 bne(u32 rs1, u32 rs2, i32 offset)   { return b_type(1, rs1, rs2, offset); }
+constexpr u32 jalr(u32 rd, u32 rs1, i32 imm)      { return i_type(0x67, 0, rd, rs1, imm); }
+constexpr u32 csrrwi(u32 rd, u32 csr, u32 uimm)   { return i_type(0x73, 5, rd, uimm, i32(csr)); }
+constexpr u32 csrrs(u32 rd, u32 csr, u32 rs1)     { return i_type(0x73, 2, rd, rs1, i32(csr)); }
+constexpr u32 csrrc(u32 rd, u32 csr, u32 rs1)     { return i_type(0x73, 3, rd, rs1, i32(csr)); }
+constexpr u32 csrrsi(u32 rd, u32 csr, u32 uimm)   { return i_type(0x73, 6, rd, uimm, i32(csr)); }
+constexpr u32 csrrci(u32 rd, u32 csr, u32 uimm)   { return i_type(0x73, 7, rd, uimm, i32(csr)); }
+
+// F and D arithmetic, rounding by frm
+constexpr u32 fp_op(u32 funct7, u32 rd, u32 rs1, u32 rs2) { return r_type(0x53, 7, funct7, rd, rs1, rs2); }
+constexpr u32 fadd_s(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x00, rd, rs1, rs2); }
+constexpr u32 fsub_s(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x04, rd, rs1, rs2); }
+constexpr u32 fmul_s(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x08, rd, rs1, rs2); }
+constexpr u32 fdiv_s(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x0c, rd, rs1, rs2); }
+constexpr u32 fsqrt_s(u32 rd, u32 rs1)            { return fp_op(0x2c, rd, rs1, 0); }
+constexpr u32 fadd_d(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x01, rd, rs1, rs2); }
+constexpr u32 fsub_d(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x05, rd, rs1, rs2); }
+constexpr u32 fmul_d(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x09, rd, rs1, rs2); }
+constexpr u32 fdiv_d(u32 rd, u32 rs1, u32 rs2)    { return fp_op(0x0d, rd, rs1, rs2); }
+constexpr u32 fsqrt_d(u32 rd, u32 rs1)            { return fp_op(0x2d, rd, rs1, 0); }
+constexpr u32 fcvt_s_d(u32 rd, u32 rs1)           { return fp_op(0x20, rd, rs1, 1); }
+constexpr u32 fmv_w_x(u32 rd, u32 rs1)            { return r_type(0x53, 0, 0x78, rd, rs1, 0); }
+constexpr u32 fld(u32 rd, u32 rs1, i32 imm)       { return i_type(0x07, 3, rd, rs1, imm); }
+
+// V, unmasked
+constexpr u32 vsetvli(u32 rd, u32 rs1, u32 vtype) { return i_type(0x57, 7, rd, rs1, i32(vtype)); }
+constexpr u32 vmv_v_i(u32 vd, i32 imm)            { return r_type(0x57, 3, 0x2f, vd, u32(imm) & 31, 0); }
+constexpr u32 vle8_v(u32 vd, u32 rs1)             { return r_type(0x07, 0, 0x01, vd, rs1, 0); }
+constexpr u32 vlse8_v(u32 vd, u32 rs1, u32 rs2)   { return r_type(0x07, 0, 0x05, vd, rs1, rs2); }
+constexpr u32 vse8_v(u32 vs3, u32 rs1)            { return r_type(0x27, 0, 0x01, vs3, rs1, 0); }
+constexpr u32 vadd_vi(u32 vd, u32 vs2, i32 imm)   { return r_type(0x57, 3, 0x01, vd, u32(imm) & 31, vs2); }
+
+constexpr u32 ecall  = 0x00000073;
+constexpr u32 ebreak = 0x00100073;
+
+// removed when the test exits
+struct TempDirs {
+  std::vector<std::string> dirs;
+  ~TempDirs() { for (auto& dir : dirs) std::filesystem::remove_all(dir); }
+} temp_dirs;
+
+// writes words as instruction_mem.bin and data as data_mem.bin into a new
+// temporary directory, returns it with a trailing slash
+std::string write_program(std::initializer_list<u32> words, const std::vector<u32>& data = {0}) {
+  char dir[] = "/tmp/rvvm-test-XXXXXX";
+  if (!mkdtemp(dir)) die("mkdtemp() failed");
+  auto write = [&](const char* name, const auto& w) {
+    auto file = std::ofstream(std::string(dir) + "/" + name, std::ios::binary);
+    file.write((const char*)std::data(w), w.size() * sizeof(u32));
+  };
+  write("instruction_mem.bin", words);
+  write("data_mem.bin", data);
+  temp_dirs.dirs.push_back(dir);
+  return std::string(dir) + "/";
+}
+
+// calls body(engine, config, what) for every engine with and without guard
+// pages, what names the combination for check()
+void for_each_config(auto body) {
+  auto names = std::array{ "interp", "threaded", "jit" };
+  for (auto engine : { CPU::ENGINE_INTERP, CPU::ENGINE_THREADED, CPU::ENGINE_JIT }) {
+    for (auto guard_pages : { false, true }) {
+      auto config = Config();
+      config.guard_pages = guard_pages;
+      body(engine, config, str(names[engine], guard_pages ? " guarded" : "", ": "));
+    }
+  }
+}
+
+// calls body(cpu, what) with a new CPU running program for every engine
+// with and without guard pages
+void for_each_engine(const std::string& program, auto body) {
+  for_each_config([&](CPU::Engine engine, const Config& config, std::string what) {
+    auto cpu = CPU(program, config);
+    cpu.engine = engine;
+    body(cpu, what);
+  });
+}
+
+int failures = 0;
+
+void check(bool ok, const auto&... what) {
+  if (ok) return;
+  print("FAIL: ", what...);
+  failures++;
+}
+
+#endif // #ifndef TESTS_GUEST_HPP
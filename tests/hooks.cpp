@@ -0,0 +1,50 @@
+// stats and traces see vector loads and stores: one access of all the bytes
+// moved, traced with its first element
+//
+//   g++ -std=c++23 -O2 -o hooks tests/hooks.cpp -lz && ./hooks
+
+#include "guest.hpp"
+#include "../src/trace.hpp"
+
+int main() {
+  // 0x5a at 0x100, then 16 bytes (e8, VLMAX at VLEN 128) loaded from 0x100,
+  // every other byte from 0x100 and 16 bytes stored at 0x200
+  auto program = write_program({addi(6, 0, 0x5a), addi(2, 0, 0x100), sb(6, 2, 0), vsetvli(5, 0, 0),
+                                vle8_v(1, 2), addi(7, 0, 2), vlse8_v(2, 2, 7), addi(3, 0, 0x200), vse8_v(1, 3),
+                                ebreak});
+  auto vector = std::map<u32, std::pair<u32, u32>>{{16, {0x100, 0x5a}}, {24, {0x100, 0x5a}}, {32, {0x200, 0x5a}}};
+
+  auto runs = 0;
+  for_each_engine(program, [&](CPU& cpu, std::string what) {
+    auto file = str(program, "trace.", runs++);
+    {
+      auto trace = TraceWriter(file);
+      cpu.enable_stats();
+      cpu.tracer = trace.tracer();
+      cpu.steps(100);
+      cpu.tracer.reset();
+    }
+    check(cpu.halted, what, "didn't halt");
+
+    auto& stats = *cpu.stats;
+    check(stats.loads == std::array<u64, 5>{0, 0, 0, 0, 2} && stats.load_bytes == 32, what, "loads ",
+          stats.to_json());
+    check(stats.stores == std::array<u64, 5>{1, 0, 0, 0, 1} && stats.store_bytes == 17, what, "stores ",
+          stats.to_json());
+
+    auto reader = TraceReader(file);
+    auto seen = 0;
+    for (auto r = TraceRecord(); reader.next(r); ) {
+      auto it = vector.find(r.pc);
+      if (it == vector.end()) continue;
+      seen++;
+      auto [addr, value] = it->second;
+      check(r.addr == addr && r.value == value, what, "record @", to_hex(r.pc), ": ", to_hex(r.addr), " ",
+            to_hex(r.value));
+    }
+    check(seen == 3, what, seen, " vector records");
+  });
+
+  if (failures) return 1;
+  print("ok");
+}
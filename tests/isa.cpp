@@ -0,0 +1,234 @@
+// instruction semantics against known results, on every engine: RV32M
+// multiplies and the division edge cases, every Zba and Zbb operation, the
+// expansion of each RV32C format and the CSR instructions on read only and
+// vector CSRs
+//
+//   g++ -std=c++23 -O2 -o isa tests/isa.cpp && ./isa
+
+#include "guest.hpp"
+
+// x3 = op(x1, x2) with x1 = a and x2 = b loaded from memory, so the JIT
+// can't fold them, in a loop that runs long enough to get translated
+std::string hot_loop(u32 inst, u32 a, u32 b) {
+  return write_program({lw(1, 0, 0), lw(2, 0, 4), addi(4, 0, 2 * JIT::hot), inst, addi(4, 4, -1), bne(4, 0, -8),
+                        ebreak}, {a, b});
+}
+
+// runs hot_loop() on every engine and checks x3, setup(cpu) comes first
+// and how says what it changed
+void check_hot_loop(Instruction op, u32 inst, u32 a, u32 b, u32 result, const char* how = "",
+                    std::function<void(CPU&)> setup = [](CPU&) {}) {
+  auto name = str(inst_names[op], " ", to_hex(a), " ", to_hex(b), " ", how);
+  check(decode(inst) == op, name, "encodes as ", inst_names[decode(inst)]);
+  for_each_engine(hot_loop(inst, a, b), [&](CPU& cpu, std::string what) {
+    what = name + what;
+    setup(cpu);
+    cpu.steps(1000);
+    check(cpu.halted, what, "didn't halt");
+    check(cpu.regs[3] == result, what, to_hex(cpu.regs[3]), ", expected ", to_hex(result));
+    check(cpu.engine != CPU::ENGINE_JIT || !cpu.jit.blocks.empty(), what, "nothing translated");
+  });
+}
+
+// op x3, x1, x2 of Zba and Zbb, op x3, x1 of the unary ones and
+// rori x3, x1, shamt
+u32 encode_bitmanip(Instruction op, u32 shamt) {
+  auto r = [](u32 funct3, u32 funct7) { return r_type(OPCODE_OP, funct3, funct7, 3, 1, 2); };
+  auto unary = [](u32 funct3, u32 funct12) { return i_type(OPCODE_OP_IMM, funct3, 3, 1, i32(funct12)); };
+  switch (op) {
+  case SH1ADD: return r(FUNCT3_SH1ADD, FUNCT7_SHADD);
+  case SH2ADD: return r(FUNCT3_SH2ADD, FUNCT7_SHADD);
+  case SH3ADD: return r(FUNCT3_SH3ADD, FUNCT7_SHADD);
+  case ANDN:   return r(FUNCT3_ANDN, FUNCT7_ANDN);
+  case ORN:    return r(FUNCT3_ORN, FUNCT7_ANDN);
+  case XNOR:   return r(FUNCT3_XNOR, FUNCT7_ANDN);
+  case MAX:    return r(FUNCT3_MAX, FUNCT7_MINMAX);
+  case MAXU:   return r(FUNCT3_MAXU, FUNCT7_MINMAX);
+  case MIN:    return r(FUNCT3_MIN, FUNCT7_MINMAX);
+  case MINU:   return r(FUNCT3_MINU, FUNCT7_MINMAX);
+  case ROL:    return r(FUNCT3_ROL, FUNCT7_ROTATE);
+  case ROR:    return r(FUNCT3_ROR, FUNCT7_ROTATE);
+  case RORI:   return unary(FUNCT3_SRAI_SRLI, FUNCT7_ROTATE << 5 | shamt);
+  case CLZ:    return unary(FUNCT3_SLLI, FUNCT12_CLZ);
+  case CTZ:    return unary(FUNCT3_SLLI, FUNCT12_CTZ);
+  case CPOP:   return unary(FUNCT3_SLLI, FUNCT12_CPOP);
+  case SEXT_B: return unary(FUNCT3_SLLI, FUNCT12_SEXT_B);
+  case SEXT_H: return unary(FUNCT3_SLLI, FUNCT12_SEXT_H);
+  case ZEXT_H: return r_type(OPCODE_OP, FUNCT3_ZEXT_H, FUNCT7_ZEXT_H, 3, 1, 0);
+  case ORC_B:  return unary(FUNCT3_SRAI_SRLI, FUNCT12_ORC_B);
+  case REV8:   return unary(FUNCT3_SRAI_SRLI, FUNCT12_REV8);
+  default:     return 0; // decodes as UNDEF, check_hot_loop() says so
+  }
+}
+
+int main() {
+  // the shared helper and each engine's own code, on the JIT the x86 div
+  // and idiv with the branches around 0 and -1. division doesn't trap: by zero the quotient is all ones and the
+  // remainder the dividend, -2^31 / -1 overflows to the dividend and 0
+  struct MulDiv { Instruction op; u32 a, b, result; };
+  auto muldivs = {
+    MulDiv{DIV,    7,          0,          0xffffffff},
+    MulDiv{DIVU,   7,          0,          0xffffffff},
+    MulDiv{REM,    7,          0,          7},
+    MulDiv{REMU,   7,          0,          7},
+    MulDiv{DIV,    0x80000000, 0xffffffff, 0x80000000},
+    MulDiv{REM,    0x80000000, 0xffffffff, 0},
+    MulDiv{DIVU,   0x80000000, 0xffffffff, 0},
+    MulDiv{REMU,   0x80000000, 0xffffffff, 0x80000000},
+    MulDiv{DIV,    u32(-7),    2,          u32(-3)}, // rounds towards zero
+    MulDiv{REM,    u32(-7),    2,          u32(-1)}, // takes the dividend's sign
+    MulDiv{DIV,    7,          u32(-2),    u32(-3)},
+    MulDiv{REM,    7,          u32(-2),    1},
+    MulDiv{MUL,    0x80000000, 0xffffffff, 0x80000000},
+    MulDiv{MULH,   0x80000000, 0x80000000, 0x40000000},
+    MulDiv{MULH,   0xffffffff, 0xffffffff, 0},
+    MulDiv{MULHSU, 0xffffffff, 0xffffffff, 0xffffffff},
+    MulDiv{MULHU,  0xffffffff, 0xffffffff, 0xfffffffe},
+  };
+  for (auto& c : muldivs) {
+    auto x = muldiv(c.op, c.a, c.b);
+    check(x == c.result, inst_names[c.op], " ", to_hex(c.a), " ", to_hex(c.b), ": ", to_hex(x),
+          ", expected ", to_hex(c.result));
+    auto inst = r_type(OPCODE_OP, c.op - MUL, FUNCT7_MULDIV, 3, 1, 2);
+    check_hot_loop(c.op, inst, c.a, c.b, c.result);
+  }
+
+  // b is rs2, or the shift amount of RORI. unary ones ignore it. on the JIT
+  // both with the host's lzcnt, tzcnt and popcnt and with the bsr, bsf and
+  // bit counting fallbacks. ORC_B is pcmpeqb there
+  struct Bitmanip { Instruction op; u32 a, b, result; };
+  auto bitmanips = {
+    Bitmanip{SH1ADD, 3,          5,          11},
+    Bitmanip{SH2ADD, 3,          5,          17},
+    Bitmanip{SH3ADD, 0x20000000, 5,          5},
+    Bitmanip{ANDN,   0xff00ff00, 0x0ff00ff0, 0xf000f000},
+    Bitmanip{ORN,    0x0000000f, 0xffff0000, 0x0000ffff},
+    Bitmanip{XNOR,   0xf0f0f0f0, 0xff00ff00, 0xf00ff00f},
+    Bitmanip{MAX,    0xffffffff, 1,          1},
+    Bitmanip{MAXU,   0xffffffff, 1,          0xffffffff},
+    Bitmanip{MIN,    0xffffffff, 1,          0xffffffff},
+    Bitmanip{MINU,   0xffffffff, 1,          1},
+    Bitmanip{ROL,    0x80000001, 33,         0x00000003}, // only the low 5 bits of b count
+    Bitmanip{ROR,    0x80000001, 1,          0xc0000000},
+    Bitmanip{RORI,   0x12345678, 4,          0x81234567},
+    Bitmanip{CLZ,    0x00010000, 0,          15},
+    Bitmanip{CLZ,    0,          0,          32},
+    Bitmanip{CTZ,    0x00010000, 0,          16},
+    Bitmanip{CTZ,    0,          0,          32},
+    Bitmanip{CPOP,   0xf0f0f0f1, 0,          17},
+    Bitmanip{SEXT_B, 0x12345680, 0,          0xffffff80},
+    Bitmanip{SEXT_H, 0x12348000, 0,          0xffff8000},
+    Bitmanip{ZEXT_H, 0xffff1234, 0,          0x00001234},
+    Bitmanip{ORC_B,  0x00ff0180, 0,          0x00ffffff},
+    Bitmanip{ORC_B,  0x01000080, 0,          0xff0000ff},
+    Bitmanip{ORC_B,  0,          0,          0},
+    Bitmanip{REV8,   0x12345678, 0,          0x78563412},
+  };
+  for (auto& c : bitmanips) {
+    auto x = bitmanip(c.op, c.a, c.b);
+    check(x == c.result, inst_names[c.op], " ", to_hex(c.a), " ", to_hex(c.b), ": ", to_hex(x),
+          ", expected ", to_hex(c.result));
+    auto inst = encode_bitmanip(c.op, c.b);
+    check_hot_loop(c.op, inst, c.a, c.b, c.result);
+    check_hot_loop(c.op, inst, c.a, c.b, c.result, "without lzcnt, tzcnt and popcnt ", [](CPU& cpu) {
+      cpu.jit.lzcnt = cpu.jit.tzcnt = cpu.jit.popcnt = false;
+    });
+  }
+
+  // instructions of every format in the order CIW, CL, CS, CI, CSS, CR, CB,
+  // CA and CJ, then reserved encodings, which expand to 0 (illegal)
+  struct Expand { const char* name; u32 c, inst; };
+  auto expansions = {
+    Expand{"c.addi4spn s0, sp, 16",            0x0800, 0x01010413},
+    Expand{"c.lw a0, 4(a1)",                   0x41c8, 0x0045a503},
+    Expand{"c.fld fa0, 8(a1)",                 0x2588, 0x0085b507},
+    Expand{"c.flw fa0, 4(a1)",                 0x61c8, 0x0045a507},
+    Expand{"c.sw a0, 4(a1)",                   0xc1c8, 0x00a5a223},
+    Expand{"c.fsd fa0, 8(a1)",                 0xa588, 0x00a5b427},
+    Expand{"c.fsw fa0, 4(a1)",                 0xe1c8, 0x00a5a227},
+    Expand{"c.nop",                            0x0001, 0x00000013},
+    Expand{"c.addi a0, -3",                    0x1575, 0xffd50513},
+    Expand{"c.li a0, 31",                      0x457d, 0x01f00513},
+    Expand{"c.addi16sp -64",                   0x7139, 0xfc010113},
+    Expand{"c.lui a0, 0x1f",                   0x657d, 0x0001f537},
+    Expand{"c.slli a0, 31",                    0x057e, 0x01f51513},
+    Expand{"c.lwsp a0, 252(sp)",               0x557e, 0x0fc12503},
+    Expand{"c.fldsp fa0, 8(sp)",               0x2522, 0x00813507},
+    Expand{"c.flwsp fa0, 4(sp)",               0x6512, 0x00412507},
+    Expand{"c.swsp a0, 252(sp)",               0xdfaa, 0x0ea12e23},
+    Expand{"c.fsdsp fa0, 8(sp)",               0xa42a, 0x00a13427},
+    Expand{"c.fswsp fa0, 4(sp)",               0xe22a, 0x00a12227},
+    Expand{"c.jr ra",                          0x8082, 0x00008067},
+    Expand{"c.jalr a0",                        0x9502, 0x000500e7},
+    Expand{"c.mv a0, a1",                      0x852e, 0x00b00533},
+    Expand{"c.add a0, a1",                     0x952e, 0x00b50533},
+    Expand{"c.ebreak",                         0x9002, 0x00100073},
+    Expand{"c.beqz s0, -4",                    0xdc75, 0xfe040ee3},
+    Expand{"c.bnez s1, 254",                   0xecfd, 0x0e049f63},
+    Expand{"c.srli s0, 3",                     0x800d, 0x00345413},
+    Expand{"c.srai s0, 31",                    0x847d, 0x41f45413},
+    Expand{"c.andi s0, -1",                    0x987d, 0xfff47413},
+    Expand{"c.sub s0, s1",                     0x8c05, 0x40940433},
+    Expand{"c.xor s0, s1",                     0x8c25, 0x00944433},
+    Expand{"c.or s0, s1",                      0x8c45, 0x00946433},
+    Expand{"c.and s0, s1",                     0x8c65, 0x00947433},
+    Expand{"c.jal 64",                         0x2081, 0x040000ef},
+    Expand{"c.j -2",                           0xbffd, 0xfffff06f},
+    Expand{"c.addi4spn with a zero immediate", 0x0000, 0x00000000},
+    Expand{"c.addi16sp with a zero immediate", 0x6101, 0x00000000},
+    Expand{"c.lui with a zero immediate",      0x6501, 0x00000000},
+    Expand{"c.lwsp to x0",                     0x4002, 0x00000000},
+    Expand{"c.jr of x0",                       0x8002, 0x00000000},
+    Expand{"c.srli with shamt[5] set, RV64",   0x9001, 0x00000000},
+    Expand{"c.slli with shamt[5] set, RV64",   0x1002, 0x00000000},
+    Expand{"c.subw, RV64",                     0x9c01, 0x00000000},
+    Expand{"quadrant 0, funct3 4",             0x8000, 0x00000000},
+  };
+  for (auto& c : expansions) {
+    auto x = expand(c.c);
+    check(x == c.inst, c.name, ": ", to_hex(x), ", expected ", to_hex(c.inst));
+  }
+
+  // CSRRS and CSRRC of x0 and CSRRSI and CSRRCI of 0 only read, also read
+  // only CSRs. vxrm and vxsat are fields of vcsr, vstart takes 0
+  auto reads = write_program({csrrs(1, CSR_CYCLE, 0), csrrc(2, CSR_INSTRET, 0), csrrsi(3, CSR_VLENB, 0),
+                              csrrci(4, CSR_INSTRETH, 0), csrrwi(0, CSR_VXRM, 2), csrrwi(0, CSR_VXSAT, 1),
+                              csrrs(5, CSR_VCSR, 0), csrrwi(0, CSR_VSTART, 0), csrrs(6, CSR_VSTART, 0), ebreak});
+  for_each_engine(reads, [&](CPU& cpu, std::string what) {
+    what = str("csr reads ", what);
+    cpu.steps(100);
+    check(cpu.halted, what, "didn't halt");
+    check(cpu.regs[1] == 0 && cpu.regs[2] == 1 && cpu.regs[4] == 0, what, "cycle ", cpu.regs[1], ", instret ",
+          cpu.regs[2], ", instreth ", cpu.regs[4]);
+    check(cpu.regs[3] == Config().vlen / 8, what, "vlenb ", cpu.regs[3]);
+    check(cpu.regs[5] == 5 && cpu.regs[6] == 0, what, "vcsr ", cpu.regs[5], ", vstart ", cpu.regs[6]);
+  });
+
+  // anything else that would write a read only CSR is illegal, also when
+  // it writes the value the CSR has. x5 is 0
+  struct Write { const char* name; u32 inst; };
+  auto writes = {
+    Write{"csrrs cycle x5",    csrrs(1, CSR_CYCLE, 5)},
+    Write{"csrrc time x5",     csrrc(1, CSR_TIME, 5)},
+    Write{"csrrsi instret 1",  csrrsi(1, CSR_INSTRET, 1)},
+    Write{"csrrci cycleh 1",   csrrci(1, CSR_CYCLEH, 1)},
+    Write{"csrrwi vlenb 0",    csrrwi(0, CSR_VLENB, 0)},
+    Write{"csrrwi vstart 1",   csrrwi(0, CSR_VSTART, 1)},
+  };
+  for (auto& c : writes) {
+    for_each_engine(write_program({addi(1, 0, 1), c.inst, ebreak}), [&](CPU& cpu, std::string what) {
+      what = str(c.name, " ", what);
+      auto faulted = false;
+      try {
+        cpu.steps(100);
+      } catch (const Fault&) {
+        faulted = true;
+      }
+      check(faulted, what, "no fault");
+      check(cpu.pc == 4 && cpu.executed == 1, what, "pc ", to_hex(cpu.pc), ", executed ", cpu.executed);
+    });
+  }
+
+  if (failures) return 1;
+  print("ok");
+}
@@ -0,0 +1,71 @@
+// the JIT's inline caches and return address stack against the
+// interpreter: a call chain deeper than the stack, returns that don't go
+// where their call pushed, compressed calls, and all of that with an arena
+// small enough to be flushed in the middle of the chain
+//
+//   g++ -std=c++23 -O2 -o jit tests/jit.cpp && ./jit
+
+#include "guest.hpp"
+
+int main() {
+  // x8 counts down the outer loop. f recurses 20 deep, past the 16 entries
+  // of the stack, and counts its calls in x19. g returns one instruction
+  // past its call site, x18 counts what runs after it. h is called by
+  // c.jalr, returns to pc + 2 and counts its calls in x9
+  constexpr u32 f = 12 * 4, h = 23 * 4;
+  auto program = write_program({
+    addi(2, 0, 1024),            //  0: sp
+    addi(8, 0, 100),             //  1
+    addi(11, 0, h),              //  2
+    addi(10, 0, 20),             //  3: loop
+    jal(1, f - 4 * 4),           //  4: call f
+    jal(1, 21 * 4 - 5 * 4),      //  5: call g
+    addi(18, 18, 1000),          //  6: skipped by g
+    addi(18, 18, 1),             //  7
+    0x9582 | 0x0001 << 16,       //  8: c.jalr a1; c.nop
+    addi(8, 8, -1),              //  9
+    bne(8, 0, 3 * 4 - 10 * 4),   // 10
+    ebreak,                      // 11
+    addi(19, 19, 1),             // 12: f
+    beq(10, 0, 20 * 4 - 13 * 4), // 13
+    addi(2, 2, -4),              // 14
+    sw(1, 2, 0),                 // 15
+    addi(10, 10, -1),            // 16
+    jal(1, f - 17 * 4),          // 17
+    lw(1, 2, 0),                 // 18
+    addi(2, 2, 4),               // 19
+    jalr(0, 1, 0),               // 20
+    addi(1, 1, 4),               // 21: g
+    jalr(0, 1, 0),               // 22
+    addi(9, 9, 1),               // 23: h
+    jalr(0, 1, 0),               // 24
+  }, std::vector<u32>(256));
+
+  auto expected = CPU(program, Config());
+  expected.steps(1000000);
+  check(expected.halted, "interp didn't halt");
+  check(expected.regs[19] == 100 * 21 && expected.regs[18] == 100 && expected.regs[9] == 100, "interp: f ",
+        expected.regs[19], ", g ", expected.regs[18], ", h ", expected.regs[9]);
+
+  for (auto small : { false, true }) {
+    for_each_engine(program, [&](CPU& cpu, std::string what) {
+      what = str(small ? "small arena " : "", what);
+      // room for a few blocks above the trampolines
+      if (small) cpu.jit.capacity = cpu.jit.code - cpu.jit.arena + JIT::max_block_size + 1024;
+      cpu.steps(1000000);
+      check(cpu.halted, what, "didn't halt");
+      check(cpu.pc == expected.pc && cpu.executed == expected.executed, what, "pc ", to_hex(cpu.pc), ", executed ",
+            cpu.executed, ", expected ", to_hex(expected.pc), ", ", expected.executed);
+      for (u32 r = 1; r < 32; r++) {
+        check(cpu.regs[r] == expected.regs[r], what, "x", r, " ", to_hex(cpu.regs[r]), ", expected ",
+              to_hex(expected.regs[r]));
+      }
+      if (cpu.engine == CPU::ENGINE_JIT) {
+        check(!small || cpu.jit.flushes > 10, what, cpu.jit.flushes, " flushes");
+      }
+    });
+  }
+
+  if (failures) return 1;
+  print("ok");
+}
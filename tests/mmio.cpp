@@ -0,0 +1,27 @@
+// a device register reads what the device says, also right after a store to
+// it, on every engine. memory reads back what was stored.
+//
+//   g++ -std=c++23 -O2 -o mmio tests/mmio.cpp && ./mmio
+
+#include "guest.hpp"
+
+int main() {
+  // a loop that gets hot enough to be translated. it stores 65 to the
+  // console's unused byte at 0x5001, which reads as 0, and to memory at
+  // 0x100, and sums what it loads back from both into x7 and x8
+  auto program = write_program({lui(5, 5), addi(10, 0, 65), addi(6, 0, 60),
+                                sb(10, 5, 1), lbu(11, 5, 1), add(7, 7, 11),
+                                sw(10, 0, 0x100), lw(12, 0, 0x100), add(8, 8, 12),
+                                addi(6, 6, -1), bne(6, 0, -7 * 4), ebreak});
+
+  for_each_engine(program, [&](CPU& cpu, std::string what) {
+    cpu.steps(1000);
+    check(cpu.halted, what, "didn't halt");
+    check(cpu.regs[7] == 0, what, "device byte read back ", cpu.regs[7], " in total");
+    check(cpu.regs[8] == 60 * 65, what, "memory read back ", cpu.regs[8], " in total");
+    if (cpu.engine == CPU::ENGINE_JIT) check(!cpu.jit.blocks.empty(), what, "nothing translated");
+  });
+
+  if (failures) return 1;
+  print("ok");
+}
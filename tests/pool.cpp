@@ -0,0 +1,75 @@
+// pool instances are copy on write forks of the template, and release()
+// puts them back to the fork point
+//
+//   g++ -std=c++23 -O2 -o pool tests/pool.cpp && ./pool
+
+#include "guest.hpp"
+#include "../src/pool.hpp"
+
+auto word(const CPU& cpu, u32 addr) {
+  return *(const u32*)(cpu.dmem + addr);
+}
+
+auto vword(const CPU& cpu, u32 vreg) {
+  return *(const u32*)(cpu.vpu.v.data() + vreg * cpu.vpu.vlenb);
+}
+
+int main() {
+  constexpr u32 e8 = 0x00, e32 = 0x10; // LMUL 1, tail and mask undisturbed
+
+  // the template stores 42, puts it into f1 and sets every e32 element of
+  // v1 to 7 before the ecall. an instance loads it, stores 43 over it,
+  // divides f1 by zero into f4, which raises DZ in fflags, and switches to
+  // e8 to add 1 to every byte of v1
+  auto program = write_program({addi(1, 0, 42), fmv_w_x(1, 1), vsetvli(5, 0, e32), vmv_v_i(1, 7),
+                                sw(1, 0, 0x100), ecall,
+                                lw(2, 0, 0x100), addi(3, 2, 1), sw(3, 0, 0x100),
+                                fmv_w_x(2, 0), fdiv_s(4, 1, 2),
+                                vsetvli(5, 0, e8), vadd_vi(1, 1, 1), ebreak});
+  auto f1 = FPU::boxed | 42;
+  auto vlmax = Config().vlen / 32;
+
+  for_each_config([&](CPU::Engine engine, const Config& config, std::string what) {
+    auto pool = Pool(program, config, 1);
+    check(pool.state.pc == 24 && pool.state.executed == 6, what, "fork point pc ", pool.state.pc, ", executed ",
+          pool.state.executed);
+
+    auto a = pool.acquire();
+    a->engine = engine;
+    a->steps(100);
+    check(a->halted && a->regs[2] == 42 && word(*a, 0x100) == 43, what, "instance didn't run from the fork point");
+    check(a->fpu.f[4] != 0 && (a->fpu.fcsr & FPU::FLAG_DZ), what, "instance didn't divide f1 by zero");
+    check(a->vpu.vtype == e8 && vword(*a, 1) == 0x01010108, what, "instance didn't add to v1 as e8");
+    check(word(*pool.base, 0x100) == 42, what, "instance write reached the template");
+
+    // the prewarmed one is taken, this is a new fork
+    auto b = pool.acquire();
+    check(word(*b, 0x100) == 42, what, "new fork sees another instance's write");
+    check(b->fpu.f[1] == f1, what, "new fork lost the template's f registers");
+    check(b->vpu.vtype == e32 && b->vpu.vl == vlmax && vword(*b, 1) == 7, what, "new fork lost the template's vector state");
+
+    auto first = a.get();
+    pool.release(std::move(a));
+    auto c = pool.acquire();
+    check(c.get() == first, what, "release() didn't keep the instance warm");
+    check(!c->halted && c->pc == 24 && c->executed == 6, what, "reset pc ", c->pc, ", executed ", c->executed);
+    check(c->regs[1] == 42 && !c->regs[2] && !c->regs[3] && c->regs[5] == vlmax, what, "reset left registers behind");
+    check(word(*c, 0x100) == 42, what, "reset left the instance's write behind");
+    check(c->fpu.f[1] == f1 && !c->fpu.f[2] && !c->fpu.f[4] && !c->fpu.fcsr, what, "reset left FP state behind");
+    check(c->vpu.vtype == e32 && c->vpu.vl == vlmax && vword(*c, 1) == 7, what, "reset left vector state behind");
+
+    c->steps(100);
+    check(c->halted && c->regs[2] == 42 && word(*c, 0x100) == 43, what, "reset instance doesn't run again");
+    check(word(*b, 0x100) == 42 && word(*pool.base, 0x100) == 42, what, "reused instance write leaked");
+  });
+
+  // the fork point is the first store that overlaps the input region, also
+  // one that starts in front of it
+  auto input = write_program({addi(1, 0, 1), sw(1, 0, 0x200), ebreak});
+  auto pool = Pool(input, Config(), 0, 0x202, 4);
+  check(pool.state.pc == 4 && pool.state.executed == 1, "input fork point pc ", pool.state.pc, ", executed ",
+        pool.state.executed);
+
+  if (failures) return 1;
+  print("ok");
+}
@@ -0,0 +1,64 @@
+// every engine builds the same profile: calls and returns through ra and t0
+// in translated code, a chain deeper than the JIT's return address stack, a
+// return that doesn't go back to its call and a compressed call
+//
+//   g++ -std=c++23 -O2 -o profiler tests/profiler.cpp && ./profiler
+
+#include "guest.hpp"
+
+int main() {
+  // x8 counts down the outer loop. f recurses 20 deep and calls m through
+  // t0 before each return, like libgcc's millicode. g returns one
+  // instruction past its call site, h is called by c.jalr
+  constexpr u32 f = 11 * 4, m = 20 * 4, g = 22 * 4, h = 24 * 4;
+  auto program = write_program({
+    addi(2, 0, 1024),            //  0: sp
+    addi(8, 0, 100),             //  1
+    addi(11, 0, h),              //  2
+    addi(10, 0, 20),             //  3: loop
+    jal(1, f - 4 * 4),           //  4: call f
+    jal(1, g - 5 * 4),           //  5: call g
+    addi(18, 18, 1000),          //  6: skipped by g
+    0x9582 | 0x0001 << 16,       //  7: c.jalr a1; c.nop
+    addi(8, 8, -1),              //  8
+    bne(8, 0, 3 * 4 - 9 * 4),    //  9
+    ebreak,                      // 10
+    beq(10, 0, 18 * 4 - 11 * 4), // 11: f
+    addi(2, 2, -4),              // 12
+    sw(1, 2, 0),                 // 13
+    addi(10, 10, -1),            // 14
+    jal(1, f - 15 * 4),          // 15
+    lw(1, 2, 0),                 // 16
+    addi(2, 2, 4),               // 17
+    jal(5, m - 18 * 4),          // 18: call m when a0 is 0, or return
+    jalr(0, 1, 0),               // 19
+    addi(19, 19, 1),             // 20: m
+    jalr(0, 5, 0),               // 21
+    addi(1, 1, 4),               // 22: g
+    jalr(0, 1, 0),               // 23
+    addi(9, 9, 1),               // 24: h
+    jalr(0, 1, 0),               // 25
+  }, std::vector<u32>(256));
+
+  auto profile = [&](CPU& cpu) {
+    cpu.enable_profiler(7);
+    cpu.steps(1000000);
+    return cpu.profiler->folded();
+  };
+  auto interp = CPU(program, Config());
+  auto expected = profile(interp);
+  check(interp.halted, "interp didn't halt");
+  check(interp.profiler->depth == 1, "interp: depth ", interp.profiler->depth);
+
+  for_each_engine(program, [&](CPU& cpu, std::string what) {
+    auto folded = profile(cpu);
+    check(cpu.halted, what, "didn't halt");
+    check(cpu.executed == interp.executed && cpu.regs == interp.regs, what, "executed ", cpu.executed,
+          ", expected ", interp.executed);
+    check(folded == expected, what, "profile\n", folded, "expected\n", expected);
+    if (cpu.engine == CPU::ENGINE_JIT) check(cpu.jit.profiler && !cpu.jit.blocks.empty(), what, "not translated");
+  });
+
+  if (failures) return 1;
+  print("ok");
+}
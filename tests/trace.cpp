@@ -0,0 +1,79 @@
+// a trace reads back record for record, per stream, across chunk boundaries
+// and with columns stored compressed and as they are
+//
+//   g++ -std=c++23 -O2 -o trace tests/trace.cpp -lz && ./trace
+
+#include "guest.hpp"
+#include "../src/trace.hpp"
+
+int main() {
+  // two interleaved streams of a bit over two chunks each. pc, inst, addr
+  // and value run in loops and compress, rd is random and doesn't, so it
+  // gets stored as it is from the second chunk on
+  constexpr size_t n = 2 * TraceWriter::chunk_records + 1000;
+  auto file = write_program({ebreak}) + "trace";
+  auto expected = std::array<std::vector<TraceRecord>, 2>();
+  auto seed = u32(0x2545f491);
+  auto random = [&] {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+  };
+
+  {
+    auto writer = TraceWriter(file);
+    auto tracers = std::array{ writer.tracer(), writer.tracer() };
+    for (u32 i = 0; i < n; i++) {
+      for (u32 s = 0; s < 2; s++) {
+        auto pc = 0x1000 * (s + 1) + 4 * (i % 50);
+        auto r = TraceRecord{pc, pc * 0x9e3779b9, random(), i % 3 ? 0 : 0x10000 + 8 * i, i % 3 ? 0 : i * (s + 3)};
+        if (r.addr) tracers[s]->access(r.addr, r.value);
+        tracers[s]->retire(r.pc, r.inst, r.rd);
+        expected[s].push_back(r);
+      }
+    }
+  }
+
+  auto reader = TraceReader(file);
+  auto seen = std::array<size_t, 2>();
+  for (auto r = TraceRecord(); reader.next(r); ) {
+    auto s = reader.stream();
+    if (s >= 2 || seen[s] == n) {
+      check(false, "record past the end of stream ", s);
+      break;
+    }
+    auto& e = expected[s][seen[s]];
+    auto fields = std::array{ r.pc, r.inst, r.rd, r.addr, r.value };
+    auto want = std::array{ e.pc, e.inst, e.rd, e.addr, e.value };
+    for (size_t f = 0; f < trace_fields; f++) {
+      if (fields[f] != want[f]) {
+        check(false, "stream ", s, " record ", seen[s], " field ", f, ": ", to_hex(fields[f]), ", expected ",
+              to_hex(want[f]));
+      }
+    }
+    seen[s]++;
+    if (failures > 10) break;
+  }
+  check(seen[0] == n && seen[1] == n, "read ", seen[0], " and ", seen[1], " records, expected ", n);
+
+  // the chunks as written: more than one per stream, and both kinds of column
+  auto in = std::ifstream(file, std::ios::binary);
+  in.seekg(sizeof(trace_magic) + sizeof(trace_version));
+  auto chunks = std::array<size_t, 2>();
+  auto raw = 0, compressed = 0;
+  for (auto header = TraceChunk(); in.read((char*)&header, sizeof(header)); ) {
+    chunks[header.stream % 2]++;
+    auto stored = size_t(0);
+    for (size_t f = 0; f < trace_fields; f++) {
+      (header.stored[f] == header.size[f] ? raw : compressed)++;
+      stored += header.stored[f];
+    }
+    in.seekg(stored, std::ios::cur);
+  }
+  check(chunks[0] > 1 && chunks[1] > 1, "chunks ", chunks[0], " and ", chunks[1]);
+  check(raw && compressed, raw, " raw and ", compressed, " compressed columns");
+
+  if (failures) return 1;
+  print("ok");
+}